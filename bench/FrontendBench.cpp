@@ -0,0 +1,153 @@
+// FrontendBench.cpp - Throughput benchmarks for the lexer and parser
+#include "Lexer.h"
+#include "Parser.h"
+#include "SourceFile.h"
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// Build a synthetic program shaped like the demos, repeated `functions` times
+std::string generateSource(int functions) {
+    std::string source;
+    for (int i = 0; i < functions; i++) {
+        std::string name = "func_" + std::to_string(i);
+        source += "// Generated function " + std::to_string(i) + "\n";
+        source += "function " + name + "(n, acc) {\n";
+        source += "    var total = 0;\n";
+        source += "    var i = 1;\n";
+        source += "    while (i <= n && total < 100000) {\n";
+        source += "        total = total + i * (acc - 3) / 2;\n";
+        source += "        i = i + 1;\n";
+        source += "    }\n";
+        source += "    if (total >= 42 || !(n == 0)) {\n";
+        source += "        return total - -acc;\n";
+        source += "    } else {\n";
+        source += "        return " + name + "(n - 1, acc * 2);\n";
+        source += "    }\n";
+        source += "}\n\n";
+    }
+    source += "function main() {\n    return func_0(10, 1);\n}\n";
+    return source;
+}
+
+// One function returning a long arithmetic chain; every `groupSize` terms
+// are wrapped in parentheses to mix nesting into the chain
+std::string generateExpressionChain(int terms, int groupSize) {
+    static const char* const ops[] = {" + ", " * ", " - ", " / ", " < ", " == "};
+    std::string source = "function main() {\n    return ";
+    for (int i = 0; i < terms; i++) {
+        if (i % groupSize == 0) source += "(";
+        source += std::to_string(i % 97 + 1);
+        if (i % groupSize == groupSize - 1 || i == terms - 1) source += ")";
+        if (i != terms - 1) source += ops[i % 6];
+    }
+    source += ";\n}\n";
+    return source;
+}
+
+// Run `body` `repeats` times and return the best wall time in seconds
+double bestOf(int repeats, const std::function<void()>& body) {
+    double best = 1e30;
+    for (int r = 0; r < repeats; r++) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best) best = elapsed.count();
+    }
+    return best;
+}
+
+void report(const std::string& label, double seconds, size_t bytes) {
+    double mbPerSecond = static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds;
+    std::cout << "  " << std::left << std::setw(34) << label
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << seconds * 1000.0 << " ms"
+              << std::setw(12) << mbPerSecond << " MB/s\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int functions = 20000;
+    int repeats = 5;
+    int chainTerms = 200000;
+    std::string inputFile;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            functions = std::stoi(argv[++i]);
+        } else if (arg == "-e" && i + 1 < argc) {
+            chainTerms = std::stoi(argv[++i]);
+        } else if (arg == "-r" && i + 1 < argc) {
+            repeats = std::stoi(argv[++i]);
+        } else if (arg == "-h" || arg == "--help") {
+            std::cout << "Usage: " << argv[0] << " [-n functions] [-e chain_terms] [-r repeats] [input_file]\n";
+            return 0;
+        } else {
+            inputFile = arg;
+        }
+    }
+
+    SourceFile file;
+    std::string generated;
+    std::string_view source;
+    if (!inputFile.empty()) {
+        file = SourceFile::map(inputFile);
+        source = file.text();
+    } else {
+        generated = generateSource(functions);
+        source = generated;
+    }
+
+    size_t tokenCount = Lexer(source).tokenize().size();
+    ASTArena sizing;
+    {
+        Lexer lexer(source);
+        Parser(lexer, sizing).parse();
+    }
+    std::cout << "Input: " << (inputFile.empty() ? "generated" : inputFile) << ", "
+              << source.size() << " bytes, " << tokenCount << " tokens\n"
+              << "AST: " << sizing.nodeCount() << " nodes, "
+              << sizing.bytesAllocated() << " bytes in " << sizing.chunkCount() << " arena chunk(s)\n\n";
+
+    std::cout << "Lexer\n";
+    report("nextToken() loop", bestOf(repeats, [&] {
+        Lexer lexer(source);
+        while (lexer.nextToken().type != TokenType::END_OF_FILE) {}
+    }), source.size());
+
+    std::cout << "\nLexer + Parser\n";
+    report("tokenize() + Parser(vector)", bestOf(repeats, [&] {
+        Lexer lexer(source);
+        ASTArena arena;
+        Parser parser(lexer.tokenize(), arena);
+        parser.parse();
+    }), source.size());
+    report("streaming Parser(Lexer&)", bestOf(repeats, [&] {
+        Lexer lexer(source);
+        ASTArena arena;
+        Parser parser(lexer, arena);
+        parser.parse();
+    }), source.size());
+
+    std::cout << "\nExpression parser (" << chainTerms << "-term arithmetic chain)\n";
+    std::string chain = generateExpressionChain(chainTerms, 8);
+    auto parseChain = [&](Parser::ExpressionMode mode) {
+        return bestOf(repeats, [&] {
+            Lexer lexer(chain);
+            ASTArena arena;
+            Parser parser(lexer, arena);
+            parser.setExpressionMode(mode);
+            parser.parse();
+        });
+    };
+    report("recursive descent", parseChain(Parser::ExpressionMode::Descent), chain.size());
+    report("precedence table", parseChain(Parser::ExpressionMode::Precedence), chain.size());
+
+    return 0;
+}
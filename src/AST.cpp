@@ -1,11 +1,36 @@
 // AST.cpp - Implementation of AST visitor pattern methods
 #include "AST.h"
 
+const char* spelling(BinaryOp op) {
+    static const char* const names[] = {
+        "+", "-", "*", "/", "<", "<=", ">", ">=", "==", "!=", "&&", "||"
+    };
+    return names[static_cast<size_t>(op)];
+}
+
+const char* spelling(UnaryOp op) {
+    return op == UnaryOp::Negate ? "-" : "!";
+}
+
+const char* spelling(ValueType type) {
+    static const char* const names[] = {"<inferred>", "i32", "i64", "f64", "i32[]", "i64[]", "f64[]"};
+    return names[static_cast<size_t>(type)];
+}
+
+const char* spelling(ReductionOp op) {
+    static const char* const names[] = {"+", "*", "min", "max"};
+    return names[static_cast<size_t>(op)];
+}
+
 // Expression node visitor implementations
 void NumberLiteral::accept(ASTVisitor& visitor) {
     visitor.visit(*this);
 }
 
+void FloatLiteral::accept(ASTVisitor& visitor) {
+    visitor.visit(*this);
+}
+
 void BooleanLiteral::accept(ASTVisitor& visitor) {
     visitor.visit(*this);
 }
@@ -22,6 +47,10 @@ void UnaryOperation::accept(ASTVisitor& visitor) {
     visitor.visit(*this);
 }
 
+void ArrayAccess::accept(ASTVisitor& visitor) {
+    visitor.visit(*this);
+}
+
 void FunctionCall::accept(ASTVisitor& visitor) {
     visitor.visit(*this);
 }
@@ -35,6 +64,10 @@ void Assignment::accept(ASTVisitor& visitor) {
     visitor.visit(*this);
 }
 
+void ArrayAssignment::accept(ASTVisitor& visitor) {
+    visitor.visit(*this);
+}
+
 void IfStatement::accept(ASTVisitor& visitor) {
     visitor.visit(*this);
 }
@@ -43,6 +76,10 @@ void WhileStatement::accept(ASTVisitor& visitor) {
     visitor.visit(*this);
 }
 
+void ForStatement::accept(ASTVisitor& visitor) {
+    visitor.visit(*this);
+}
+
 void Block::accept(ASTVisitor& visitor) {
     visitor.visit(*this);
 }
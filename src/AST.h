@@ -1,8 +1,72 @@
 // AST.h - Abstract Syntax Tree node definitions
 #pragma once
-#include <memory>
-#include <vector>
-#include <string>
+#include "Arena.h"
+#include "SymbolTable.h"
+#include <cstdint>
+
+// Nodes are placement-constructed in an ASTArena and released with it, so
+// they hold raw child pointers and NodeLists instead of owning containers and
+// have no virtual destructor.
+
+// Operator opcodes
+enum class BinaryOp : uint8_t {
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Equal,
+    NotEqual,
+    And,
+    Or
+};
+
+enum class UnaryOp : uint8_t {
+    Negate,
+    Not
+};
+
+// Operators a parallel loop combines per-chunk partial results with
+enum class ReductionOp : uint8_t {
+    Add,
+    Mul,
+    Min,
+    Max
+};
+
+// Value types. Inferred marks an unannotated variable, which takes the
+// type of its initializer; unannotated parameters and results are I32.
+// Arrays are fixed-size locals or parameters passed as pointer + length;
+// they are never copied, so an array is only reachable through one name.
+enum class ValueType : uint8_t {
+    Inferred,
+    I32,
+    I64,
+    F64,
+    I32Array,
+    I64Array,
+    F64Array
+};
+
+inline bool isArray(ValueType type) {
+    return type >= ValueType::I32Array;
+}
+
+inline ValueType elementType(ValueType array) {
+    return static_cast<ValueType>(static_cast<uint8_t>(array) - 3);
+}
+
+inline ValueType arrayOf(ValueType element) {
+    return static_cast<ValueType>(static_cast<uint8_t>(element) + 3);
+}
+
+const char* spelling(BinaryOp op);
+const char* spelling(UnaryOp op);
+const char* spelling(ValueType type);
+const char* spelling(ReductionOp op);
 
 // Forward declarations for visitor pattern
 class ASTVisitor;
@@ -10,27 +74,37 @@ class ASTVisitor;
 // Base AST Node
 class ASTNode {
 public:
-    virtual ~ASTNode() = default;
     virtual void accept(ASTVisitor& visitor) = 0;
+    
+protected:
+    ~ASTNode() = default;
 };
 
 // Expression base class
 class Expression : public ASTNode {
-public:
-    virtual ~Expression() = default;
+protected:
+    ~Expression() = default;
 };
 
 // Statement base class  
 class Statement : public ASTNode {
-public:
-    virtual ~Statement() = default;
+protected:
+    ~Statement() = default;
 };
 
 // Expression nodes
 class NumberLiteral : public Expression {
 public:
-    int value;
-    NumberLiteral(int val) : value(val) {}
+    int64_t value;
+    ValueType type;  // I32, or I64 when the value does not fit
+    NumberLiteral(int64_t val, ValueType t = ValueType::I32) : value(val), type(t) {}
+    void accept(ASTVisitor& visitor) override;
+};
+
+class FloatLiteral : public Expression {
+public:
+    double value;
+    FloatLiteral(double val) : value(val) {}
     void accept(ASTVisitor& visitor) override;
 };
 
@@ -43,129 +117,184 @@ public:
 
 class Variable : public Expression {
 public:
-    std::string name;
-    Variable(const std::string& n) : name(n) {}
+    Symbol name;
+    Variable(Symbol n) : name(n) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 class BinaryOperation : public Expression {
 public:
-    std::unique_ptr<Expression> left;
-    std::string operator_;
-    std::unique_ptr<Expression> right;
+    Expression* left;
+    BinaryOp op;
+    Expression* right;
     
-    BinaryOperation(std::unique_ptr<Expression> l, const std::string& op, std::unique_ptr<Expression> r)
-        : left(std::move(l)), operator_(op), right(std::move(r)) {}
+    BinaryOperation(Expression* l, BinaryOp o, Expression* r)
+        : left(l), op(o), right(r) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 class UnaryOperation : public Expression {
 public:
-    std::string operator_;
-    std::unique_ptr<Expression> operand;
+    UnaryOp op;
+    Expression* operand;
     
-    UnaryOperation(const std::string& op, std::unique_ptr<Expression> expr)
-        : operator_(op), operand(std::move(expr)) {}
+    UnaryOperation(UnaryOp o, Expression* expr)
+        : op(o), operand(expr) {}
+    void accept(ASTVisitor& visitor) override;
+};
+
+class ArrayAccess : public Expression {
+public:
+    Symbol array;
+    Expression* index;
+    
+    ArrayAccess(Symbol a, Expression* i)
+        : array(a), index(i) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 class FunctionCall : public Expression {
 public:
-    std::string name;
-    std::vector<std::unique_ptr<Expression>> arguments;
+    Symbol name;
+    NodeList<Expression*> arguments;
     
-    FunctionCall(const std::string& n, std::vector<std::unique_ptr<Expression>> args)
-        : name(n), arguments(std::move(args)) {}
+    FunctionCall(Symbol n, NodeList<Expression*> args)
+        : name(n), arguments(args) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 // Statement nodes
 class VariableDeclaration : public Statement {
 public:
-    std::string name;
-    std::unique_ptr<Expression> initializer;
+    Symbol name;
+    Expression* initializer;
+    ValueType type;
+    uint32_t length;  // Element count of a local array
     
-    VariableDeclaration(const std::string& n, std::unique_ptr<Expression> init)
-        : name(n), initializer(std::move(init)) {}
+    VariableDeclaration(Symbol n, Expression* init, ValueType t = ValueType::Inferred, uint32_t len = 0)
+        : name(n), initializer(init), type(t), length(len) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 class Assignment : public Statement {
 public:
-    std::string name;
-    std::unique_ptr<Expression> value;
+    Symbol name;
+    Expression* value;
+    
+    Assignment(Symbol n, Expression* val)
+        : name(n), value(val) {}
+    void accept(ASTVisitor& visitor) override;
+};
+
+class ArrayAssignment : public Statement {
+public:
+    Symbol array;
+    Expression* index;
+    Expression* value;
     
-    Assignment(const std::string& n, std::unique_ptr<Expression> val)
-        : name(n), value(std::move(val)) {}
+    ArrayAssignment(Symbol a, Expression* i, Expression* val)
+        : array(a), index(i), value(val) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 class IfStatement : public Statement {
 public:
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<Statement> thenBranch;
-    std::unique_ptr<Statement> elseBranch;
+    Expression* condition;
+    Statement* thenBranch;
+    Statement* elseBranch;
     
-    IfStatement(std::unique_ptr<Expression> cond, std::unique_ptr<Statement> then, 
-                std::unique_ptr<Statement> else_ = nullptr)
-        : condition(std::move(cond)), thenBranch(std::move(then)), elseBranch(std::move(else_)) {}
+    IfStatement(Expression* cond, Statement* then, Statement* else_ = nullptr)
+        : condition(cond), thenBranch(then), elseBranch(else_) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 class WhileStatement : public Statement {
 public:
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<Statement> body;
+    Expression* condition;
+    Statement* body;
+    
+    WhileStatement(Expression* cond, Statement* b)
+        : condition(cond), body(b) {}
+    void accept(ASTVisitor& visitor) override;
+};
+
+// for (variable in start .. end) body: the variable counts from start up to
+// end - 1; end is evaluated once and the body cannot assign the variable,
+// so the trip count is known on entry.
+//
+// A parallel for splits the range into chunks that run on the worker pool.
+// Its body reads the enclosing variables as they were on entry and may only
+// assign its reduction variables, each of which starts a chunk at the
+// operator's identity; the chunks' results are folded into the variable in
+// chunk order once all have finished.
+struct Reduction {
+    Symbol variable;
+    ReductionOp op;
+};
+
+class ForStatement : public Statement {
+public:
+    Symbol variable;
+    Expression* start;
+    Expression* end;
+    Statement* body;
+    bool parallel;
+    NodeList<Reduction> reductions;
     
-    WhileStatement(std::unique_ptr<Expression> cond, std::unique_ptr<Statement> b)
-        : condition(std::move(cond)), body(std::move(b)) {}
+    ForStatement(Symbol v, Expression* s, Expression* e, Statement* b, bool par = false,
+                 NodeList<Reduction> reds = {})
+        : variable(v), start(s), end(e), body(b), parallel(par), reductions(reds) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 class Block : public Statement {
 public:
-    std::vector<std::unique_ptr<Statement>> statements;
+    NodeList<Statement*> statements;
     
-    Block(std::vector<std::unique_ptr<Statement>> stmts)
-        : statements(std::move(stmts)) {}
+    Block(NodeList<Statement*> stmts)
+        : statements(stmts) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 class FunctionDeclaration : public Statement {
 public:
-    std::string name;
-    std::vector<std::string> parameters;
-    std::unique_ptr<Block> body;
+    Symbol name;
+    NodeList<Symbol> parameters;
+    NodeList<ValueType> parameterTypes;  // Parallel to `parameters`
+    ValueType returnType;
+    Block* body;
+    bool memoize;  // Annotated @memo
     
-    FunctionDeclaration(const std::string& n, std::vector<std::string> params, std::unique_ptr<Block> b)
-        : name(n), parameters(std::move(params)), body(std::move(b)) {}
+    FunctionDeclaration(Symbol n, NodeList<Symbol> params, NodeList<ValueType> types, ValueType result,
+                        Block* b, bool memo = false)
+        : name(n), parameters(params), parameterTypes(types), returnType(result), body(b), memoize(memo) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 class ReturnStatement : public Statement {
 public:
-    std::unique_ptr<Expression> value;
+    Expression* value;
     
-    ReturnStatement(std::unique_ptr<Expression> val = nullptr)
-        : value(std::move(val)) {}
+    ReturnStatement(Expression* val = nullptr)
+        : value(val) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 class ExpressionStatement : public Statement {
 public:
-    std::unique_ptr<Expression> expression;
+    Expression* expression;
     
-    ExpressionStatement(std::unique_ptr<Expression> expr)
-        : expression(std::move(expr)) {}
+    ExpressionStatement(Expression* expr)
+        : expression(expr) {}
     void accept(ASTVisitor& visitor) override;
 };
 
 class Program : public ASTNode {
 public:
-    std::vector<std::unique_ptr<Statement>> statements;
+    NodeList<Statement*> statements;
     
-    Program(std::vector<std::unique_ptr<Statement>> stmts)
-        : statements(std::move(stmts)) {}
+    Program(NodeList<Statement*> stmts)
+        : statements(stmts) {}
     void accept(ASTVisitor& visitor) override;
 };
 
@@ -174,15 +303,19 @@ class ASTVisitor {
 public:
     virtual ~ASTVisitor() = default;
     virtual void visit(NumberLiteral& node) = 0;
+    virtual void visit(FloatLiteral& node) = 0;
     virtual void visit(BooleanLiteral& node) = 0;
     virtual void visit(Variable& node) = 0;
     virtual void visit(BinaryOperation& node) = 0;
     virtual void visit(UnaryOperation& node) = 0;
+    virtual void visit(ArrayAccess& node) = 0;
     virtual void visit(FunctionCall& node) = 0;
     virtual void visit(VariableDeclaration& node) = 0;
     virtual void visit(Assignment& node) = 0;
+    virtual void visit(ArrayAssignment& node) = 0;
     virtual void visit(IfStatement& node) = 0;
     virtual void visit(WhileStatement& node) = 0;
+    virtual void visit(ForStatement& node) = 0;
     virtual void visit(Block& node) = 0;
     virtual void visit(FunctionDeclaration& node) = 0;
     virtual void visit(ReturnStatement& node) = 0;
@@ -0,0 +1,29 @@
+// Arena.cpp - Implementation
+#include "Arena.h"
+#include <algorithm>
+
+ASTArena::ASTArena(size_t firstChunkSize)
+    : cursor(nullptr), limit(nullptr), nextChunkSize(std::max<size_t>(firstChunkSize, 1024)),
+      bytesUsed(0), bytesReserved(0), nodes(0) {}
+
+void* ASTArena::allocateSlow(size_t size, size_t align) {
+    // Chunks double in size so a large unit needs only O(log n) of them;
+    // oversized requests get a chunk of their own
+    size_t chunkSize = std::max(nextChunkSize, size + align);
+    nextChunkSize = std::min(nextChunkSize * 2, MAX_CHUNK_SIZE);
+
+    chunks.emplace_back(new char[chunkSize]);
+    bytesReserved += chunkSize;
+    cursor = chunks.back().get();
+    limit = cursor + chunkSize;
+    return allocate(size, align);
+}
+
+void ASTArena::release() {
+    chunks.clear();
+    cursor = nullptr;
+    limit = nullptr;
+    bytesUsed = 0;
+    bytesReserved = 0;
+    nodes = 0;
+}
@@ -0,0 +1,86 @@
+// Arena.h - Bump allocator that owns every AST node of one compilation unit
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Fixed-size list of arena-allocated items (statements, arguments, ...).
+// Trivially destructible, so nodes holding one need no destructor.
+template <typename T>
+struct NodeList {
+    T* items = nullptr;
+    uint32_t count = 0;
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t index) const { return items[index]; }
+};
+
+class ASTArena {
+private:
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char* cursor;
+    char* limit;
+    size_t nextChunkSize;
+
+    size_t bytesUsed;      // Bytes handed out to nodes and lists
+    size_t bytesReserved;  // Bytes obtained from the system
+    size_t nodes;
+
+    void* allocateSlow(size_t size, size_t align);
+
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t MAX_CHUNK_SIZE = 16 * 1024 * 1024;
+
+    explicit ASTArena(size_t firstChunkSize = DEFAULT_CHUNK_SIZE);
+    ASTArena(const ASTArena&) = delete;
+    ASTArena& operator=(const ASTArena&) = delete;
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+        if (cursor && aligned + size <= reinterpret_cast<uintptr_t>(limit)) {
+            cursor = reinterpret_cast<char*>(aligned + size);
+            bytesUsed += size;
+            return reinterpret_cast<void*>(aligned);
+        }
+        return allocateSlow(size, align);
+    }
+
+    // Placement-construct a node. Nodes are never destroyed individually:
+    // the arena releases their memory wholesale, so they must not own
+    // anything that needs a destructor.
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "arena-allocated nodes must be trivially destructible");
+        nodes++;
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    NodeList<T> copyList(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable<T>::value, "list items must be trivially copyable");
+        NodeList<T> list;
+        list.count = static_cast<uint32_t>(values.size());
+        if (!values.empty()) {
+            list.items = static_cast<T*>(allocate(sizeof(T) * values.size(), alignof(T)));
+            std::uninitialized_copy(values.begin(), values.end(), list.items);
+        }
+        return list;
+    }
+
+    // Drop every node at once; no destructors run
+    void release();
+
+    size_t nodeCount() const { return nodes; }
+    size_t bytesAllocated() const { return bytesUsed; }
+    size_t bytesReservedTotal() const { return bytesReserved; }
+    size_t chunkCount() const { return chunks.size(); }
+};
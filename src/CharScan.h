@@ -0,0 +1,177 @@
+// CharScan.h - Vectorized character-class scanning kernels used by the Lexer
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Each kernel scans [p, end) and returns a pointer to the first byte that does
+// not belong to the run (or `end`). Blocks are processed 32 bytes at a time
+// with AVX2, 16 with SSE2, and the tail (or everything, on other targets) is
+// handled by the scalar loop. Loads never read past `end`.
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#define SIMPLELANG_SCAN_AVX2 1
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMPLELANG_SCAN_SSE2 1
+#endif
+
+namespace scan {
+
+inline bool isWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline bool isIdentifierStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+inline bool isIdentifierChar(char c) {
+    return isIdentifierStart(c) || isDigit(c);
+}
+
+#if defined(SIMPLELANG_SCAN_AVX2) || defined(SIMPLELANG_SCAN_SSE2)
+
+// One SIMD register worth of input. Comparisons return a bitmask with bit i
+// set when byte i matches.
+struct Block {
+#ifdef SIMPLELANG_SCAN_AVX2
+    static constexpr size_t WIDTH = 32;
+    static constexpr uint32_t ALL = 0xFFFFFFFFu;
+    __m256i bytes;
+
+    explicit Block(const char* p)
+        : bytes(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))) {}
+
+    uint32_t eq(char c) const {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c))));
+    }
+
+    // Bytes in [lo, hi]. The comparison is signed, so non-ASCII bytes
+    // (negative as int8) never fall inside an ASCII range.
+    uint32_t inRange(char lo, char hi) const {
+        __m256i aboveLo = _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(static_cast<char>(lo - 1)));
+        __m256i belowHi = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), bytes);
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(aboveLo, belowHi)));
+    }
+#else
+    static constexpr size_t WIDTH = 16;
+    static constexpr uint32_t ALL = 0xFFFFu;
+    __m128i bytes;
+
+    explicit Block(const char* p)
+        : bytes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) {}
+
+    uint32_t eq(char c) const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c))));
+    }
+
+    uint32_t inRange(char lo, char hi) const {
+        __m128i aboveLo = _mm_cmpgt_epi8(bytes, _mm_set1_epi8(static_cast<char>(lo - 1)));
+        __m128i belowHi = _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(hi + 1)), bytes);
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(aboveLo, belowHi)));
+    }
+#endif
+};
+
+// Offset of the first byte that is NOT in `mask`; requires mask != ALL
+inline unsigned firstClear(uint32_t mask) {
+    return static_cast<unsigned>(__builtin_ctz(~mask));
+}
+
+// Account for the newlines selected by `newlineMask` in the block at `p`
+inline void countNewlines(uint32_t newlineMask, const char* p, int& newlines, const char*& lineStart) {
+    if (newlineMask) {
+        newlines += __builtin_popcount(newlineMask);
+        lineStart = p + (31 - __builtin_clz(newlineMask)) + 1;
+    }
+}
+
+#endif
+
+// Skip spaces, tabs, carriage returns and newlines. Every newline crossed
+// increments `newlines`, and `lineStart` is left pointing just past the last
+// one, so callers can update line/column in bulk.
+inline const char* skipWhitespace(const char* p, const char* end, int& newlines, const char*& lineStart) {
+#if defined(SIMPLELANG_SCAN_AVX2) || defined(SIMPLELANG_SCAN_SSE2)
+    while (p + Block::WIDTH <= end) {
+        Block block(p);
+        uint32_t newlineMask = block.eq('\n');
+        uint32_t whitespace = newlineMask | block.eq(' ') | block.eq('\t') | block.eq('\r');
+        if (whitespace == Block::ALL) {
+            countNewlines(newlineMask, p, newlines, lineStart);
+            p += Block::WIDTH;
+            continue;
+        }
+        unsigned stop = firstClear(whitespace);
+        countNewlines(newlineMask & ((1u << stop) - 1), p, newlines, lineStart);
+        return p + stop;
+    }
+#endif
+    while (p < end && isWhitespace(*p)) {
+        if (*p == '\n') {
+            newlines++;
+            lineStart = p + 1;
+        }
+        p++;
+    }
+    return p;
+}
+
+// Find the end of the current line (the '\n' itself is not consumed)
+inline const char* findNewline(const char* p, const char* end) {
+#if defined(SIMPLELANG_SCAN_AVX2) || defined(SIMPLELANG_SCAN_SSE2)
+    while (p + Block::WIDTH <= end) {
+        uint32_t newlineMask = Block(p).eq('\n');
+        if (newlineMask) {
+            return p + __builtin_ctz(newlineMask);
+        }
+        p += Block::WIDTH;
+    }
+#endif
+    while (p < end && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+// Skip [A-Za-z0-9_]
+inline const char* skipIdentifier(const char* p, const char* end) {
+#if defined(SIMPLELANG_SCAN_AVX2) || defined(SIMPLELANG_SCAN_SSE2)
+    while (p + Block::WIDTH <= end) {
+        Block block(p);
+        uint32_t identifier = block.inRange('a', 'z') | block.inRange('A', 'Z') |
+                              block.inRange('0', '9') | block.eq('_');
+        if (identifier != Block::ALL) {
+            return p + firstClear(identifier);
+        }
+        p += Block::WIDTH;
+    }
+#endif
+    while (p < end && isIdentifierChar(*p)) {
+        p++;
+    }
+    return p;
+}
+
+// Skip [0-9]
+inline const char* skipDigits(const char* p, const char* end) {
+#if defined(SIMPLELANG_SCAN_AVX2) || defined(SIMPLELANG_SCAN_SSE2)
+    while (p + Block::WIDTH <= end) {
+        uint32_t digits = Block(p).inRange('0', '9');
+        if (digits != Block::ALL) {
+            return p + firstClear(digits);
+        }
+        p += Block::WIDTH;
+    }
+#endif
+    while (p < end && isDigit(*p)) {
+        p++;
+    }
+    return p;
+}
+
+} // namespace scan
@@ -1,86 +1,2419 @@
 // CodeGen.cpp - Complete LLVM Code Generator with bug fixes
 #include "CodeGen.h"
+#include "Runtime.h"
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/StandardInstrumentations.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/PassTimingInfo.h>
+#include <llvm/IR/ValueHandle.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#if LLVM_VERSION_MAJOR >= 14
+#include <llvm/MC/TargetRegistry.h>
+#else
+#include <llvm/Support/TargetRegistry.h>
+#endif
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+
+namespace {
+
+void initializeNativeTarget() {
+    // Generators may be created on several threads at once
+    static std::once_flag initialized;
+    std::call_once(initialized, [] {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
+}
+
+// Host CPU features as a sorted "+feature,-feature" list
+std::string hostFeatures() {
+    std::vector<std::string> names;
+    llvm::StringMap<bool> hostFeatures;
+    if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+        for (auto& feature : hostFeatures) {
+            names.push_back((feature.second ? "+" : "-") + feature.first().str());
+        }
+    }
+    std::sort(names.begin(), names.end());
+    
+    std::string features;
+    for (const auto& name : names) {
+        if (!features.empty()) features += ",";
+        features += name;
+    }
+    return features;
+}
+
+llvm::CodeGenOpt::Level codeGenOptLevel(int level) {
+    return level == 0 ? llvm::CodeGenOpt::None
+         : level >= 3 ? llvm::CodeGenOpt::Aggressive
+         : llvm::CodeGenOpt::Default;
+}
+
+std::unique_ptr<llvm::TargetMachine> createHostTargetMachine() {
+    std::string triple = llvm::sys::getProcessTriple();
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!target) {
+        throw CodeGenError("No target for " + triple + ": " + error);
+    }
+    std::string features = hostFeatures();
+    
+    // PIC so the same machine code can be linked into position-independent executables
+    return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+        triple, llvm::sys::getHostCPUName(), features, llvm::TargetOptions(), llvm::Reloc::PIC_));
+}
+
+const char* cTypeName(llvm::Type* type) {
+    if (type->isIntegerTy(32)) return "int32_t";
+    if (type->isIntegerTy(64)) return "int64_t";
+    if (type->isDoubleTy()) return "double";
+    if (type->isVoidTy()) return "void";
+    throw CodeGenError("Type has no C equivalent");
+}
+
+llvm::OptimizationLevel optimizationLevel(int level) {
+    switch (level) {
+        case 0: return llvm::OptimizationLevel::O0;
+        case 1: return llvm::OptimizationLevel::O1;
+        case 2: return llvm::OptimizationLevel::O2;
+        default: return llvm::OptimizationLevel::O3;
+    }
+}
+
+// Tail-call recognition, over the pointer tree and over the flat AST. A
+// return is a self tail call when it returns `self(args)` directly, or
+// `operand op self(args)` / `self(args) op operand` with op + or * and a
+// call-free operand; + and * on wrapping i32 are associative and
+// commutative, so such returns can be accumulated into a loop.
+struct TailCallMatch {
+    FunctionCall* call = nullptr;
+    Expression* operand = nullptr;
+    bool operandFirst = false;
+    BinaryOp op = BinaryOp::Add;
+};
+
+bool containsCall(Expression* expression) {
+    if (dynamic_cast<FunctionCall*>(expression)) {
+        return true;
+    }
+    if (auto* binary = dynamic_cast<BinaryOperation*>(expression)) {
+        return containsCall(binary->left) || containsCall(binary->right);
+    }
+    if (auto* unary = dynamic_cast<UnaryOperation*>(expression)) {
+        return containsCall(unary->operand);
+    }
+    if (auto* element = dynamic_cast<ArrayAccess*>(expression)) {
+        return containsCall(element->index);
+    }
+    return false;
+}
+
+FunctionCall* selfCall(Expression* expression, Symbol self, size_t arity) {
+    auto* call = dynamic_cast<FunctionCall*>(expression);
+    return call && call->name == self && call->arguments.size() == arity ? call : nullptr;
+}
+
+TailCallMatch matchTailCall(Expression* value, Symbol self, size_t arity) {
+    TailCallMatch match;
+    if ((match.call = selfCall(value, self, arity))) {
+        return match;
+    }
+    auto* binary = dynamic_cast<BinaryOperation*>(value);
+    if (!binary || (binary->op != BinaryOp::Add && binary->op != BinaryOp::Mul)) {
+        return match;
+    }
+    match.op = binary->op;
+    if ((match.call = selfCall(binary->right, self, arity)) && !containsCall(binary->left)) {
+        match.operand = binary->left;
+        match.operandFirst = true;
+    } else if ((match.call = selfCall(binary->left, self, arity)) && !containsCall(binary->right)) {
+        match.operand = binary->right;
+    } else {
+        match.call = nullptr;
+    }
+    return match;
+}
+
+void scanReturns(Statement* statement, Symbol self, size_t arity, TailCallPlan& plan) {
+    if (auto* block = dynamic_cast<Block*>(statement)) {
+        for (Statement* child : block->statements) {
+            scanReturns(child, self, arity, plan);
+        }
+    } else if (auto* ifStatement = dynamic_cast<IfStatement*>(statement)) {
+        scanReturns(ifStatement->thenBranch, self, arity, plan);
+        if (ifStatement->elseBranch) {
+            scanReturns(ifStatement->elseBranch, self, arity, plan);
+        }
+    } else if (auto* whileStatement = dynamic_cast<WhileStatement*>(statement)) {
+        scanReturns(whileStatement->body, self, arity, plan);
+    } else if (auto* forStatement = dynamic_cast<ForStatement*>(statement)) {
+        scanReturns(forStatement->body, self, arity, plan);
+    } else if (auto* returnStatement = dynamic_cast<ReturnStatement*>(statement)) {
+        if (returnStatement->value) {
+            TailCallMatch match = matchTailCall(returnStatement->value, self, arity);
+            if (match.call) {
+                plan.note(match.operand != nullptr, match.op);
+            }
+        }
+    }
+}
+
+struct FlatTailCallMatch {
+    NodeIndex call = NO_NODE;
+    NodeIndex operand = NO_NODE;
+    bool operandFirst = false;
+    BinaryOp op = BinaryOp::Add;
+};
+
+bool containsCall(const FlatAST& ast, NodeIndex expression) {
+    for (NodeIndex i = ast.expressionStart(expression); i <= expression; i++) {
+        if (ast.kinds[i] == NodeKind::Call) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool isSelfCall(const FlatAST& ast, NodeIndex expression, Symbol self, size_t arity) {
+    return ast.kinds[expression] == NodeKind::Call && static_cast<Symbol>(ast.values[expression]) == self &&
+           ast.b[expression] == arity;
+}
+
+FlatTailCallMatch matchTailCall(const FlatAST& ast, NodeIndex value, Symbol self, size_t arity) {
+    FlatTailCallMatch match;
+    if (isSelfCall(ast, value, self, arity)) {
+        match.call = value;
+        return match;
+    }
+    if (ast.kinds[value] != NodeKind::Binary ||
+        (ast.binaryOp(value) != BinaryOp::Add && ast.binaryOp(value) != BinaryOp::Mul)) {
+        return match;
+    }
+    match.op = ast.binaryOp(value);
+    NodeIndex left = ast.a[value];
+    NodeIndex right = ast.b[value];
+    if (isSelfCall(ast, right, self, arity) && !containsCall(ast, left)) {
+        match.call = right;
+        match.operand = left;
+        match.operandFirst = true;
+    } else if (isSelfCall(ast, left, self, arity) && !containsCall(ast, right)) {
+        match.call = left;
+        match.operand = right;
+    }
+    return match;
+}
+
+void scanReturns(const FlatAST& ast, NodeIndex statement, Symbol self, size_t arity, TailCallPlan& plan) {
+    switch (ast.kinds[statement]) {
+        case NodeKind::Block:
+            for (NodeIndex i = 0; i < ast.b[statement]; i++) {
+                scanReturns(ast, ast.listItem(statement, i), self, arity, plan);
+            }
+            break;
+        case NodeKind::If:
+            scanReturns(ast, ast.b[statement], self, arity, plan);
+            if (ast.c[statement] != NO_NODE) {
+                scanReturns(ast, ast.c[statement], self, arity, plan);
+            }
+            break;
+        case NodeKind::While:
+            scanReturns(ast, ast.b[statement], self, arity, plan);
+            break;
+        case NodeKind::For:
+        case NodeKind::ParallelFor:
+            scanReturns(ast, ast.c[statement], self, arity, plan);
+            break;
+        case NodeKind::Return:
+            if (ast.a[statement] != NO_NODE) {
+                FlatTailCallMatch match = matchTailCall(ast, ast.a[statement], self, arity);
+                if (match.call != NO_NODE) {
+                    plan.note(match.operand != NO_NODE, match.op);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Calls `visit` with the callee of every call under a node, in source
+// order. Walks an explicit stack, since operator chains can nest deeper
+// than the native one.
+void forEachCall(ASTNode* root, const std::function<void(Symbol)>& visit) {
+    std::vector<ASTNode*> pending{root};
+    // Children go on in reverse so the leftmost is visited first
+    auto push = [&](std::initializer_list<ASTNode*> children) {
+        pending.insert(pending.end(), std::rbegin(children), std::rend(children));
+    };
+    while (!pending.empty()) {
+        ASTNode* node = pending.back();
+        pending.pop_back();
+        if (!node) {
+            continue;
+        }
+        if (auto* call = dynamic_cast<FunctionCall*>(node)) {
+            visit(call->name);
+            pending.insert(pending.end(), std::make_reverse_iterator(call->arguments.end()),
+                           std::make_reverse_iterator(call->arguments.begin()));
+        } else if (auto* binary = dynamic_cast<BinaryOperation*>(node)) {
+            push({binary->left, binary->right});
+        } else if (auto* unary = dynamic_cast<UnaryOperation*>(node)) {
+            push({unary->operand});
+        } else if (auto* element = dynamic_cast<ArrayAccess*>(node)) {
+            push({element->index});
+        } else if (auto* store = dynamic_cast<ArrayAssignment*>(node)) {
+            push({store->index, store->value});
+        } else if (auto* forStatement = dynamic_cast<ForStatement*>(node)) {
+            push({forStatement->start, forStatement->end, forStatement->body});
+        } else if (auto* declaration = dynamic_cast<VariableDeclaration*>(node)) {
+            push({declaration->initializer});
+        } else if (auto* assignment = dynamic_cast<Assignment*>(node)) {
+            push({assignment->value});
+        } else if (auto* ifStatement = dynamic_cast<IfStatement*>(node)) {
+            push({ifStatement->condition, ifStatement->thenBranch, ifStatement->elseBranch});
+        } else if (auto* whileStatement = dynamic_cast<WhileStatement*>(node)) {
+            push({whileStatement->condition, whileStatement->body});
+        } else if (auto* block = dynamic_cast<Block*>(node)) {
+            pending.insert(pending.end(), std::make_reverse_iterator(block->statements.end()),
+                           std::make_reverse_iterator(block->statements.begin()));
+        } else if (auto* function = dynamic_cast<FunctionDeclaration*>(node)) {
+            push({function->body});
+        } else if (auto* returnStatement = dynamic_cast<ReturnStatement*>(node)) {
+            push({returnStatement->value});
+        } else if (auto* expressionStatement = dynamic_cast<ExpressionStatement*>(node)) {
+            push({expressionStatement->expression});
+        }
+    }
+}
+
+// Calls to `callee` anywhere under a node; used to pick the functions
+// --memoize applies to
+size_t countCalls(ASTNode* node, Symbol callee) {
+    size_t count = 0;
+    forEachCall(node, [&](Symbol name) {
+        if (name == callee) count++;
+    });
+    return count;
+}
+
+size_t countCalls(const FlatAST& ast, NodeIndex statement, Symbol callee) {
+    if (statement == NO_NODE) {
+        return 0;
+    }
+    auto expressionCalls = [&](NodeIndex expression) {
+        size_t count = 0;
+        if (expression != NO_NODE) {
+            for (NodeIndex i = ast.expressionStart(expression); i <= expression; i++) {
+                if (ast.kinds[i] == NodeKind::Call && static_cast<Symbol>(ast.values[i]) == callee) {
+                    count++;
+                }
+            }
+        }
+        return count;
+    };
+    switch (ast.kinds[statement]) {
+        case NodeKind::Block: {
+            size_t count = 0;
+            for (NodeIndex i = 0; i < ast.b[statement]; i++) {
+                count += countCalls(ast, ast.listItem(statement, i), callee);
+            }
+            return count;
+        }
+        case NodeKind::If:
+            return expressionCalls(ast.a[statement]) + countCalls(ast, ast.b[statement], callee) +
+                   countCalls(ast, ast.c[statement], callee);
+        case NodeKind::While:
+            return expressionCalls(ast.a[statement]) + countCalls(ast, ast.b[statement], callee);
+        case NodeKind::For:
+            return expressionCalls(ast.a[statement]) + expressionCalls(ast.b[statement]) +
+                   countCalls(ast, ast.c[statement], callee);
+        case NodeKind::ParallelFor:
+            return expressionCalls(ast.listItem(statement, 0)) + expressionCalls(ast.listItem(statement, 1)) +
+                   countCalls(ast, ast.c[statement], callee);
+        case NodeKind::ArrayAssignment:
+            return expressionCalls(ast.a[statement]) + expressionCalls(ast.b[statement]);
+        case NodeKind::VariableDeclaration:
+        case NodeKind::Assignment:
+        case NodeKind::Return:
+        case NodeKind::ExpressionStatement:
+            return expressionCalls(ast.a[statement]);
+        default:
+            return 0;
+    }
+}
+
+// Memo tables: one-argument functions get a direct-indexed array for
+// arguments in [0, MEMO_DENSE_SIZE); everything else goes through a
+// direct-mapped hash table where a colliding entry simply replaces the old one
+constexpr uint32_t MEMO_DENSE_SIZE = 1u << 16;
+constexpr uint32_t MEMO_HASH_SIZE = 1u << 12;
+
+// Local arrays are aligned for the widest vector loads the host may use
+constexpr uint64_t ARRAY_ALIGNMENT = 64;
+// Arrays live in the stack frame; one function's may take at most this much
+// of the 8 MiB main and worker stacks, leaving room for recursion
+constexpr uint64_t MAX_ARRAY_BYTES = 1 << 20;
+
+const char* const ARRAY_VALUE_ERROR = "Arrays can only be indexed, passed to functions or given to len()";
+
+// Arguments of a forked call followed by its result
+llvm::StructType* forkFrameType(llvm::Function* callee) {
+    llvm::FunctionType* type = callee->getFunctionType();
+    std::vector<llvm::Type*> fields(type->param_begin(), type->param_end());
+    fields.push_back(type->getReturnType());
+    return llvm::StructType::get(callee->getContext(), fields);
+}
+
+// Host JIT with process symbols (the C library, the driver's exports)
+// visible to generated code
+template <typename JIT, typename Builder>
+std::unique_ptr<JIT> createJIT(int optLevel) {
+    llvm::Expected<llvm::orc::JITTargetMachineBuilder> machineBuilder =
+        llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!machineBuilder) {
+        throw CodeGenError("Failed to detect host: " + llvm::toString(machineBuilder.takeError()));
+    }
+    machineBuilder->setCodeGenOptLevel(codeGenOptLevel(optLevel));
+    
+    llvm::Expected<std::unique_ptr<JIT>> jit = Builder()
+        .setJITTargetMachineBuilder(std::move(*machineBuilder))
+        .create();
+    if (!jit) {
+        throw CodeGenError("Failed to create JIT: " + llvm::toString(jit.takeError()));
+    }
+    
+    auto processSymbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        (*jit)->getDataLayout().getGlobalPrefix());
+    if (!processSymbols) {
+        throw CodeGenError("Failed to load process symbols: " + llvm::toString(processSymbols.takeError()));
+    }
+    (*jit)->getMainJITDylib().addGenerator(std::move(*processSymbols));
+    
+    // The runtime is linked into the driver but not exported from it
+    llvm::orc::SymbolMap runtime;
+    for (const auto& [name, address] : runtimeSymbols()) {
+#if LLVM_VERSION_MAJOR >= 17
+        runtime[(*jit)->mangleAndIntern(name)] = llvm::orc::ExecutorSymbolDef(
+            llvm::orc::ExecutorAddr::fromPtr(address), llvm::JITSymbolFlags::Exported);
+#else
+        runtime[(*jit)->mangleAndIntern(name)] = llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(address), llvm::JITSymbolFlags::Exported);
+#endif
+    }
+    if (llvm::Error error = (*jit)->getMainJITDylib().define(llvm::orc::absoluteSymbols(std::move(runtime)))) {
+        throw CodeGenError("Failed to bind the runtime: " + llvm::toString(std::move(error)));
+    }
+    return std::move(*jit);
+}
+
+int runMain(llvm::orc::LLJIT& jit, const std::string& mainName) {
+    auto mainSymbol = jit.lookup(mainName);
+    if (!mainSymbol) {
+        throw CodeGenError("Main function not found: " + llvm::toString(mainSymbol.takeError()));
+    }
+#if LLVM_VERSION_MAJOR >= 15
+    auto mainEntry = mainSymbol->toPtr<int (*)()>();
+#else
+    auto mainEntry = reinterpret_cast<int (*)()>(static_cast<uintptr_t>(mainSymbol->getAddress()));
+#endif
+    // print() writes around the driver's own buffered output
+    std::cout.flush();
+    int result = mainEntry();
+    simplelang_flush();
+    return result;
+}
+
+} // namespace
+
+void TailCallPlan::note(bool accumulated, BinaryOp returnOp) {
+    if (!accumulated) {
+        selfTailCalls = true;
+    } else if (!conflict && accumulate && op != returnOp) {
+        // One accumulator cannot serve both + and *
+        conflict = true;
+        accumulate = false;
+    } else if (!conflict) {
+        accumulate = true;
+        op = returnOp;
+        selfTailCalls = true;
+    }
+}
+
+std::string CodeGenOptions::key() const {
+    std::string key = ssa ? "ssa" : "alloca";
+    if (memoize) key += ",memoize";
+    if (fastMath) key += ",fast-math";
+    if (autoParallel) key += ",auto-parallel";
+    return key;
+}
+
+bool TailCallPlan::accepts(bool accumulated, BinaryOp returnOp) const {
+    return !accumulated || (accumulate && op == returnOp);
+}
+
+void addCalls(FunctionDeclaration& function, CallGraph& calls) {
+    std::vector<Symbol>& callees = calls[function.name];
+    forEachCall(function.body, [&](Symbol callee) { callees.push_back(callee); });
+}
+
+void findPrintingFunctions(const CallGraph& calls, std::unordered_set<Symbol>& printing) {
+    static const Symbol print = SymbolTable::global().intern("print");
+    static const Symbol println = SymbolTable::global().intern("println");
+    
+    // Mark direct printers, then walk back from each newly marked function
+    // to its callers
+    std::unordered_map<Symbol, std::vector<Symbol>> callers;
+    std::vector<Symbol> marked;
+    for (const auto& [function, callees] : calls) {
+        for (Symbol callee : callees) {
+            bool builtin = (callee == print || callee == println) && !calls.count(callee);
+            if (!builtin && !printing.count(callee)) {
+                callers[callee].push_back(function);
+            } else if (printing.insert(function).second) {
+                marked.push_back(function);
+            }
+        }
+    }
+    while (!marked.empty()) {
+        Symbol function = marked.back();
+        marked.pop_back();
+        for (Symbol caller : callers[function]) {
+            if (printing.insert(caller).second) {
+                marked.push_back(caller);
+            }
+        }
+    }
+}
 
 CodeGenerator::CodeGenerator() {
     // Initialize LLVM
-    llvm::InitializeNativeTarget();
-    llvm::InitializeNativeTargetAsmPrinter();
-    llvm::InitializeNativeTargetAsmParser();
+    initializeNativeTarget();
     
     context = std::make_unique<llvm::LLVMContext>();
     module = std::make_unique<llvm::Module>("SimpleLang", *context);
     builder = std::make_unique<llvm::IRBuilder<>>(*context);
     
-    currentFunction = nullptr;
-    lastValue = nullptr;
+    targetMachine = createHostTargetMachine();
+    module->setTargetTriple(targetMachine->getTargetTriple().str());
+    module->setDataLayout(targetMachine->createDataLayout());
+    optLevel = 0;
+    
+    currentFunction = nullptr;
+    lastValue = nullptr;
+}
+
+llvm::AllocaInst* CodeGenerator::createEntryBlockAlloca(llvm::Function* function, const std::string& varName,
+                                                       llvm::Type* type) {
+    llvm::IRBuilder<> tmpBuilder(&function->getEntryBlock(), function->getEntryBlock().begin());
+    return tmpBuilder.CreateAlloca(type, nullptr, varName);
+}
+
+llvm::Type* CodeGenerator::llvmType(ValueType type) {
+    switch (type) {
+        case ValueType::I64: return llvm::Type::getInt64Ty(*context);
+        case ValueType::F64: return llvm::Type::getDoubleTy(*context);
+        case ValueType::I32Array:
+        case ValueType::I64Array:
+        case ValueType::F64Array:
+            return llvm::PointerType::getUnqual(llvmType(elementType(type)));
+        default: return llvm::Type::getInt32Ty(*context);
+    }
+}
+
+llvm::FunctionType* CodeGenerator::functionType(const std::vector<ValueType>& parameterTypes, ValueType returnType) {
+    std::vector<llvm::Type*> types;
+    for (ValueType type : parameterTypes) {
+        types.push_back(llvmType(type));
+        if (isArray(type)) {
+            types.push_back(llvm::Type::getInt64Ty(*context));
+        }
+    }
+    return llvm::FunctionType::get(llvmType(returnType), types, false);
+}
+
+void CodeGenerator::addArrayAttributes(llvm::Function* function, const std::vector<ValueType>& parameterTypes) {
+    unsigned index = 0;
+    for (ValueType type : parameterTypes) {
+        if (isArray(type)) {
+            llvm::Align alignment = module->getDataLayout().getABITypeAlign(llvmType(elementType(type)));
+            function->addParamAttr(index, llvm::Attribute::NoAlias);
+#if LLVM_VERSION_MAJOR >= 21
+            function->addParamAttr(index, llvm::Attribute::getWithCaptureInfo(*context, llvm::CaptureInfo::none()));
+#else
+            function->addParamAttr(index, llvm::Attribute::NoCapture);
+#endif
+            function->addParamAttr(index, llvm::Attribute::getWithAlignment(*context, alignment));
+            index++;
+        }
+        index++;
+    }
+}
+
+void CodeGenerator::nameArguments(llvm::Function* function, const std::vector<Symbol>& parameters,
+                                  const std::vector<ValueType>& parameterTypes) {
+    auto arg = function->arg_begin();
+    for (size_t i = 0; i < parameters.size(); i++, arg++) {
+        arg->setName(symbolName(parameters[i]));
+        if (isArray(parameterTypes[i])) {
+            (++arg)->setName(symbolName(parameters[i]) + ".len");
+        }
+    }
+}
+
+llvm::Value* CodeGenerator::toInt32(llvm::Value* value) {
+    if (value->getType()->isIntegerTy(1)) {
+        return builder->CreateZExt(value, llvm::Type::getInt32Ty(*context), "booltmp");
+    }
+    return value;
+}
+
+llvm::Value* CodeGenerator::convert(llvm::Value* value, llvm::Type* type) {
+    llvm::Type* from = value->getType();
+    if (from == type) {
+        return value;
+    }
+    if (from->isPointerTy() || type->isPointerTy()) {
+        throw CodeGenError(ARRAY_VALUE_ERROR);
+    }
+    if (from->isIntegerTy(1)) {
+        return type->isDoubleTy() ? builder->CreateUIToFP(value, type, "booltmp")
+                                  : builder->CreateZExt(value, type, "booltmp");
+    }
+    if (from->isDoubleTy()) {
+        return builder->CreateFPToSI(value, type, "fptosi");
+    }
+    if (type->isDoubleTy()) {
+        return builder->CreateSIToFP(value, type, "sitofp");
+    }
+    return builder->CreateSExtOrTrunc(value, type, "convtmp");
+}
+
+llvm::Type* CodeGenerator::castType(Symbol callee, size_t arguments) {
+    static const Symbol i32 = SymbolTable::global().intern("i32");
+    static const Symbol i64 = SymbolTable::global().intern("i64");
+    static const Symbol f64 = SymbolTable::global().intern("f64");
+    if (arguments != 1 || functions.count(callee)) {
+        return nullptr;
+    }
+    if (callee == i32) return llvmType(ValueType::I32);
+    if (callee == i64) return llvmType(ValueType::I64);
+    if (callee == f64) return llvmType(ValueType::F64);
+    return nullptr;
+}
+
+llvm::Type* CodeGenerator::variableType(Symbol name) {
+    auto it = variableTypes.find(name);
+    return it == variableTypes.end() ? llvm::Type::getInt32Ty(*context) : it->second;
+}
+
+void CodeGenerator::writeVariable(Symbol name, llvm::BasicBlock* block, llvm::Value* value) {
+    llvm::Value*& definition = currentDef[name][block];
+    if (definition == value) {
+        return;
+    }
+    definition = value;
+    if (auto* phi = llvm::dyn_cast<llvm::PHINode>(value)) {
+        phiDefinitions[phi].emplace_back(name, block);
+    }
+}
+
+llvm::Value* CodeGenerator::readVariable(Symbol name, llvm::BasicBlock* block) {
+    auto& definitions = currentDef[name];
+    auto it = definitions.find(block);
+    if (it != definitions.end()) {
+        return it->second;
+    }
+    return readVariableRecursive(name, block);
+}
+
+llvm::Value* CodeGenerator::readVariableRecursive(Symbol name, llvm::BasicBlock* block) {
+    llvm::Value* value;
+    if (!sealedBlocks.count(block)) {
+        // Predecessors still unknown: place an operand-less phi and fill it in when sealed
+        llvm::IRBuilder<> phiBuilder(block, block->begin());
+        llvm::PHINode* phi = phiBuilder.CreatePHI(variableType(name), 2, symbolName(name));
+        incompletePhis[block].emplace_back(name, phi);
+        value = phi;
+    } else if (llvm::BasicBlock* predecessor = block->getSinglePredecessor()) {
+        // No phi needed
+        value = readVariable(name, predecessor);
+    } else if (llvm::pred_empty(block)) {
+        // Unreachable, or read before any definition
+        value = llvm::UndefValue::get(variableType(name));
+    } else {
+        // Record the phi first to break cycles through loops
+        llvm::IRBuilder<> phiBuilder(block, block->begin());
+        llvm::PHINode* phi = phiBuilder.CreatePHI(variableType(name), 2, symbolName(name));
+        writeVariable(name, block, phi);
+        value = addPhiOperands(name, phi);
+    }
+    writeVariable(name, block, value);
+    return value;
+}
+
+llvm::Value* CodeGenerator::addPhiOperands(Symbol name, llvm::PHINode* phi) {
+    llvm::BasicBlock* block = phi->getParent();
+    for (llvm::BasicBlock* predecessor : llvm::predecessors(block)) {
+        phi->addIncoming(readVariable(name, predecessor), predecessor);
+    }
+    return tryRemoveTrivialPhi(phi);
+}
+
+llvm::Value* CodeGenerator::tryRemoveTrivialPhi(llvm::PHINode* phi) {
+    llvm::Value* same = nullptr;
+    for (llvm::Value* operand : phi->incoming_values()) {
+        if (operand == same || operand == phi) {
+            continue;
+        }
+        if (same) {
+            return phi; // Merges at least two values
+        }
+        same = operand;
+    }
+    if (!same) {
+        same = llvm::UndefValue::get(phi->getType());
+    }
+    
+    // Remember the phis that used this one; they may become trivial in turn
+    std::vector<llvm::WeakVH> phiUsers;
+    for (llvm::User* user : phi->users()) {
+        if (user != phi && llvm::isa<llvm::PHINode>(user)) {
+            phiUsers.emplace_back(user);
+        }
+    }
+    
+    phi->replaceAllUsesWith(same);
+    auto recorded = phiDefinitions.find(phi);
+    if (recorded != phiDefinitions.end()) {
+        std::vector<std::pair<Symbol, llvm::BasicBlock*>> definitions = std::move(recorded->second);
+        phiDefinitions.erase(recorded);
+        for (auto& definition : definitions) {
+            // Later writes in the same block may have replaced it already
+            if (currentDef[definition.first][definition.second] == phi) {
+                writeVariable(definition.first, definition.second, same);
+            }
+        }
+    }
+    phi->eraseFromParent();
+    
+    // `same` itself may be one of the users removed below
+    llvm::WeakTrackingVH result(same);
+    for (llvm::WeakVH& handle : phiUsers) {
+        auto* user = llvm::dyn_cast_or_null<llvm::PHINode>(static_cast<llvm::Value*>(handle));
+        // Skip phis whose operands are still being added
+        if (user && user->getNumIncomingValues() == llvm::pred_size(user->getParent())) {
+            tryRemoveTrivialPhi(user);
+        }
+    }
+    return result;
+}
+
+void CodeGenerator::sealBlock(llvm::BasicBlock* block) {
+    if (!options.ssa) {
+        return;
+    }
+    auto it = incompletePhis.find(block);
+    if (it != incompletePhis.end()) {
+        std::vector<std::pair<Symbol, llvm::PHINode*>> pending = std::move(it->second);
+        incompletePhis.erase(it);
+        for (auto& entry : pending) {
+            addPhiOperands(entry.first, entry.second);
+        }
+    }
+    sealedBlocks.insert(block);
+}
+
+void CodeGenerator::generate(Program& program) {
+    // Prototype pass: every top-level function can be called before its definition
+    CallGraph calls;
+    for (Statement* statement : program.statements) {
+        if (auto* function = dynamic_cast<FunctionDeclaration*>(statement)) {
+            declareFunction(function->name, std::vector<ValueType>(function->parameterTypes.begin(),
+                                                                   function->parameterTypes.end()),
+                            function->returnType);
+            addCalls(*function, calls);
+        }
+    }
+    findPrintingFunctions(calls, printing);
+    program.accept(*this);
+}
+
+void CodeGenerator::generate(const FlatAST& ast) {
+    if (ast.root == NO_NODE) {
+        return;
+    }
+    CallGraph calls;
+    // Post-order: a statement's nodes directly follow the previous statement's
+    NodeIndex first = 0;
+    for (NodeIndex i = 0; i < ast.b[ast.root]; i++) {
+        NodeIndex statement = ast.listItem(ast.root, i);
+        if (ast.kinds[statement] == NodeKind::Function) {
+            Symbol name = static_cast<Symbol>(ast.values[statement]);
+            std::vector<ValueType> parameterTypes;
+            for (NodeIndex p = 0; p < ast.b[statement]; p++) {
+                parameterTypes.push_back(ast.parameterType(statement, p));
+            }
+            declareFunction(name, parameterTypes, ast.returnType(statement));
+            std::vector<Symbol>& callees = calls[name];
+            for (NodeIndex node = first; node < statement; node++) {
+                if (ast.kinds[node] == NodeKind::Call) {
+                    callees.push_back(static_cast<Symbol>(ast.values[node]));
+                }
+            }
+        }
+        first = statement + 1;
+    }
+    findPrintingFunctions(calls, printing);
+    flatStatement(ast, ast.root);
+}
+
+void CodeGenerator::declareFunction(Symbol name, const std::vector<ValueType>& parameterTypes,
+                                    ValueType returnType) {
+    if (functions[name]) {
+        return;
+    }
+    llvm::Function* function = llvm::Function::Create(functionType(parameterTypes, returnType),
+                                                      llvm::Function::ExternalLinkage, symbolName(name), module.get());
+    addArrayAttributes(function, parameterTypes);
+    functions[name] = function;
+    signatures[name] = parameterTypes;
+}
+
+void CodeGenerator::declareFunction(Symbol name, size_t arity) {
+    declareFunction(name, std::vector<ValueType>(arity, ValueType::I32), ValueType::I32);
+}
+
+void CodeGenerator::declarePrinting(const std::unordered_set<Symbol>& names) {
+    printing.insert(names.begin(), names.end());
+}
+
+std::string CodeGenerator::bitcode() {
+    std::string buffer;
+    llvm::raw_string_ostream stream(buffer);
+    llvm::WriteBitcodeToFile(*module, stream);
+    stream.flush();
+    return buffer;
+}
+
+void CodeGenerator::linkBitcode(const std::string& bitcode, const std::string& name) {
+    llvm::MemoryBufferRef buffer(bitcode, name);
+    llvm::Expected<std::unique_ptr<llvm::Module>> parsed = llvm::parseBitcodeFile(buffer, *context);
+    if (!parsed) {
+        throw CodeGenError("Invalid bitcode for " + name + ": " + llvm::toString(parsed.takeError()));
+    }
+    if (llvm::Linker::linkModules(*module, std::move(*parsed))) {
+        throw CodeGenError("Failed to link " + name);
+    }
+    
+    // Linking may replace declarations; refresh the function table
+    for (auto& entry : functions) {
+        entry.second = module->getFunction(symbolName(entry.first));
+    }
+}
+
+void CodeGenerator::dumpIR() {
+    module->print(llvm::outs(), nullptr);
+}
+
+void CodeGenerator::writeIRToFile(const std::string& filename) {
+    std::error_code EC;
+    llvm::raw_fd_ostream dest(filename, EC, llvm::sys::fs::OF_None);
+    
+    if (EC) {
+        throw CodeGenError("Could not open file: " + EC.message());
+    }
+    
+    module->print(dest, nullptr);
+}
+
+void CodeGenerator::prepareNativeNames() {
+    if (nativeNames) {
+        return;
+    }
+    nativeNames = true;
+    for (llvm::Function& function : *module) {
+        if (function.isDeclaration() || function.hasLocalLinkage()) {
+            continue;
+        }
+        function.setName(function.getName() == "main" ? std::string(NATIVE_ENTRY)
+                                                       : NATIVE_PREFIX + function.getName().str());
+    }
+}
+
+void CodeGenerator::emitNative(llvm::raw_pwrite_stream& dest, bool assembly) {
+    if (llvm::verifyModule(*module, &llvm::errs())) {
+        throw CodeGenError("Module verification failed");
+    }
+    
+#if LLVM_VERSION_MAJOR >= 18
+    llvm::CodeGenFileType fileType = assembly ? llvm::CodeGenFileType::AssemblyFile
+                                              : llvm::CodeGenFileType::ObjectFile;
+#else
+    llvm::CodeGenFileType fileType = assembly ? llvm::CGFT_AssemblyFile : llvm::CGFT_ObjectFile;
+#endif
+    targetMachine->setOptLevel(codeGenOptLevel(optLevel));
+    
+    // Instruction selection still runs on the legacy pass manager
+    llvm::legacy::PassManager passes;
+    if (targetMachine->addPassesToEmitFile(passes, dest, nullptr, fileType)) {
+        throw CodeGenError("Target cannot emit this file type");
+    }
+    passes.run(*module);
+}
+
+void CodeGenerator::emitNativeFile(const std::string& filename, bool assembly) {
+    prepareNativeNames();
+    std::error_code EC;
+    llvm::raw_fd_ostream dest(filename, EC, llvm::sys::fs::OF_None);
+    if (EC) {
+        throw CodeGenError("Could not open file: " + EC.message());
+    }
+    emitNative(dest, assembly);
+}
+
+void CodeGenerator::writeObjectFile(const std::string& filename) {
+    emitNativeFile(filename, false);
+}
+
+void CodeGenerator::writeAssemblyFile(const std::string& filename) {
+    emitNativeFile(filename, true);
+}
+
+std::string CodeGenerator::objectCode() {
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream stream(buffer);
+    emitNative(stream, false);
+    return std::string(buffer.begin(), buffer.end());
+}
+
+std::string CodeGenerator::hostTarget() {
+    initializeNativeTarget();
+    return llvm::sys::getProcessTriple() + "/" + llvm::sys::getHostCPUName().str() + "/" + hostFeatures();
+}
+
+int CodeGenerator::executeObject(const std::string& object, int optLevel) {
+    initializeNativeTarget();
+    std::unique_ptr<llvm::orc::LLJIT> jit = createJIT<llvm::orc::LLJIT, llvm::orc::LLJITBuilder>(optLevel);
+    if (llvm::Error error = jit->addObjectFile(llvm::MemoryBuffer::getMemBufferCopy(object, "cached-object"))) {
+        throw CodeGenError("Failed to load object: " + llvm::toString(std::move(error)));
+    }
+    return runMain(*jit, "main");
+}
+
+void CodeGenerator::writeCHeader(const std::string& filename, const std::string& sourceName) {
+    prepareNativeNames();
+    std::ofstream out(filename, std::ios::trunc);
+    if (!out) {
+        throw CodeGenError("Could not open file: " + filename);
+    }
+    
+    out << "// Generated by simplelang from " << sourceName << " - do not edit\n"
+        << "#pragma once\n"
+        << "#include <stdint.h>\n\n"
+        << "#ifdef __cplusplus\n"
+        << "extern \"C\" {\n"
+        << "#endif\n\n";
+    for (llvm::Function& function : *module) {
+        if (function.isDeclaration() || function.hasLocalLinkage()) {
+            continue;
+        }
+        out << cTypeName(function.getReturnType()) << " " << function.getName().str() << "(";
+        if (function.arg_empty()) {
+            out << "void";
+        }
+        // An array parameter's pointer is followed by its length
+        llvm::StringRef name = function.getName();
+        name.consume_front(NATIVE_PREFIX);
+        auto signature = signatures.find(SymbolTable::global().intern(name));
+        size_t parameter = 0;
+        for (llvm::Argument& arg : function.args()) {
+            std::string type;
+            if (arg.getType()->isPointerTy() && signature != signatures.end()) {
+                type = cTypeName(llvmType(elementType(signature->second.at(parameter)))) + std::string("*");
+            } else {
+                type = cTypeName(arg.getType());
+                parameter++;
+            }
+            std::string argName = arg.getName().str();
+            std::replace(argName.begin(), argName.end(), '.', '_');
+            out << (arg.getArgNo() ? ", " : "") << type << " " << argName;
+        }
+        out << ");\n";
+    }
+    out << "\n#ifdef __cplusplus\n"
+        << "}\n"
+        << "#endif\n";
+}
+
+int CodeGenerator::executeJIT() {
+    // Verify the module
+    if (llvm::verifyModule(*module, &llvm::errs())) {
+        throw CodeGenError("Module verification failed");
+    }
+    
+    llvm::Function* mainFunction = module->getFunction("main");
+    if (!mainFunction) {
+        mainFunction = module->getFunction(NATIVE_ENTRY);
+    }
+    if (!mainFunction || mainFunction->empty()) {
+        throw CodeGenError("Main function not found");
+    }
+    if (mainFunction->arg_size() != 0) {
+        throw CodeGenError("Main function must not take parameters");
+    }
+    std::string mainName = mainFunction->getName().str();
+    
+    std::unique_ptr<llvm::orc::LLLazyJIT> jit = createJIT<llvm::orc::LLLazyJIT, llvm::orc::LLLazyJITBuilder>(optLevel);
+    
+    // Compile each function separately, when its stub is first called
+    jit->setPartitionFunction(llvm::orc::CompileOnDemandLayer::compileRequested);
+    
+    // The JIT takes ownership of the module and its context
+    builder.reset();
+    functions.clear();
+    llvm::orc::ThreadSafeModule threadSafeModule(std::move(module), std::move(context));
+    if (llvm::Error error = jit->addLazyIRModule(std::move(threadSafeModule))) {
+        throw CodeGenError("Failed to add module to JIT: " + llvm::toString(std::move(error)));
+    }
+    return runMain(*jit, mainName);
+}
+
+void CodeGenerator::optimize(int level, bool timePasses, OptimizationStage stage) {
+    optLevel = level;
+    if (level == 0 && !timePasses) {
+        return;
+    }
+    
+    llvm::LoopAnalysisManager loopAM;
+    llvm::FunctionAnalysisManager functionAM;
+    llvm::CGSCCAnalysisManager cgsccAM;
+    llvm::ModuleAnalysisManager moduleAM;
+    
+    // The timing handler reads TimePassesIsEnabled when it is constructed
+    // and prints its report when `instrumentations` is destroyed
+    // Pre-link runs on worker threads and leaves the global alone
+    if (stage != OptimizationStage::PreLink) {
+        llvm::TimePassesIsEnabled = timePasses;
+    }
+    llvm::PassInstrumentationCallbacks callbacks;
+#if LLVM_VERSION_MAJOR >= 16
+    llvm::StandardInstrumentations instrumentations(*context, false);
+#else
+    llvm::StandardInstrumentations instrumentations(false);
+#endif
+    instrumentations.registerCallbacks(callbacks, &functionAM);
+    
+    llvm::PassBuilder passBuilder(targetMachine.get(), llvm::PipelineTuningOptions(), {}, &callbacks);
+    passBuilder.registerModuleAnalyses(moduleAM);
+    passBuilder.registerCGSCCAnalyses(cgsccAM);
+    passBuilder.registerFunctionAnalyses(functionAM);
+    passBuilder.registerLoopAnalyses(loopAM);
+    passBuilder.crossRegisterProxies(loopAM, functionAM, cgsccAM, moduleAM);
+    
+    llvm::ModulePassManager passes;
+    if (level == 0) {
+        passes = passBuilder.buildO0DefaultPipeline(llvm::OptimizationLevel::O0,
+                                                    stage == OptimizationStage::PreLink);
+    } else if (stage == OptimizationStage::PreLink) {
+        passes = passBuilder.buildLTOPreLinkDefaultPipeline(optimizationLevel(level));
+    } else if (stage == OptimizationStage::PostLink) {
+        // Everything is in one module now, so no summary index is needed
+        // for cross-module inlining
+        passes = passBuilder.buildLTODefaultPipeline(optimizationLevel(level), nullptr);
+    } else {
+        passes = passBuilder.buildPerModuleDefaultPipeline(optimizationLevel(level));
+    }
+    passes.run(*module, moduleAM);
+}
+
+llvm::Value* CodeGenerator::emitBinary(BinaryOp op, llvm::Value* left, llvm::Value* right) {
+    if (!left || !right) {
+        throw CodeGenError("Invalid operands for binary operation");
+    }
+    if (left->getType()->isPointerTy() || right->getType()->isPointerTy()) {
+        throw CodeGenError(ARRAY_VALUE_ERROR);
+    }
+    
+    // && and || need control flow and go through emitLogical
+    if (op == BinaryOp::And || op == BinaryOp::Or) {
+        throw CodeGenError(std::string("Logical operator without short-circuit lowering: ") + spelling(op));
+    }
+    
+    // Operands meet at the wider type: f64 over i64 over i32
+    llvm::Type* type = toInt32(left)->getType();
+    llvm::Type* rightType = toInt32(right)->getType();
+    if (rightType->isDoubleTy() || (!type->isDoubleTy() && rightType->getIntegerBitWidth() > type->getIntegerBitWidth())) {
+        type = rightType;
+    }
+    left = convert(left, type);
+    right = convert(right, type);
+    
+    if (type->isDoubleTy()) {
+        switch (op) {
+            case BinaryOp::Add: return builder->CreateFAdd(left, right, "addtmp");
+            case BinaryOp::Sub: return builder->CreateFSub(left, right, "subtmp");
+            case BinaryOp::Mul: return builder->CreateFMul(left, right, "multmp");
+            case BinaryOp::Div: return builder->CreateFDiv(left, right, "divtmp");
+            case BinaryOp::Less: return builder->CreateFCmpOLT(left, right, "cmptmp");
+            case BinaryOp::LessEqual: return builder->CreateFCmpOLE(left, right, "cmptmp");
+            case BinaryOp::Greater: return builder->CreateFCmpOGT(left, right, "cmptmp");
+            case BinaryOp::GreaterEqual: return builder->CreateFCmpOGE(left, right, "cmptmp");
+            case BinaryOp::Equal: return builder->CreateFCmpOEQ(left, right, "cmptmp");
+            case BinaryOp::NotEqual: return builder->CreateFCmpUNE(left, right, "cmptmp");
+            case BinaryOp::And:
+            case BinaryOp::Or:
+                break;
+        }
+        throw CodeGenError(std::string("Unknown binary operator: ") + spelling(op));
+    }
+    
+    switch (op) {
+        case BinaryOp::Add: return builder->CreateAdd(left, right, "addtmp");
+        case BinaryOp::Sub: return builder->CreateSub(left, right, "subtmp");
+        case BinaryOp::Mul: return builder->CreateMul(left, right, "multmp");
+        case BinaryOp::Div: return builder->CreateSDiv(left, right, "divtmp");
+        case BinaryOp::Less: return builder->CreateICmpSLT(left, right, "cmptmp");
+        case BinaryOp::LessEqual: return builder->CreateICmpSLE(left, right, "cmptmp");
+        case BinaryOp::Greater: return builder->CreateICmpSGT(left, right, "cmptmp");
+        case BinaryOp::GreaterEqual: return builder->CreateICmpSGE(left, right, "cmptmp");
+        case BinaryOp::Equal: return builder->CreateICmpEQ(left, right, "cmptmp");
+        case BinaryOp::NotEqual: return builder->CreateICmpNE(left, right, "cmptmp");
+        case BinaryOp::And:
+        case BinaryOp::Or:
+            break;
+    }
+    throw CodeGenError(std::string("Unknown binary operator: ") + spelling(op));
+}
+
+llvm::Value* CodeGenerator::emitUnary(UnaryOp op, llvm::Value* operand) {
+    if (!operand) {
+        throw CodeGenError("Invalid operand for unary operation");
+    }
+    if (operand->getType()->isPointerTy()) {
+        throw CodeGenError(ARRAY_VALUE_ERROR);
+    }
+    
+    switch (op) {
+        case UnaryOp::Negate:
+            if (operand->getType()->isDoubleTy()) {
+                return builder->CreateFNeg(operand, "negtmp");
+            }
+            return builder->CreateNeg(toInt32(operand), "negtmp");
+        case UnaryOp::Not: return builder->CreateNot(emitCondition(operand, "notcond"), "nottmp");
+    }
+    throw CodeGenError(std::string("Unknown unary operator: ") + spelling(op));
+}
+
+llvm::Value* CodeGenerator::emitLoad(Symbol name) {
+    auto array = arrays.find(name);
+    if (array != arrays.end()) {
+        return array->second.data;
+    }
+    if (options.ssa) {
+        if (!currentDef.count(name)) {
+            throw CodeGenError("Unknown variable name: " + symbolName(name));
+        }
+        return readVariable(name, builder->GetInsertBlock());
+    }
+    
+    llvm::AllocaInst* alloca = namedValues[name];
+    if (!alloca) {
+        throw CodeGenError("Unknown variable name: " + symbolName(name));
+    }
+    
+    // Load the value
+    return builder->CreateLoad(alloca->getAllocatedType(), alloca, symbolName(name));
+}
+
+const CodeGenerator::ArrayBinding& CodeGenerator::arrayBinding(Symbol name) {
+    auto it = arrays.find(name);
+    if (it == arrays.end()) {
+        throw CodeGenError("Unknown array: " + symbolName(name));
+    }
+    return it->second;
+}
+
+const Symbol* CodeGenerator::arrayNamed(llvm::Value* value) {
+    for (const auto& entry : arrays) {
+        if (entry.second.data == value) {
+            return &entry.first;
+        }
+    }
+    return nullptr;
+}
+
+llvm::Value* CodeGenerator::emitElementPointer(Symbol array, llvm::Value* index) {
+    const ArrayBinding& binding = arrayBinding(array);
+    if (!index) {
+        throw CodeGenError("Invalid array index");
+    }
+    index = toInt32(index);
+    if (!index->getType()->isIntegerTy()) {
+        throw CodeGenError("Index into " + symbolName(array) + " must be an integer");
+    }
+    // Indices are not bounds checked
+    index = convert(index, llvm::Type::getInt64Ty(*context));
+    return builder->CreateInBoundsGEP(binding.element, binding.data, index, symbolName(array) + ".elem");
+}
+
+llvm::Value* CodeGenerator::emitArrayLoad(Symbol array, llvm::Value* index) {
+    llvm::Value* element = emitElementPointer(array, index);
+    return builder->CreateLoad(arrayBinding(array).element, element, symbolName(array) + ".val");
+}
+
+void CodeGenerator::emitArrayStore(Symbol array, llvm::Value* index, llvm::Value* value) {
+    llvm::Value* element = emitElementPointer(array, index);
+    if (!value) {
+        throw CodeGenError("Invalid assignment value");
+    }
+    builder->CreateStore(convert(value, arrayBinding(array).element), element);
+}
+
+void CodeGenerator::emitArrayDeclaration(Symbol name, ValueType type, uint32_t length) {
+    if (std::find(loopVariables.begin(), loopVariables.end(), name) != loopVariables.end()) {
+        throw CodeGenError("Cannot redeclare loop variable " + symbolName(name));
+    }
+    if (std::find(sharedVariables.begin(), sharedVariables.end(), name) != sharedVariables.end()) {
+        throw CodeGenError("Cannot redeclare " + symbolName(name) + " inside a parallel for loop");
+    }
+    llvm::Type* element = llvmType(elementType(type));
+    llvm::ArrayType* storage = llvm::ArrayType::get(element, length);
+    uint64_t bytes = module->getDataLayout().getTypeAllocSize(storage);
+    if (bytes > MAX_ARRAY_BYTES - arrayBytes) {
+        throw CodeGenError("Array " + symbolName(name) + " needs " + std::to_string(bytes) +
+                           " bytes of stack; a function's arrays may take at most " +
+                           std::to_string(MAX_ARRAY_BYTES) + " bytes");
+    }
+    arrayBytes += bytes;
+    
+    // The storage and the pointer to its first element live in the entry
+    // block, so the array can be used anywhere in the function
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::AllocaInst* alloca = createEntryBlockAlloca(function, symbolName(name) + ".storage", storage);
+    alloca->setAlignment(llvm::Align(ARRAY_ALIGNMENT));
+    llvm::IRBuilder<> entryBuilder(alloca->getParent(), std::next(alloca->getIterator()));
+    llvm::Value* data = entryBuilder.CreateInBoundsGEP(storage, alloca, {entryBuilder.getInt64(0), entryBuilder.getInt64(0)},
+                                                       symbolName(name));
+    
+    // Zeroed at the declaration, like a scalar without an initializer
+    builder->CreateMemSet(alloca, builder->getInt8(0), bytes, llvm::MaybeAlign(ARRAY_ALIGNMENT));
+    
+    namedValues.erase(name);
+    arrays[name] = ArrayBinding{data, builder->getInt64(length), element};
+}
+
+llvm::Value* CodeGenerator::emitCall(Symbol name, const std::vector<llvm::Value*>& args) {
+    if (branchHint(name, args.size()) != BranchHint::None) {
+        if (!args[0]) {
+            throw CodeGenError("Invalid argument in function call");
+        }
+        return args[0];
+    }
+    if (llvm::Type* type = castType(name, args.size())) {
+        if (!args[0]) {
+            throw CodeGenError("Invalid argument in function call");
+        }
+        return convert(args[0], type);
+    }
+    static const Symbol print = SymbolTable::global().intern("print");
+    static const Symbol println = SymbolTable::global().intern("println");
+    if ((name == print || name == println) && !functions.count(name)) {
+        return emitPrint(name == println, args);
+    }
+    static const Symbol len = SymbolTable::global().intern("len");
+    if (name == len && args.size() == 1 && !functions.count(name)) {
+        const Symbol* array = args[0] ? arrayNamed(args[0]) : nullptr;
+        if (!array) {
+            throw CodeGenError("len() takes an array");
+        }
+        return arrays[*array].length;
+    }
+    
+    llvm::Function* calleeFunction = functions[name];
+    if (!calleeFunction) {
+        throw CodeGenError("Unknown function referenced: " + symbolName(name));
+    }
+    
+    // Check argument count
+    auto signature = signatures.find(name);
+    size_t arity = signature != signatures.end() ? signature->second.size() : calleeFunction->arg_size();
+    if (arity != args.size()) {
+        throw CodeGenError("Incorrect number of arguments passed to function: " + symbolName(name));
+    }
+    
+    std::vector<llvm::Value*> values;
+    std::vector<Symbol> passed;
+    values.reserve(args.size());
+    for (size_t i = 0; i < args.size(); i++) {
+        if (!args[i]) {
+            throw CodeGenError("Invalid argument in function call");
+        }
+        llvm::Type* type = calleeFunction->getArg(values.size())->getType();
+        if (!type->isPointerTy()) {
+            values.push_back(convert(args[i], type));
+            continue;
+        }
+        
+        // Arrays travel as pointer and length
+        const Symbol* array = arrayNamed(args[i]);
+        if (!array) {
+            throw CodeGenError("Argument " + std::to_string(i + 1) + " of " + symbolName(name) + " must be an array");
+        }
+        const ArrayBinding& binding = arrays[*array];
+        if (signature != signatures.end() && binding.element != llvmType(elementType(signature->second[i]))) {
+            throw CodeGenError("Array " + symbolName(*array) + " has the wrong element type for " + symbolName(name));
+        }
+        // The parameters are noalias, so no call may see one array twice
+        if (std::find(passed.begin(), passed.end(), *array) != passed.end()) {
+            throw CodeGenError("Array " + symbolName(*array) + " is passed to " + symbolName(name) + " more than once");
+        }
+        passed.push_back(*array);
+        values.push_back(binding.data);
+        values.push_back(binding.length);
+    }
+    
+    return builder->CreateCall(calleeFunction, values, "calltmp");
+}
+
+llvm::Value* CodeGenerator::emitPrint(bool newline, const std::vector<llvm::Value*>& args) {
+    if (args.size() > 1 || (args.empty() && !newline)) {
+        throw CodeGenError(newline ? "println() takes at most one value" : "print() takes one value");
+    }
+    llvm::Type* voidType = builder->getVoidTy();
+    if (args.empty()) {
+        builder->CreateCall(module->getOrInsertFunction("simplelang_print_newline",
+                                                        llvm::FunctionType::get(voidType, false)));
+        return builder->getInt32(0);
+    }
+    
+    llvm::Value* value = args[0];
+    if (!value) {
+        throw CodeGenError("Invalid argument in function call");
+    }
+    if (value->getType()->isPointerTy()) {
+        throw CodeGenError(ARRAY_VALUE_ERROR);
+    }
+    // Integers of every width print as i64, booleans as 0 or 1
+    bool real = value->getType()->isDoubleTy();
+    if (!real) {
+        value = builder->CreateSExt(toInt32(value), builder->getInt64Ty());
+    }
+    llvm::FunctionCallee runtime = module->getOrInsertFunction(
+        real ? "simplelang_print_f64" : "simplelang_print_i64",
+        llvm::FunctionType::get(voidType, {value->getType(), builder->getInt32Ty()}, false));
+    builder->CreateCall(runtime, {value, builder->getInt32(newline ? 1 : 0)});
+    return builder->getInt32(0);
+}
+
+llvm::Value* CodeGenerator::emitCondition(llvm::Value* value, const char* name) {
+    // Convert condition to boolean if necessary
+    if (value->getType()->isPointerTy()) {
+        throw CodeGenError(ARRAY_VALUE_ERROR);
+    }
+    if (value->getType()->isDoubleTy()) {
+        // NaN counts as nonzero, as in C
+        return builder->CreateFCmpUNE(value, llvm::ConstantFP::get(value->getType(), 0.0), name);
+    }
+    if (value->getType() != llvm::Type::getInt1Ty(*context)) {
+        value = builder->CreateICmpNE(value, llvm::Constant::getNullValue(value->getType()), name);
+    }
+    return value;
+}
+
+llvm::Value* CodeGenerator::emitLogical(BinaryOp op, llvm::Value* left,
+                                       const std::function<llvm::Value*()>& right) {
+    if (!left) {
+        throw CodeGenError("Invalid operands for binary operation");
+    }
+    llvm::Value* leftValue = emitCondition(left, "lhsbool");
+    
+    // `a && b` is false without evaluating b when a is false, `a || b` true when a is true
+    bool isAnd = op == BinaryOp::And;
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock* leftBlock = builder->GetInsertBlock();
+    llvm::BasicBlock* rightBlock = llvm::BasicBlock::Create(*context, isAnd ? "and.rhs" : "or.rhs", function);
+    llvm::BasicBlock* mergeBlock = llvm::BasicBlock::Create(*context, isAnd ? "and.end" : "or.end", function);
+    if (isAnd) {
+        builder->CreateCondBr(leftValue, rightBlock, mergeBlock);
+    } else {
+        builder->CreateCondBr(leftValue, mergeBlock, rightBlock);
+    }
+    sealBlock(rightBlock);
+    
+    builder->SetInsertPoint(rightBlock);
+    llvm::Value* rightValue = right();
+    if (!rightValue) {
+        throw CodeGenError("Invalid operands for binary operation");
+    }
+    rightValue = emitCondition(rightValue, "rhsbool");
+    // The right operand may have branched itself
+    llvm::BasicBlock* rightEnd = builder->GetInsertBlock();
+    builder->CreateBr(mergeBlock);
+    sealBlock(mergeBlock);
+    
+    builder->SetInsertPoint(mergeBlock);
+    llvm::PHINode* phi = builder->CreatePHI(llvm::Type::getInt1Ty(*context), 2, isAnd ? "andtmp" : "ortmp");
+    phi->addIncoming(llvm::ConstantInt::get(*context, llvm::APInt(1, isAnd ? 0 : 1, false)), leftBlock);
+    phi->addIncoming(rightValue, rightEnd);
+    return phi;
+}
+
+BranchHint CodeGenerator::branchHint(Symbol callee, size_t arguments) {
+    static const Symbol likely = SymbolTable::global().intern("likely");
+    static const Symbol unlikely = SymbolTable::global().intern("unlikely");
+    if (arguments != 1 || (callee != likely && callee != unlikely) || functions.count(callee)) {
+        return BranchHint::None;
+    }
+    return callee == likely ? BranchHint::Likely : BranchHint::Unlikely;
+}
+
+Expression* CodeGenerator::stripBranchHint(Expression* condition, BranchHint& hint) {
+    auto* call = dynamic_cast<FunctionCall*>(condition);
+    hint = call ? branchHint(call->name, call->arguments.size()) : BranchHint::None;
+    return hint == BranchHint::None ? condition : call->arguments[0];
+}
+
+NodeIndex CodeGenerator::flatStripBranchHint(const FlatAST& ast, NodeIndex condition, BranchHint& hint) {
+    hint = ast.kinds[condition] == NodeKind::Call
+        ? branchHint(static_cast<Symbol>(ast.values[condition]), ast.b[condition])
+        : BranchHint::None;
+    return hint == BranchHint::None ? condition : ast.listItem(condition, 0);
+}
+
+void CodeGenerator::emitCondBr(llvm::Value* condition, llvm::BasicBlock* trueBlock, llvm::BasicBlock* falseBlock,
+                               BranchHint hint) {
+    llvm::BranchInst* branch = builder->CreateCondBr(condition, trueBlock, falseBlock);
+    if (hint != BranchHint::None) {
+        // The same 2000:1 ratio clang uses for __builtin_expect
+        uint32_t hot = 2000;
+        uint32_t cold = 1;
+        bool taken = hint == BranchHint::Likely;
+        branch->setMetadata(llvm::LLVMContext::MD_prof,
+                            llvm::MDBuilder(*context).createBranchWeights(taken ? hot : cold, taken ? cold : hot));
+    }
+}
+
+void CodeGenerator::emitVariableDeclaration(Symbol name, llvm::Value* initValue, ValueType declared) {
+    if (std::find(loopVariables.begin(), loopVariables.end(), name) != loopVariables.end()) {
+        throw CodeGenError("Cannot redeclare loop variable " + symbolName(name));
+    }
+    if (std::find(sharedVariables.begin(), sharedVariables.end(), name) != sharedVariables.end()) {
+        throw CodeGenError("Cannot redeclare " + symbolName(name) + " inside a parallel for loop");
+    }
+    if (initValue && initValue->getType()->isPointerTy()) {
+        throw CodeGenError(ARRAY_VALUE_ERROR);
+    }
+    arrays.erase(name);
+    
+    // Without an annotation the variable takes its initializer's type
+    llvm::Type* type = declared != ValueType::Inferred || !initValue ? llvmType(declared)
+                                                                     : toInt32(initValue)->getType();
+    if (!initValue) {
+        // Default initialize to 0
+        initValue = llvm::Constant::getNullValue(type);
+    }
+    initValue = convert(initValue, type);
+    
+    if (options.ssa) {
+        variableTypes[name] = type;
+        writeVariable(name, builder->GetInsertBlock(), initValue);
+        return;
+    }
+    
+    // Create alloca in entry block
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::AllocaInst* alloca = createEntryBlockAlloca(function, symbolName(name), type);
+    builder->CreateStore(initValue, alloca);
+    namedValues[name] = alloca;
+}
+
+void CodeGenerator::emitAssignment(Symbol name, llvm::Value* value) {
+    if (arrays.count(name)) {
+        throw CodeGenError("Cannot assign to array " + symbolName(name));
+    }
+    if (std::find(loopVariables.begin(), loopVariables.end(), name) != loopVariables.end()) {
+        throw CodeGenError("Cannot assign to loop variable " + symbolName(name));
+    }
+    if (std::find(sharedVariables.begin(), sharedVariables.end(), name) != sharedVariables.end()) {
+        throw CodeGenError("Cannot assign to " + symbolName(name) +
+                           " inside a parallel for loop unless it is one of the loop's reductions");
+    }
+    llvm::AllocaInst* variable = options.ssa ? nullptr : namedValues[name];
+    if (options.ssa ? !currentDef.count(name) : !variable) {
+        throw CodeGenError("Unknown variable name: " + symbolName(name));
+    }
+    if (!value) {
+        throw CodeGenError("Invalid assignment value");
+    }
+    
+    if (options.ssa) {
+        writeVariable(name, builder->GetInsertBlock(), convert(value, variableType(name)));
+        return;
+    }
+    builder->CreateStore(convert(value, variable->getAllocatedType()), variable);
+}
+
+void CodeGenerator::emitIf(const std::function<llvm::Value*()>& condition, BranchHint hint,
+                           const std::function<void()>& thenBranch,
+                           const std::function<void()>* elseBranch) {
+    llvm::Value* conditionValue = condition();
+    
+    if (!conditionValue) {
+        throw CodeGenError("Invalid if condition");
+    }
+    
+    conditionValue = emitCondition(conditionValue, "ifcond");
+    
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    
+    // Create blocks
+    llvm::BasicBlock* thenBlock = llvm::BasicBlock::Create(*context, "then", function);
+    llvm::BasicBlock* elseBlock = elseBranch ? 
+        llvm::BasicBlock::Create(*context, "else", function) : nullptr;
+    llvm::BasicBlock* mergeBlock = llvm::BasicBlock::Create(*context, "ifcont", function);
+    
+    // Create conditional branch
+    emitCondBr(conditionValue, thenBlock, elseBranch ? elseBlock : mergeBlock, hint);
+    sealBlock(thenBlock);
+    if (elseBlock) {
+        sealBlock(elseBlock);
+    }
+    
+    // Generate then block
+    builder->SetInsertPoint(thenBlock);
+    thenBranch();
+    
+    // Only add branch if block doesn't already have a terminator
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        builder->CreateBr(mergeBlock);
+    }
+    
+    // Generate else block if present
+    if (elseBranch) {
+        builder->SetInsertPoint(elseBlock);
+        (*elseBranch)();
+        
+        // Only add branch if block doesn't already have a terminator
+        if (!builder->GetInsertBlock()->getTerminator()) {
+            builder->CreateBr(mergeBlock);
+        }
+    }
+    
+    // Continue with merge block
+    sealBlock(mergeBlock);
+    builder->SetInsertPoint(mergeBlock);
+}
+
+void CodeGenerator::emitWhile(const std::function<llvm::Value*()>& condition, BranchHint hint,
+                              const std::function<void()>& body) {
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    
+    llvm::BasicBlock* condBlock = llvm::BasicBlock::Create(*context, "whilecond", function);
+    llvm::BasicBlock* bodyBlock = llvm::BasicBlock::Create(*context, "whilebody", function);
+    llvm::BasicBlock* afterBlock = llvm::BasicBlock::Create(*context, "afterwhile", function);
+    
+    builder->CreateBr(condBlock);
+    
+    // Generate condition block
+    builder->SetInsertPoint(condBlock);
+    llvm::Value* conditionValue = condition();
+    
+    if (!conditionValue) {
+        throw CodeGenError("Invalid while condition");
+    }
+    
+    conditionValue = emitCondition(conditionValue, "whilecond");
+    emitCondBr(conditionValue, bodyBlock, afterBlock, hint);
+    sealBlock(bodyBlock);
+    sealBlock(afterBlock);
+    
+    // Generate body block
+    builder->SetInsertPoint(bodyBlock);
+    body();
+    
+    // Only add branch if block doesn't already have a terminator
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        builder->CreateBr(condBlock);
+    }
+    
+    // The back edge is in place, so the loop header's phis can be completed
+    sealBlock(condBlock);
+    
+    // Continue with after block
+    builder->SetInsertPoint(afterBlock);
+}
+
+void CodeGenerator::emitFor(Symbol variable, const std::function<llvm::Value*()>& start,
+                            const std::function<llvm::Value*()>& end, const std::function<void()>& body) {
+    llvm::Value* startValue = start();
+    llvm::Value* endValue = end();
+    llvm::Type* type = loopBounds(variable, startValue, endValue);
+    // The end is evaluated once, before the first iteration
+    emitVariableDeclaration(variable, startValue, ValueType::Inferred);
+    
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock* condBlock = llvm::BasicBlock::Create(*context, "for.cond", function);
+    llvm::BasicBlock* bodyBlock = llvm::BasicBlock::Create(*context, "for.body", function);
+    llvm::BasicBlock* incBlock = llvm::BasicBlock::Create(*context, "for.inc", function);
+    llvm::BasicBlock* afterBlock = llvm::BasicBlock::Create(*context, "for.end", function);
+    builder->CreateBr(condBlock);
+    
+    builder->SetInsertPoint(condBlock);
+    llvm::Value* counter = emitLoad(variable);
+    builder->CreateCondBr(builder->CreateICmpSLT(counter, endValue, "forcond"), bodyBlock, afterBlock);
+    sealBlock(bodyBlock);
+    sealBlock(afterBlock);
+    
+    builder->SetInsertPoint(bodyBlock);
+    loopVariables.push_back(variable);
+    body();
+    loopVariables.pop_back();
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        builder->CreateBr(incBlock);
+    }
+    sealBlock(incBlock);
+    
+    // counter < end, so the increment cannot overflow
+    builder->SetInsertPoint(incBlock);
+    llvm::Value* next = builder->CreateNSWAdd(emitLoad(variable), llvm::ConstantInt::get(type, 1), "fornext");
+    emitAssignment(variable, next);
+    llvm::BranchInst* latch = builder->CreateBr(condBlock);
+    latch->setMetadata(llvm::LLVMContext::MD_loop, countedLoopMetadata());
+    sealBlock(condBlock);
+    
+    builder->SetInsertPoint(afterBlock);
+}
+
+llvm::MDNode* CodeGenerator::countedLoopMetadata() {
+    // A counted loop always terminates. Under --fast-math the vectorizer may
+    // also reorder floating-point reductions, so vectorization is requested
+    // outright rather than left to the cost model alone.
+    std::vector<llvm::Metadata*> properties{nullptr};
+    properties.push_back(llvm::MDNode::get(*context, llvm::MDString::get(*context, "llvm.loop.mustprogress")));
+    if (options.fastMath) {
+        properties.push_back(llvm::MDNode::get(
+            *context, {llvm::MDString::get(*context, "llvm.loop.vectorize.enable"),
+                       llvm::ConstantAsMetadata::get(builder->getTrue())}));
+    }
+    llvm::MDNode* loop = llvm::MDNode::getDistinct(*context, properties);
+    loop->replaceOperandWith(0, loop);
+    return loop;
+}
+
+llvm::Type* CodeGenerator::loopBounds(Symbol variable, llvm::Value*& start, llvm::Value*& end) {
+    if (!start || !end) {
+        throw CodeGenError("Invalid for loop bounds");
+    }
+    start = toInt32(start);
+    end = toInt32(end);
+    llvm::Type* type = start->getType();
+    if (!type->isIntegerTy() || !end->getType()->isIntegerTy()) {
+        throw CodeGenError("Bounds of the loop over " + symbolName(variable) + " must be integers");
+    }
+    if (end->getType()->getIntegerBitWidth() > type->getIntegerBitWidth()) {
+        type = end->getType();
+    }
+    start = convert(start, type);
+    end = convert(end, type);
+    return type;
+}
+
+void CodeGenerator::emitParallelFor(Symbol variable, const std::function<llvm::Value*()>& start,
+                                    const std::function<llvm::Value*()>& end, const std::vector<Reduction>& reductions,
+                                    const std::function<void()>& body) {
+    llvm::Value* startValue = start();
+    llvm::Value* endValue = end();
+    llvm::Type* type = loopBounds(variable, startValue, endValue);
+    llvm::Type* int64Type = builder->getInt64Ty();
+    llvm::Function* parent = builder->GetInsertBlock()->getParent();
+    
+    std::vector<Symbol> reduced;
+    std::vector<llvm::Type*> reductionTypes;
+    for (const Reduction& reduction : reductions) {
+        if (arrays.count(reduction.variable)) {
+            throw CodeGenError("Cannot reduce into array " + symbolName(reduction.variable));
+        }
+        if (reduction.variable == variable) {
+            throw CodeGenError("Cannot reduce into loop variable " + symbolName(variable));
+        }
+        if (std::find(reduced.begin(), reduced.end(), reduction.variable) != reduced.end()) {
+            throw CodeGenError("Variable " + symbolName(reduction.variable) + " is reduced more than once");
+        }
+        reduced.push_back(reduction.variable);
+        reductionTypes.push_back(emitLoad(reduction.variable)->getType());
+    }
+    
+    // Every other variable in scope is copied into the body's context
+    std::vector<Symbol> shared;
+    if (options.ssa) {
+        for (const auto& entry : variableTypes) {
+            shared.push_back(entry.first);
+        }
+    } else {
+        for (const auto& entry : namedValues) {
+            if (entry.second) shared.push_back(entry.first);
+        }
+    }
+    shared.erase(std::remove_if(shared.begin(), shared.end(), [&](Symbol name) {
+        return name == variable || arrays.count(name) ||
+               std::find(reduced.begin(), reduced.end(), name) != reduced.end();
+    }), shared.end());
+    std::sort(shared.begin(), shared.end());
+    std::vector<Symbol> sharedArrays;
+    for (const auto& entry : arrays) {
+        if (entry.first != variable) sharedArrays.push_back(entry.first);
+    }
+    std::sort(sharedArrays.begin(), sharedArrays.end());
+    
+    // Context layout: shared values, then array data and lengths, then a
+    // pointer to each reduction's per-chunk partial results
+    std::vector<llvm::Value*> fields;
+    for (Symbol name : shared) {
+        fields.push_back(emitLoad(name));
+    }
+    for (Symbol name : sharedArrays) {
+        fields.push_back(arrays[name].data);
+        fields.push_back(arrays[name].length);
+    }
+    std::vector<llvm::Value*> partials;
+    for (size_t i = 0; i < reductions.size(); i++) {
+        llvm::ArrayType* storage = llvm::ArrayType::get(reductionTypes[i], SIMPLELANG_MAX_CHUNKS);
+        llvm::AllocaInst* alloca = createEntryBlockAlloca(parent, symbolName(reduced[i]) + ".partials", storage);
+        partials.push_back(builder->CreateInBoundsGEP(storage, alloca, {builder->getInt64(0), builder->getInt64(0)}));
+        fields.push_back(partials.back());
+    }
+    std::vector<llvm::Type*> fieldTypes;
+    for (llvm::Value* field : fields) {
+        fieldTypes.push_back(field->getType());
+    }
+    llvm::StructType* contextType = llvm::StructType::get(*context, fieldTypes);
+    llvm::AllocaInst* frame = createEntryBlockAlloca(parent, "parallel.context", contextType);
+    for (size_t i = 0; i < fields.size(); i++) {
+        builder->CreateStore(fields[i], builder->CreateStructGEP(contextType, frame, i));
+    }
+    
+    // void body(i8* context, i64 chunk, i64 begin, i64 end)
+    llvm::PointerType* bytePointer = builder->getInt8PtrTy();
+    llvm::FunctionType* bodyType = llvm::FunctionType::get(
+        builder->getVoidTy(), {bytePointer, int64Type, int64Type, int64Type}, false);
+    llvm::Function* outlined = llvm::Function::Create(bodyType, llvm::Function::InternalLinkage,
+                                                      parent->getName() + ".parallel", module.get());
+    outlined->addFnAttr(llvm::Attribute::NoUnwind);
+    llvm::Argument* contextArg = outlined->getArg(0);
+    llvm::Argument* chunkArg = outlined->getArg(1);
+    llvm::Argument* beginArg = outlined->getArg(2);
+    llvm::Argument* endArg = outlined->getArg(3);
+    contextArg->setName("context");
+    chunkArg->setName("chunk");
+    beginArg->setName("begin");
+    endArg->setName("end");
+    
+    llvm::IRBuilderBase::InsertPoint callerPoint = builder->saveIP();
+    auto oldNamedValues = std::move(namedValues);
+    auto oldCurrentDef = std::move(currentDef);
+    auto oldVariableTypes = std::move(variableTypes);
+    auto oldSealedBlocks = std::move(sealedBlocks);
+    auto oldIncompletePhis = std::move(incompletePhis);
+    auto oldPhiDefinitions = std::move(phiDefinitions);
+    auto oldArrays = std::move(arrays);
+    uint64_t oldArrayBytes = arrayBytes;
+    auto oldLoopVariables = std::move(loopVariables);
+    auto oldSharedVariables = std::move(sharedVariables);
+    TailRecursion oldTailRecursion = std::move(tailRecursion);
+    llvm::Function* oldCurrentFunction = currentFunction;
+    auto restore = [&] {
+        namedValues = std::move(oldNamedValues);
+        currentDef = std::move(oldCurrentDef);
+        variableTypes = std::move(oldVariableTypes);
+        sealedBlocks = std::move(oldSealedBlocks);
+        incompletePhis = std::move(oldIncompletePhis);
+        phiDefinitions = std::move(oldPhiDefinitions);
+        arrays = std::move(oldArrays);
+        arrayBytes = oldArrayBytes;
+        loopVariables = std::move(oldLoopVariables);
+        sharedVariables = std::move(oldSharedVariables);
+        tailRecursion = std::move(oldTailRecursion);
+        currentFunction = oldCurrentFunction;
+        builder->restoreIP(callerPoint);
+    };
+    namedValues.clear();
+    currentDef.clear();
+    variableTypes.clear();
+    sealedBlocks.clear();
+    incompletePhis.clear();
+    phiDefinitions.clear();
+    arrays.clear();
+    arrayBytes = 0;
+    loopVariables.clear();
+    tailRecursion = TailRecursion();
+    currentFunction = outlined;
+    
+    llvm::BasicBlock* entryBlock = llvm::BasicBlock::Create(*context, "entry", outlined);
+    builder->SetInsertPoint(entryBlock);
+    sealBlock(entryBlock);
+    llvm::Value* contextFields = builder->CreateBitCast(contextArg, contextType->getPointerTo(), "fields");
+    auto field = [&](size_t i) {
+        return builder->CreateLoad(fieldTypes[i], builder->CreateStructGEP(contextType, contextFields, i));
+    };
+    size_t next = 0;
+    for (Symbol name : shared) {
+        emitVariableDeclaration(name, field(next++), ValueType::Inferred);
+    }
+    for (Symbol name : sharedArrays) {
+        llvm::Value* data = field(next++);
+        arrays[name] = ArrayBinding{data, field(next++), oldArrays[name].element};
+    }
+    sharedVariables = shared;
+    for (size_t i = 0; i < reductions.size(); i++) {
+        emitVariableDeclaration(reduced[i], reductionIdentity(reductions[i].op, reductionTypes[i]),
+                                ValueType::Inferred);
+    }
+    
+    emitFor(variable, [&] { return convert(beginArg, type); }, [&] { return convert(endArg, type); }, body);
+    
+    for (size_t i = 0; i < reductions.size(); i++) {
+        llvm::Value* slot = builder->CreateInBoundsGEP(reductionTypes[i], field(next + i), chunkArg);
+        builder->CreateStore(emitLoad(reduced[i]), slot);
+    }
+    builder->CreateRetVoid();
+    
+    if (llvm::verifyFunction(*outlined, &llvm::errs())) {
+        restore();
+        outlined->eraseFromParent();
+        throw CodeGenError("Function verification failed for parallel loop in: " + parent->getName().str());
+    }
+    restore();
+    
+    llvm::FunctionCallee runtime = module->getOrInsertFunction(
+        "simplelang_parallel_for",
+        llvm::FunctionType::get(int64Type, {bodyType->getPointerTo(), bytePointer, int64Type, int64Type}, false));
+    llvm::Value* chunks = builder->CreateCall(
+        runtime, {outlined, builder->CreateBitCast(frame, bytePointer), builder->CreateSExt(startValue, int64Type),
+                  builder->CreateSExt(endValue, int64Type)}, "chunks");
+    if (reductions.empty()) {
+        return;
+    }
+    
+    // Fold the partial results into the variables in chunk order, so integer
+    // results never depend on the schedule and f64 results only on the
+    // number of workers
+    llvm::BasicBlock* entry = builder->GetInsertBlock();
+    llvm::BasicBlock* combineBlock = llvm::BasicBlock::Create(*context, "parallel.combine", parent);
+    llvm::BasicBlock* foldBlock = llvm::BasicBlock::Create(*context, "parallel.fold", parent);
+    llvm::BasicBlock* afterBlock = llvm::BasicBlock::Create(*context, "parallel.end", parent);
+    std::vector<llvm::Value*> initial;
+    for (Symbol name : reduced) {
+        initial.push_back(emitLoad(name));
+    }
+    builder->CreateBr(combineBlock);
+    
+    builder->SetInsertPoint(combineBlock);
+    llvm::PHINode* chunk = builder->CreatePHI(int64Type, 2, "chunk");
+    chunk->addIncoming(builder->getInt64(0), entry);
+    std::vector<llvm::PHINode*> results;
+    for (size_t i = 0; i < reductions.size(); i++) {
+        results.push_back(builder->CreatePHI(reductionTypes[i], 2, symbolName(reduced[i])));
+        results.back()->addIncoming(initial[i], entry);
+    }
+    builder->CreateCondBr(builder->CreateICmpSLT(chunk, chunks), foldBlock, afterBlock);
+    sealBlock(foldBlock);
+    sealBlock(afterBlock);
+    
+    builder->SetInsertPoint(foldBlock);
+    for (size_t i = 0; i < reductions.size(); i++) {
+        llvm::Value* partial = builder->CreateLoad(
+            reductionTypes[i], builder->CreateInBoundsGEP(reductionTypes[i], partials[i], chunk), "partial");
+        results[i]->addIncoming(emitReduction(reductions[i].op, results[i], partial), foldBlock);
+    }
+    chunk->addIncoming(builder->CreateNUWAdd(chunk, builder->getInt64(1)), foldBlock);
+    builder->CreateBr(combineBlock);
+    sealBlock(combineBlock);
+    
+    builder->SetInsertPoint(afterBlock);
+    for (size_t i = 0; i < reductions.size(); i++) {
+        emitAssignment(reduced[i], results[i]);
+    }
+}
+
+llvm::Value* CodeGenerator::reductionIdentity(ReductionOp op, llvm::Type* type) {
+    if (type->isDoubleTy()) {
+        switch (op) {
+            case ReductionOp::Add: return llvm::ConstantFP::get(type, 0.0);
+            case ReductionOp::Mul: return llvm::ConstantFP::get(type, 1.0);
+            case ReductionOp::Min: return llvm::ConstantFP::getInfinity(type, false);
+            case ReductionOp::Max: return llvm::ConstantFP::getInfinity(type, true);
+        }
+    }
+    unsigned bits = type->getIntegerBitWidth();
+    switch (op) {
+        case ReductionOp::Add: return llvm::ConstantInt::get(type, 0);
+        case ReductionOp::Mul: return llvm::ConstantInt::get(type, 1);
+        case ReductionOp::Min: return llvm::ConstantInt::get(*context, llvm::APInt::getSignedMaxValue(bits));
+        case ReductionOp::Max: return llvm::ConstantInt::get(*context, llvm::APInt::getSignedMinValue(bits));
+    }
+    throw CodeGenError("Unknown reduction operator");
+}
+
+llvm::Value* CodeGenerator::emitReduction(ReductionOp op, llvm::Value* left, llvm::Value* right) {
+    bool real = left->getType()->isDoubleTy();
+    switch (op) {
+        case ReductionOp::Add:
+            return emitBinary(BinaryOp::Add, left, right);
+        case ReductionOp::Mul:
+            return emitBinary(BinaryOp::Mul, left, right);
+        case ReductionOp::Min:
+            return builder->CreateSelect(real ? builder->CreateFCmpOLT(left, right) : builder->CreateICmpSLT(left, right),
+                                         left, right, "min");
+        case ReductionOp::Max:
+            return builder->CreateSelect(real ? builder->CreateFCmpOGT(left, right) : builder->CreateICmpSGT(left, right),
+                                         left, right, "max");
+    }
+    throw CodeGenError("Unknown reduction operator");
+}
+
+bool CodeGenerator::canFork(Symbol callee, size_t arguments) {
+    if (!options.autoParallel) {
+        return false;
+    }
+    auto function = functions.find(callee);
+    auto signature = signatures.find(callee);
+    if (function == functions.end() || !function->second || signature == signatures.end() ||
+        signature->second.size() != arguments) {
+        return false;
+    }
+    return !printing.count(callee) && std::none_of(signature->second.begin(), signature->second.end(), isArray);
+}
+
+llvm::Function* CodeGenerator::forkThunk(Symbol callee) {
+    llvm::Function*& thunk = forkThunks[callee];
+    if (thunk) {
+        return thunk;
+    }
+    llvm::Function* target = functions[callee];
+    llvm::StructType* frameType = forkFrameType(target);
+    thunk = llvm::Function::Create(llvm::FunctionType::get(builder->getVoidTy(), {builder->getInt8PtrTy()}, false),
+                                   llvm::Function::InternalLinkage, symbolName(callee) + ".fork", module.get());
+    thunk->addFnAttr(llvm::Attribute::NoUnwind);
+    
+    // Arguments come in through the frame and the result goes back in its
+    // last field
+    llvm::IRBuilder<> thunkBuilder(llvm::BasicBlock::Create(*context, "entry", thunk));
+    llvm::Value* frame = thunkBuilder.CreateBitCast(thunk->getArg(0), frameType->getPointerTo(), "frame");
+    std::vector<llvm::Value*> args;
+    for (unsigned i = 0; i < target->arg_size(); i++) {
+        args.push_back(thunkBuilder.CreateLoad(frameType->getElementType(i),
+                                               thunkBuilder.CreateStructGEP(frameType, frame, i)));
+    }
+    llvm::Value* result = thunkBuilder.CreateCall(target, args, "result");
+    thunkBuilder.CreateStore(result, thunkBuilder.CreateStructGEP(frameType, frame, target->arg_size()));
+    thunkBuilder.CreateRetVoid();
+    return thunk;
+}
+
+std::pair<llvm::Value*, llvm::Value*> CodeGenerator::emitForkedCalls(Symbol left,
+                                                                     const std::vector<llvm::Value*>& leftArgs,
+                                                                     Symbol right,
+                                                                     const std::vector<llvm::Value*>& rightArgs) {
+    llvm::Function* parent = builder->GetInsertBlock()->getParent();
+    llvm::Function* target = functions[right];
+    llvm::StructType* frameType = forkFrameType(target);
+    llvm::Type* bytePointer = builder->getInt8PtrTy();
+    llvm::StructType* taskType = llvm::StructType::get(
+        *context, {bytePointer, bytePointer, builder->getInt64Ty(), builder->getInt64Ty()});
+    llvm::FunctionCallee shouldFork = module->getOrInsertFunction(
+        "simplelang_should_fork", llvm::FunctionType::get(builder->getInt32Ty(), false));
+    llvm::FunctionCallee fork = module->getOrInsertFunction(
+        "simplelang_fork", llvm::FunctionType::get(builder->getVoidTy(),
+                                                   {taskType->getPointerTo(), forkThunk(right)->getType(), bytePointer},
+                                                   false));
+    llvm::FunctionCallee join = module->getOrInsertFunction(
+        "simplelang_join", llvm::FunctionType::get(builder->getVoidTy(), {taskType->getPointerTo()}, false));
+    
+    llvm::BasicBlock* forkBlock = llvm::BasicBlock::Create(*context, "fork", parent);
+    llvm::BasicBlock* serialBlock = llvm::BasicBlock::Create(*context, "fork.serial", parent);
+    llvm::BasicBlock* joinBlock = llvm::BasicBlock::Create(*context, "fork.join", parent);
+    llvm::Value* worthwhile = builder->CreateICmpNE(builder->CreateCall(shouldFork, {}, "worthwhile"),
+                                                    builder->getInt32(0));
+    builder->CreateCondBr(worthwhile, forkBlock, serialBlock);
+    sealBlock(forkBlock);
+    sealBlock(serialBlock);
+    
+    // Fork the right call, run the left one here, then wait for the right
+    builder->SetInsertPoint(forkBlock);
+    llvm::AllocaInst* task = createEntryBlockAlloca(parent, "fork.task", taskType);
+    llvm::AllocaInst* frame = createEntryBlockAlloca(parent, symbolName(right) + ".frame", frameType);
+    for (size_t i = 0; i < rightArgs.size(); i++) {
+        builder->CreateStore(convert(rightArgs[i], frameType->getElementType(i)),
+                             builder->CreateStructGEP(frameType, frame, i));
+    }
+    builder->CreateCall(fork, {task, forkThunk(right), builder->CreateBitCast(frame, bytePointer)});
+    llvm::Value* forkedLeft = emitCall(left, leftArgs);
+    builder->CreateCall(join, {task});
+    llvm::Value* forkedRight = builder->CreateLoad(frameType->getElementType(rightArgs.size()),
+                                                   builder->CreateStructGEP(frameType, frame, rightArgs.size()),
+                                                   "forked");
+    builder->CreateBr(joinBlock);
+    forkBlock = builder->GetInsertBlock();
+    
+    builder->SetInsertPoint(serialBlock);
+    llvm::Value* serialLeft = emitCall(left, leftArgs);
+    llvm::Value* serialRight = emitCall(right, rightArgs);
+    builder->CreateBr(joinBlock);
+    serialBlock = builder->GetInsertBlock();
+    sealBlock(joinBlock);
+    
+    builder->SetInsertPoint(joinBlock);
+    llvm::PHINode* leftValue = builder->CreatePHI(forkedLeft->getType(), 2, symbolName(left));
+    leftValue->addIncoming(forkedLeft, forkBlock);
+    leftValue->addIncoming(serialLeft, serialBlock);
+    llvm::PHINode* rightValue = builder->CreatePHI(forkedRight->getType(), 2, symbolName(right));
+    rightValue->addIncoming(forkedRight, forkBlock);
+    rightValue->addIncoming(serialRight, serialBlock);
+    return {leftValue, rightValue};
+}
+
+void CodeGenerator::emitFunction(Symbol name, const std::vector<Symbol>& parameters,
+                                 const std::vector<ValueType>& parameterTypes, ValueType returnType,
+                                 const TailCallPlan& plan, bool memoize, const std::function<void()>& body) {
+    static const Symbol mainName = SymbolTable::global().intern("main");
+    if (name == mainName && returnType != ValueType::I32) {
+        throw CodeGenError("main must return i32");
+    }
+    if (isArray(returnType)) {
+        throw CodeGenError("Function " + symbolName(name) + " cannot return an array");
+    }
+    llvm::FunctionType* type = functionType(parameterTypes, returnType);
+    
+    // f64 operations built for this function may be reassociated and contracted
+    llvm::FastMathFlags fastMath;
+    if (options.fastMath) {
+        fastMath.setFast();
+    }
+    builder->setFastMathFlags(fastMath);
+    
+    // Reuse a forward declaration if there is one
+    llvm::Function* function = functions[name];
+    if (function && !function->empty()) {
+        throw CodeGenError("Redefinition of function: " + symbolName(name));
+    }
+    if (function && function->getFunctionType() != type) {
+        throw CodeGenError("Definition of " + symbolName(name) + " does not match its declaration");
+    }
+    if (!function) {
+        function = llvm::Function::Create(type, llvm::Function::ExternalLinkage, symbolName(name), module.get());
+        addArrayAttributes(function, parameterTypes);
+    }
+    
+    functions[name] = function;
+    signatures[name] = parameterTypes;
+    
+    // A memoized function's public symbol becomes the table lookup; its
+    // body moves to an internal function that recursive calls never
+    // reach directly
+    if (memoize) {
+        if (parameters.empty()) {
+            throw CodeGenError("Cannot memoize " + symbolName(name) + ": it has no parameters");
+        }
+        llvm::Function* wrapper = function;
+        function = llvm::Function::Create(type, llvm::Function::InternalLinkage,
+                                          symbolName(name) + ".body", module.get());
+        nameArguments(wrapper, parameters, parameterTypes);
+        emitMemoWrapper(wrapper, function);
+    }
+    nameArguments(function, parameters, parameterTypes);
+    
+    // Create entry block
+    llvm::BasicBlock* entryBlock = llvm::BasicBlock::Create(*context, "entry", function);
+    builder->SetInsertPoint(entryBlock);
+    
+    // Save current state
+    std::unordered_map<Symbol, llvm::AllocaInst*> oldNamedValues = namedValues;
+    auto oldCurrentDef = std::move(currentDef);
+    auto oldVariableTypes = std::move(variableTypes);
+    auto oldArrays = std::move(arrays);
+    uint64_t oldArrayBytes = arrayBytes;
+    auto oldLoopVariables = std::move(loopVariables);
+    auto oldSharedVariables = std::move(sharedVariables);
+    TailRecursion oldTailRecursion = std::move(tailRecursion);
+    llvm::Function* oldCurrentFunction = currentFunction;
+    currentFunction = function;
+    
+    // Create allocas for parameters, or in SSA mode define them directly
+    namedValues.clear();
+    currentDef.clear();
+    variableTypes.clear();
+    arrays.clear();
+    arrayBytes = 0;
+    loopVariables.clear();
+    sharedVariables.clear();
+    sealBlock(entryBlock);
+    bool arrayParameters = false;
+    auto arg = function->arg_begin();
+    for (size_t i = 0; i < parameters.size(); i++, arg++) {
+        if (isArray(parameterTypes[i])) {
+            llvm::Argument* data = &*arg;
+            arrays[parameters[i]] = ArrayBinding{data, &*++arg, llvmType(elementType(parameterTypes[i]))};
+            arrayParameters = true;
+            continue;
+        }
+        if (options.ssa) {
+            variableTypes[parameters[i]] = arg->getType();
+            writeVariable(parameters[i], entryBlock, &*arg);
+            continue;
+        }
+        llvm::AllocaInst* alloca = createEntryBlockAlloca(function, std::string(arg->getName()), arg->getType());
+        builder->CreateStore(&*arg, alloca);
+        namedValues[parameters[i]] = alloca;
+    }
+    
+    // Self tail calls loop back to a header after the parameter setup.
+    // Array parameters are fixed for the whole body, so functions taking
+    // arrays keep their self calls.
+    tailRecursion = TailRecursion();
+    if (plan.selfTailCalls && !arrayParameters) {
+        tailRecursion.function = name;
+        tailRecursion.parameters = parameters;
+        tailRecursion.plan = plan;
+        llvm::Type* resultType = type->getReturnType();
+        if (resultType->isDoubleTy() && !options.fastMath) {
+            // Accumulating reassociates the floating-point operations
+            tailRecursion.plan.accumulate = false;
+        }
+        if (tailRecursion.plan.accumulate) {
+            // Not a valid identifier, so it cannot clash with a variable
+            tailRecursion.accumulator = SymbolTable::global().intern("tailrecurse.acc");
+            int identity = plan.op == BinaryOp::Mul ? 1 : 0;
+            emitVariableDeclaration(tailRecursion.accumulator,
+                                    convert(llvm::ConstantInt::get(*context, llvm::APInt(32, identity, true)), resultType),
+                                    ValueType::Inferred);
+        }
+        for (Symbol parameter : parameters) {
+            tailRecursion.parameterSlots.push_back(options.ssa ? nullptr : namedValues[parameter]);
+        }
+        tailRecursion.header = llvm::BasicBlock::Create(*context, "tailrecurse", function);
+        builder->CreateBr(tailRecursion.header);
+        builder->SetInsertPoint(tailRecursion.header);
+    }
+    
+    // Generate function body
+    body();
+    
+    // If no explicit return, add return 0
+    if (!builder->GetInsertBlock()->getTerminator()) {
+        emitReturn(nullptr);
+    }
+    if (tailRecursion.header) {
+        sealBlock(tailRecursion.header);
+    }
+    
+    // Every block is sealed by now
+    sealedBlocks.clear();
+    incompletePhis.clear();
+    phiDefinitions.clear();
+    
+    // Verify function
+    if (llvm::verifyFunction(*function, &llvm::errs())) {
+        currentDef = std::move(oldCurrentDef);
+        variableTypes = std::move(oldVariableTypes);
+        arrays = std::move(oldArrays);
+        arrayBytes = oldArrayBytes;
+        loopVariables = std::move(oldLoopVariables);
+        sharedVariables = std::move(oldSharedVariables);
+        tailRecursion = std::move(oldTailRecursion);
+        function->eraseFromParent();
+        throw CodeGenError("Function verification failed for: " + symbolName(name));
+    }
+    
+    // Restore state
+    namedValues = oldNamedValues;
+    currentDef = std::move(oldCurrentDef);
+    variableTypes = std::move(oldVariableTypes);
+    arrays = std::move(oldArrays);
+    arrayBytes = oldArrayBytes;
+    loopVariables = std::move(oldLoopVariables);
+    sharedVariables = std::move(oldSharedVariables);
+    tailRecursion = std::move(oldTailRecursion);
+    currentFunction = oldCurrentFunction;
 }
 
-llvm::AllocaInst* CodeGenerator::createEntryBlockAlloca(llvm::Function* function, const std::string& varName) {
-    llvm::IRBuilder<> tmpBuilder(&function->getEntryBlock(), function->getEntryBlock().begin());
-    return tmpBuilder.CreateAlloca(llvm::Type::getInt32Ty(*context), nullptr, varName);
+bool CodeGenerator::shouldMemoize(Symbol name, bool annotated, bool recursive,
+                                  const std::vector<ValueType>& parameterTypes, ValueType returnType) {
+    bool int32 = returnType == ValueType::I32;
+    for (ValueType type : parameterTypes) {
+        int32 = int32 && type == ValueType::I32;
+    }
+    if (annotated && !int32) {
+        throw CodeGenError("Cannot memoize " + symbolName(name) + ": memo tables hold i32 arguments and results only");
+    }
+    // A cached result would skip the output
+    if (annotated && printing.count(name)) {
+        throw CodeGenError("Cannot memoize " + symbolName(name) + ": it prints");
+    }
+    return annotated || (recursive && int32 && !parameterTypes.empty() && !printing.count(name));
 }
 
-llvm::Type* CodeGenerator::getType(const std::string& typeName) {
-    if (typeName == "int") {
-        return llvm::Type::getInt32Ty(*context);
-    } else if (typeName == "bool") {
-        return llvm::Type::getInt1Ty(*context);
+void CodeGenerator::emitMemoWrapper(llvm::Function* wrapper, llvm::Function* body) {
+    llvm::Type* int32Type = llvm::Type::getInt32Ty(*context);
+    llvm::Type* int64Type = llvm::Type::getInt64Ty(*context);
+    std::string name = wrapper->getName().str();
+    std::vector<llvm::Value*> args;
+    for (auto& arg : wrapper->args()) {
+        args.push_back(&arg);
+    }
+    
+    llvm::BasicBlock* entryBlock = llvm::BasicBlock::Create(*context, "entry", wrapper);
+    llvm::BasicBlock* hashBlock = llvm::BasicBlock::Create(*context, "memo.hash", wrapper);
+    builder->SetInsertPoint(entryBlock);
+    
+    // Return the cached value on a hit; otherwise run the body and let
+    // `store` record its result
+    auto lookup = [&](llvm::Value* hit, const std::function<llvm::Value*()>& cached,
+                      const std::function<void(llvm::Value*)>& store) {
+        llvm::BasicBlock* hitBlock = llvm::BasicBlock::Create(*context, "memo.hit", wrapper);
+        llvm::BasicBlock* missBlock = llvm::BasicBlock::Create(*context, "memo.miss", wrapper);
+        builder->CreateCondBr(hit, hitBlock, missBlock);
+        
+        builder->SetInsertPoint(hitBlock);
+        builder->CreateRet(cached());
+        
+        builder->SetInsertPoint(missBlock);
+        llvm::Value* result = builder->CreateCall(body, args, "result");
+        store(result);
+        builder->CreateRet(result);
+    };
+    
+    if (args.size() == 1) {
+        // Dense entries hold 1 << 32 | value, and are zero while empty
+        llvm::ArrayType* denseType = llvm::ArrayType::get(int64Type, MEMO_DENSE_SIZE);
+        auto* dense = new llvm::GlobalVariable(*module, denseType, false, llvm::GlobalValue::InternalLinkage,
+                                               llvm::ConstantAggregateZero::get(denseType), name + ".memo.dense");
+        llvm::BasicBlock* denseBlock = llvm::BasicBlock::Create(*context, "memo.dense", wrapper, hashBlock);
+        llvm::Value* inRange = builder->CreateICmpULT(args[0], llvm::ConstantInt::get(int32Type, MEMO_DENSE_SIZE),
+                                                      "inrange");
+        builder->CreateCondBr(inRange, denseBlock, hashBlock);
+        
+        builder->SetInsertPoint(denseBlock);
+        llvm::Value* slot = builder->CreateInBoundsGEP(
+            denseType, dense, {builder->getInt64(0), builder->CreateZExt(args[0], int64Type)}, "slot");
+        // Entries are read and written whole, so threads sharing the table
+        // at most compute a result twice
+        llvm::LoadInst* entry = builder->CreateLoad(int64Type, slot, "entry");
+        entry->setAtomic(llvm::AtomicOrdering::Monotonic);
+        llvm::Constant* present = builder->getInt64(1ull << 32);
+        lookup(builder->CreateICmpUGE(entry, present, "hit"),
+               [&] { return builder->CreateTrunc(entry, int32Type, "cached"); },
+               [&](llvm::Value* result) {
+                   builder->CreateStore(builder->CreateOr(builder->CreateZExt(result, int64Type), present), slot)
+                       ->setAtomic(llvm::AtomicOrdering::Monotonic);
+               });
+    } else {
+        builder->CreateBr(hashBlock);
+    }
+    
+    // Hash entries are { sequence, value, keys[arity] }, guarded as a
+    // seqlock for parallel loops: the sequence is 0 while empty, odd while a
+    // writer owns the entry and even otherwise. A reader only trusts fields
+    // read between two equal, even sequence values.
+    builder->SetInsertPoint(hashBlock);
+    llvm::ArrayType* keysType = llvm::ArrayType::get(int32Type, args.size());
+    llvm::StructType* entryType = llvm::StructType::get(*context, {int32Type, int32Type, keysType});
+    llvm::ArrayType* tableType = llvm::ArrayType::get(entryType, MEMO_HASH_SIZE);
+    auto* table = new llvm::GlobalVariable(*module, tableType, false, llvm::GlobalValue::InternalLinkage,
+                                           llvm::ConstantAggregateZero::get(tableType), name + ".memo.table");
+    
+    // FNV-1a over the arguments, then fold the high bits down
+    llvm::Value* hash = builder->getInt32(0x811C9DC5u);
+    for (llvm::Value* arg : args) {
+        hash = builder->CreateMul(builder->CreateXor(hash, arg), builder->getInt32(0x01000193u), "hash");
+    }
+    hash = builder->CreateXor(hash, builder->CreateLShr(hash, 15));
+    llvm::Value* index = builder->CreateAnd(hash, MEMO_HASH_SIZE - 1, "index");
+    llvm::Value* entry = builder->CreateInBoundsGEP(
+        tableType, table, {builder->getInt64(0), builder->CreateZExt(index, int64Type)}, "entry");
+    
+    auto field = [&](unsigned field) {
+        return builder->CreateStructGEP(entryType, entry, field);
+    };
+    auto key = [&](size_t i) {
+        return builder->CreateInBoundsGEP(entryType, entry,
+                                          {builder->getInt32(0), builder->getInt32(2), builder->getInt32(i)});
+    };
+    auto load = [&](llvm::Value* pointer, llvm::AtomicOrdering ordering, const char* name) {
+        llvm::LoadInst* value = builder->CreateLoad(int32Type, pointer, name);
+        value->setAtomic(ordering);
+        return value;
+    };
+    auto store = [&](llvm::Value* value, llvm::Value* pointer, llvm::AtomicOrdering ordering) {
+        builder->CreateStore(value, pointer)->setAtomic(ordering);
+    };
+    llvm::Value* sequence = load(field(0), llvm::AtomicOrdering::Acquire, "sequence");
+    llvm::Value* cached = load(field(1), llvm::AtomicOrdering::Monotonic, "cached");
+    std::vector<llvm::Value*> keys;
+    for (size_t i = 0; i < args.size(); i++) {
+        keys.push_back(load(key(i), llvm::AtomicOrdering::Monotonic, "key"));
+    }
+    builder->CreateFence(llvm::AtomicOrdering::Acquire);
+    llvm::Value* recheck = load(field(0), llvm::AtomicOrdering::Monotonic, "recheck");
+    llvm::Value* even = builder->CreateICmpEQ(builder->CreateAnd(sequence, 1), builder->getInt32(0));
+    llvm::Value* hit = builder->CreateAnd(builder->CreateICmpNE(sequence, builder->getInt32(0)), even);
+    hit = builder->CreateAnd(hit, builder->CreateICmpEQ(sequence, recheck), "hit");
+    for (size_t i = 0; i < args.size(); i++) {
+        hit = builder->CreateAnd(hit, builder->CreateICmpEQ(keys[i], args[i]), "hit");
+    }
+    lookup(hit,
+           [&] { return cached; },
+           [&](llvm::Value* result) {
+               // Claim the entry unless another writer holds it; a lost
+               // race only means this result is not cached
+               llvm::Value* expected = builder->CreateAnd(sequence, ~1u);
+               llvm::Value* claim = builder->CreateAtomicCmpXchg(
+                   field(0), expected, builder->CreateAdd(expected, builder->getInt32(1)), llvm::MaybeAlign(4),
+                   llvm::AtomicOrdering::AcquireRelease, llvm::AtomicOrdering::Monotonic);
+               llvm::BasicBlock* storeBlock = llvm::BasicBlock::Create(*context, "memo.store", wrapper);
+               llvm::BasicBlock* doneBlock = llvm::BasicBlock::Create(*context, "memo.done", wrapper);
+               builder->CreateCondBr(builder->CreateExtractValue(claim, 1), storeBlock, doneBlock);
+               
+               builder->SetInsertPoint(storeBlock);
+               store(result, field(1), llvm::AtomicOrdering::Monotonic);
+               for (size_t i = 0; i < args.size(); i++) {
+                   store(args[i], key(i), llvm::AtomicOrdering::Monotonic);
+               }
+               store(builder->CreateAdd(expected, builder->getInt32(2)), field(0), llvm::AtomicOrdering::Release);
+               builder->CreateBr(doneBlock);
+               builder->SetInsertPoint(doneBlock);
+           });
+    
+    if (llvm::verifyFunction(*wrapper, &llvm::errs())) {
+        throw CodeGenError("Function verification failed for memo wrapper of: " + name);
     }
-    return llvm::Type::getVoidTy(*context);
 }
 
-void CodeGenerator::generate(Program& program) {
-    program.accept(*this);
+void CodeGenerator::emitReturn(llvm::Value* value) {
+    llvm::Type* returnType = currentFunction->getReturnType();
+    if (returnType->isVoidTy()) {
+        // Only outlined parallel loop bodies return void
+        throw CodeGenError("Cannot return from inside a parallel for loop");
+    }
+    if (!value) {
+        value = llvm::Constant::getNullValue(returnType);
+    }
+    value = convert(value, returnType);
+    
+    if (tailRecursion.plan.accumulate) {
+        value = emitBinary(tailRecursion.plan.op, emitLoad(tailRecursion.accumulator), value);
+    } else if (auto* call = llvm::dyn_cast<llvm::CallInst>(value)) {
+        // A call whose result is returned as is is a tail call; with the
+        // caller's exact prototype it is guaranteed not to grow the stack.
+        // An array other than one the caller was given lives in the
+        // caller's frame, which a tail call may reuse, so none is allowed.
+        bool frameArrays = std::any_of(call->arg_begin(), call->arg_end(), [](const llvm::Use& arg) {
+            return arg->getType()->isPointerTy() && !llvm::isa<llvm::Argument>(arg.get());
+        });
+        llvm::BasicBlock* block = builder->GetInsertBlock();
+        if (!frameArrays && !block->empty() && &block->back() == call) {
+            call->setTailCallKind(call->getFunctionType() == currentFunction->getFunctionType()
+                                  ? llvm::CallInst::TCK_MustTail : llvm::CallInst::TCK_Tail);
+        }
+    }
+    builder->CreateRet(value);
 }
 
-void CodeGenerator::dumpIR() {
-    module->print(llvm::outs(), nullptr);
+void CodeGenerator::emitTailJump(const std::vector<llvm::Value*>& args, llvm::Value* operand) {
+    if (operand) {
+        llvm::Value* accumulated = emitBinary(tailRecursion.plan.op, emitLoad(tailRecursion.accumulator), operand);
+        emitAssignment(tailRecursion.accumulator, accumulated);
+    }
+    
+    // Every argument is evaluated before any parameter is reassigned. The
+    // stores go to the original parameter slots, which the header reads
+    // even if the body later redeclares a parameter.
+    for (size_t i = 0; i < args.size(); i++) {
+        if (options.ssa) {
+            writeVariable(tailRecursion.parameters[i], builder->GetInsertBlock(),
+                          convert(args[i], currentFunction->getArg(i)->getType()));
+        } else {
+            builder->CreateStore(convert(args[i], currentFunction->getArg(i)->getType()),
+                                 tailRecursion.parameterSlots[i]);
+        }
+    }
+    builder->CreateBr(tailRecursion.header);
 }
 
-void CodeGenerator::writeIRToFile(const std::string& filename) {
-    std::error_code EC;
-    llvm::raw_fd_ostream dest(filename, EC, llvm::sys::fs::OF_None);
+bool CodeGenerator::emitTailRecursion(Expression* value) {
+    if (!tailRecursion.header) {
+        return false;
+    }
+    TailCallMatch match = matchTailCall(value, tailRecursion.function, tailRecursion.parameters.size());
+    if (!match.call || !tailRecursion.plan.accepts(match.operand != nullptr, match.op)) {
+        return false;
+    }
     
-    if (EC) {
-        throw CodeGenError("Could not open file: " + EC.message());
+    // Keep the source's evaluation order
+    llvm::Value* operand = nullptr;
+    if (match.operand && match.operandFirst) {
+        match.operand->accept(*this);
+        operand = lastValue;
+    }
+    std::vector<llvm::Value*> args;
+    for (Expression* arg : match.call->arguments) {
+        arg->accept(*this);
+        args.push_back(lastValue);
+    }
+    if (match.operand && !match.operandFirst) {
+        match.operand->accept(*this);
+        operand = lastValue;
     }
     
-    module->print(dest, nullptr);
+    emitTailJump(args, operand);
+    return true;
 }
 
-int CodeGenerator::executeJIT() {
-    // Verify the module
-    std::string errorStr;
-    if (llvm::verifyModule(*module, &llvm::errs())) {
-        throw CodeGenError("Module verification failed");
+bool CodeGenerator::flatTailRecursion(const FlatAST& ast, NodeIndex value) {
+    if (!tailRecursion.header) {
+        return false;
     }
-    
-    // Create execution engine
-    llvm::ExecutionEngine* executionEngine = llvm::EngineBuilder(std::unique_ptr<llvm::Module>(module.release()))
-        .setErrorStr(&errorStr)
-        .create();
-    
-    if (!executionEngine) {
-        throw CodeGenError("Failed to create execution engine: " + errorStr);
+    FlatTailCallMatch match = matchTailCall(ast, value, tailRecursion.function, tailRecursion.parameters.size());
+    if (match.call == NO_NODE || !tailRecursion.plan.accepts(match.operand != NO_NODE, match.op)) {
+        return false;
     }
     
-    // Look for main function
-    llvm::Function* mainFunction = executionEngine->FindFunctionNamed("main");
-    if (!mainFunction) {
-        throw CodeGenError("Main function not found");
+    // Keep the source's evaluation order
+    llvm::Value* operand = nullptr;
+    if (match.operand != NO_NODE && match.operandFirst) {
+        operand = flatExpression(ast, match.operand);
+    }
+    std::vector<llvm::Value*> args;
+    for (NodeIndex i = 0; i < ast.b[match.call]; i++) {
+        args.push_back(flatExpression(ast, ast.listItem(match.call, i)));
+    }
+    if (match.operand != NO_NODE && !match.operandFirst) {
+        operand = flatExpression(ast, match.operand);
     }
     
-    // Execute main function
-    std::vector<llvm::GenericValue> args;
-    llvm::GenericValue result = executionEngine->runFunction(mainFunction, args);
-    
-    delete executionEngine;
-    return result.IntVal.getSExtValue();
+    emitTailJump(args, operand);
+    return true;
 }
 
 void CodeGenerator::visit(NumberLiteral& node) {
-    lastValue = llvm::ConstantInt::get(*context, llvm::APInt(32, node.value, true));
+    lastValue = llvm::ConstantInt::get(llvmType(node.type), node.value, true);
+}
+
+void CodeGenerator::visit(FloatLiteral& node) {
+    lastValue = llvm::ConstantFP::get(llvmType(ValueType::F64), node.value);
 }
 
 void CodeGenerator::visit(BooleanLiteral& node) {
@@ -88,226 +2421,149 @@ void CodeGenerator::visit(BooleanLiteral& node) {
 }
 
 void CodeGenerator::visit(Variable& node) {
-    llvm::AllocaInst* alloca = namedValues[node.name];
-    if (!alloca) {
-        throw CodeGenError("Unknown variable name: " + node.name);
+    lastValue = emitLoad(node.name);
+}
+
+void CodeGenerator::visitLogical(BinaryOperation& node) {
+    // A chain a && b && c nests to the left; lower it with a loop so only
+    // right operands recurse
+    std::vector<BinaryOperation*> chain{&node};
+    while (auto* left = dynamic_cast<BinaryOperation*>(chain.back()->left)) {
+        if (left->op != BinaryOp::And && left->op != BinaryOp::Or) {
+            break;
+        }
+        chain.push_back(left);
     }
-    
-    // Load the value
-    lastValue = builder->CreateLoad(alloca->getAllocatedType(), alloca, node.name.c_str());
+    chain.back()->left->accept(*this);
+    llvm::Value* value = lastValue;
+    for (auto link = chain.rbegin(); link != chain.rend(); ++link) {
+        Expression* right = (*link)->right;
+        value = emitLogical((*link)->op, value, [&] { right->accept(*this); return lastValue; });
+    }
+    lastValue = value;
+}
+
+bool CodeGenerator::visitForkedCalls(BinaryOperation& node) {
+    auto* leftCall = dynamic_cast<FunctionCall*>(node.left);
+    auto* rightCall = dynamic_cast<FunctionCall*>(node.right);
+    if (!leftCall || !rightCall || !canFork(leftCall->name, leftCall->arguments.size()) ||
+        !canFork(rightCall->name, rightCall->arguments.size())) {
+        return false;
+    }
+    std::vector<llvm::Value*> leftArgs;
+    for (Expression* arg : leftCall->arguments) {
+        arg->accept(*this);
+        leftArgs.push_back(lastValue);
+    }
+    std::vector<llvm::Value*> rightArgs;
+    for (Expression* arg : rightCall->arguments) {
+        arg->accept(*this);
+        rightArgs.push_back(lastValue);
+    }
+    auto results = emitForkedCalls(leftCall->name, leftArgs, rightCall->name, rightArgs);
+    lastValue = emitBinary(node.op, results.first, results.second);
+    return true;
 }
 
 void CodeGenerator::visit(BinaryOperation& node) {
+    if (node.op == BinaryOp::And || node.op == BinaryOp::Or) {
+        visitLogical(node);
+        return;
+    }
+    
+    if (visitForkedCalls(node)) {
+        return;
+    }
+    
     node.left->accept(*this);
     llvm::Value* left = lastValue;
     
     node.right->accept(*this);
     llvm::Value* right = lastValue;
     
-    if (!left || !right) {
-        throw CodeGenError("Invalid operands for binary operation");
-    }
-    
-    if (node.operator_ == "+") {
-        lastValue = builder->CreateAdd(left, right, "addtmp");
-    } else if (node.operator_ == "-") {
-        lastValue = builder->CreateSub(left, right, "subtmp");
-    } else if (node.operator_ == "*") {
-        lastValue = builder->CreateMul(left, right, "multmp");
-    } else if (node.operator_ == "/") {
-        lastValue = builder->CreateSDiv(left, right, "divtmp");
-    } else if (node.operator_ == "<") {
-        lastValue = builder->CreateICmpSLT(left, right, "cmptmp");
-    } else if (node.operator_ == "<=") {
-        lastValue = builder->CreateICmpSLE(left, right, "cmptmp");
-    } else if (node.operator_ == ">") {
-        lastValue = builder->CreateICmpSGT(left, right, "cmptmp");
-    } else if (node.operator_ == ">=") {
-        lastValue = builder->CreateICmpSGE(left, right, "cmptmp");
-    } else if (node.operator_ == "==") {
-        lastValue = builder->CreateICmpEQ(left, right, "cmptmp");
-    } else if (node.operator_ == "!=") {
-        lastValue = builder->CreateICmpNE(left, right, "cmptmp");
-    } else if (node.operator_ == "&&") {
-        lastValue = builder->CreateAnd(left, right, "andtmp");
-    } else if (node.operator_ == "||") {
-        lastValue = builder->CreateOr(left, right, "ortmp");
-    } else {
-        throw CodeGenError("Unknown binary operator: " + node.operator_);
-    }
+    lastValue = emitBinary(node.op, left, right);
 }
 
 void CodeGenerator::visit(UnaryOperation& node) {
     node.operand->accept(*this);
-    llvm::Value* operand = lastValue;
-    
-    if (!operand) {
-        throw CodeGenError("Invalid operand for unary operation");
-    }
-    
-    if (node.operator_ == "-") {
-        lastValue = builder->CreateNeg(operand, "negtmp");
-    } else if (node.operator_ == "!") {
-        lastValue = builder->CreateNot(operand, "nottmp");
-    } else {
-        throw CodeGenError("Unknown unary operator: " + node.operator_);
-    }
+    lastValue = emitUnary(node.op, lastValue);
+}
+
+void CodeGenerator::visit(ArrayAccess& node) {
+    node.index->accept(*this);
+    lastValue = emitArrayLoad(node.array, lastValue);
 }
 
 void CodeGenerator::visit(FunctionCall& node) {
-    llvm::Function* calleeFunction = functions[node.name];
-    if (!calleeFunction) {
-        throw CodeGenError("Unknown function referenced: " + node.name);
-    }
-    
-    // Check argument count
-    if (calleeFunction->arg_size() != node.arguments.size()) {
-        throw CodeGenError("Incorrect number of arguments passed to function: " + node.name);
-    }
-    
     std::vector<llvm::Value*> args;
     for (auto& arg : node.arguments) {
         arg->accept(*this);
         args.push_back(lastValue);
-        if (!lastValue) {
-            throw CodeGenError("Invalid argument in function call");
-        }
     }
     
-    lastValue = builder->CreateCall(calleeFunction, args, "calltmp");
+    lastValue = emitCall(node.name, args);
 }
 
 void CodeGenerator::visit(VariableDeclaration& node) {
-    llvm::Function* function = builder->GetInsertBlock()->getParent();
-    
-    // Create alloca in entry block
-    llvm::AllocaInst* alloca = createEntryBlockAlloca(function, node.name);
-    
     // Generate initializer if present
     llvm::Value* initValue = nullptr;
     if (node.initializer) {
         node.initializer->accept(*this);
         initValue = lastValue;
-    } else {
-        // Default initialize to 0
-        initValue = llvm::ConstantInt::get(*context, llvm::APInt(32, 0, true));
     }
     
-    builder->CreateStore(initValue, alloca);
-    namedValues[node.name] = alloca;
+    if (isArray(node.type)) {
+        emitArrayDeclaration(node.name, node.type, node.length);
+    } else {
+        emitVariableDeclaration(node.name, initValue, node.type);
+    }
     lastValue = nullptr; // Variable declarations don't return values
 }
 
 void CodeGenerator::visit(Assignment& node) {
-    llvm::AllocaInst* variable = namedValues[node.name];
-    if (!variable) {
-        throw CodeGenError("Unknown variable name: " + node.name);
-    }
-    
     node.value->accept(*this);
-    if (!lastValue) {
-        throw CodeGenError("Invalid assignment value");
-    }
-    
-    builder->CreateStore(lastValue, variable);
+    emitAssignment(node.name, lastValue);
+}
+
+void CodeGenerator::visit(ArrayAssignment& node) {
+    node.index->accept(*this);
+    llvm::Value* index = lastValue;
+    node.value->accept(*this);
+    emitArrayStore(node.array, index, lastValue);
+    lastValue = nullptr;
 }
 
 void CodeGenerator::visit(IfStatement& node) {
-    node.condition->accept(*this);
-    llvm::Value* conditionValue = lastValue;
-    
-    if (!conditionValue) {
-        throw CodeGenError("Invalid if condition");
-    }
-    
-    // Convert condition to boolean if necessary
-    if (conditionValue->getType() != llvm::Type::getInt1Ty(*context)) {
-        conditionValue = builder->CreateICmpNE(conditionValue,
-                                               llvm::ConstantInt::get(*context, llvm::APInt(32, 0, true)),
-                                               "ifcond");
-    }
-    
-    llvm::Function* function = builder->GetInsertBlock()->getParent();
-    
-    // Create blocks
-    llvm::BasicBlock* thenBlock = llvm::BasicBlock::Create(*context, "then", function);
-    llvm::BasicBlock* elseBlock = node.elseBranch ? 
-        llvm::BasicBlock::Create(*context, "else", function) : nullptr;
-    llvm::BasicBlock* mergeBlock = llvm::BasicBlock::Create(*context, "ifcont", function);
-    
-    // Create conditional branch
-    if (node.elseBranch) {
-        builder->CreateCondBr(conditionValue, thenBlock, elseBlock);
-    } else {
-        builder->CreateCondBr(conditionValue, thenBlock, mergeBlock);
-    }
-    
-    // Generate then block
-    builder->SetInsertPoint(thenBlock);
-    node.thenBranch->accept(*this);
-    
-    // Only add branch if block doesn't already have a terminator
-    if (!builder->GetInsertBlock()->getTerminator()) {
-        builder->CreateBr(mergeBlock);
-    }
-    
-    // Generate else block if present
-    if (node.elseBranch) {
-        builder->SetInsertPoint(elseBlock);
-        node.elseBranch->accept(*this);
-        
-        // Only add branch if block doesn't already have a terminator
-        if (!builder->GetInsertBlock()->getTerminator()) {
-            builder->CreateBr(mergeBlock);
-        }
-    }
-    
-    // Continue with merge block
-    builder->SetInsertPoint(mergeBlock);
+    BranchHint hint = BranchHint::None;
+    Expression* condition = stripBranchHint(node.condition, hint);
+    std::function<void()> elseBranch = [&] { node.elseBranch->accept(*this); };
+    emitIf([&] { condition->accept(*this); return lastValue; }, hint,
+           [&] { node.thenBranch->accept(*this); },
+           node.elseBranch ? &elseBranch : nullptr);
     lastValue = nullptr; // If statements don't return values
 }
 
 void CodeGenerator::visit(WhileStatement& node) {
-    llvm::Function* function = builder->GetInsertBlock()->getParent();
-    
-    llvm::BasicBlock* condBlock = llvm::BasicBlock::Create(*context, "whilecond", function);
-    llvm::BasicBlock* bodyBlock = llvm::BasicBlock::Create(*context, "whilebody", function);
-    llvm::BasicBlock* afterBlock = llvm::BasicBlock::Create(*context, "afterwhile", function);
-    
-    builder->CreateBr(condBlock);
-    
-    // Generate condition block
-    builder->SetInsertPoint(condBlock);
-    node.condition->accept(*this);
-    llvm::Value* conditionValue = lastValue;
-    
-    if (!conditionValue) {
-        throw CodeGenError("Invalid while condition");
-    }
-    
-    // Convert condition to boolean if necessary
-    if (conditionValue->getType() != llvm::Type::getInt1Ty(*context)) {
-        conditionValue = builder->CreateICmpNE(conditionValue,
-                                               llvm::ConstantInt::get(*context, llvm::APInt(32, 0, true)),
-                                               "whilecond");
-    }
-    
-    builder->CreateCondBr(conditionValue, bodyBlock, afterBlock);
-    
-    // Generate body block
-    builder->SetInsertPoint(bodyBlock);
-    node.body->accept(*this);
-    
-    // Only add branch if block doesn't already have a terminator
-    if (!builder->GetInsertBlock()->getTerminator()) {
-        builder->CreateBr(condBlock);
-    }
-    
-    // Continue with after block
-    builder->SetInsertPoint(afterBlock);
+    BranchHint hint = BranchHint::None;
+    Expression* condition = stripBranchHint(node.condition, hint);
+    emitWhile([&] { condition->accept(*this); return lastValue; }, hint,
+              [&] { node.body->accept(*this); });
     lastValue = nullptr; // While statements don't return values
 }
 
+void CodeGenerator::visit(ForStatement& node) {
+    auto start = [&] { node.start->accept(*this); return lastValue; };
+    auto end = [&] { node.end->accept(*this); return lastValue; };
+    auto body = [&] { node.body->accept(*this); };
+    if (node.parallel) {
+        emitParallelFor(node.variable, start, end,
+                        std::vector<Reduction>(node.reductions.begin(), node.reductions.end()), body);
+    } else {
+        emitFor(node.variable, start, end, body);
+    }
+    lastValue = nullptr;
+}
+
 void CodeGenerator::visit(Block& node) {
     for (auto& stmt : node.statements) {
         stmt->accept(*this);
@@ -315,64 +2571,28 @@ void CodeGenerator::visit(Block& node) {
 }
 
 void CodeGenerator::visit(FunctionDeclaration& node) {
-    // Create function type
-    std::vector<llvm::Type*> paramTypes(node.parameters.size(), llvm::Type::getInt32Ty(*context));
-    llvm::FunctionType* functionType = llvm::FunctionType::get(llvm::Type::getInt32Ty(*context), paramTypes, false);
-    
-    llvm::Function* function = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage, node.name, module.get());
-    
-    // Set parameter names
-    unsigned idx = 0;
-    for (auto& arg : function->args()) {
-        arg.setName(node.parameters[idx++]);
-    }
-    
-    functions[node.name] = function;
-    
-    // Create entry block
-    llvm::BasicBlock* entryBlock = llvm::BasicBlock::Create(*context, "entry", function);
-    builder->SetInsertPoint(entryBlock);
-    
-    // Save current state
-    std::unordered_map<std::string, llvm::AllocaInst*> oldNamedValues = namedValues;
-    llvm::Function* oldCurrentFunction = currentFunction;
-    currentFunction = function;
-    
-    // Create allocas for parameters
-    namedValues.clear();
-    for (auto& arg : function->args()) {
-        llvm::AllocaInst* alloca = createEntryBlockAlloca(function, std::string(arg.getName()));
-        builder->CreateStore(&arg, alloca);
-        namedValues[std::string(arg.getName())] = alloca;
-    }
-    
-    // Generate function body
-    node.body->accept(*this);
-    
-    // If no explicit return, add return 0
-    if (!builder->GetInsertBlock()->getTerminator()) {
-        builder->CreateRet(llvm::ConstantInt::get(*context, llvm::APInt(32, 0, true)));
-    }
-    
-    // Verify function
-    if (llvm::verifyFunction(*function, &llvm::errs())) {
-        function->eraseFromParent();
-        throw CodeGenError("Function verification failed for: " + node.name);
-    }
-    
-    // Restore state
-    namedValues = oldNamedValues;
-    currentFunction = oldCurrentFunction;
+    std::vector<Symbol> parameters(node.parameters.begin(), node.parameters.end());
+    TailCallPlan plan;
+    scanReturns(node.body, node.name, parameters.size(), plan);
+    std::vector<ValueType> parameterTypes(node.parameterTypes.begin(), node.parameterTypes.end());
+    bool memoize = shouldMemoize(node.name, node.memoize, options.memoize && countCalls(node.body, node.name) > 1,
+                                 parameterTypes, node.returnType);
+    emitFunction(node.name, parameters, parameterTypes, node.returnType, plan, memoize,
+                 [&] { node.body->accept(*this); });
     lastValue = nullptr;
 }
 
 void CodeGenerator::visit(ReturnStatement& node) {
+    if (node.value && emitTailRecursion(node.value)) {
+        return;
+    }
+    
+    llvm::Value* value = nullptr;
     if (node.value) {
         node.value->accept(*this);
-        builder->CreateRet(lastValue);
-    } else {
-        builder->CreateRet(llvm::ConstantInt::get(*context, llvm::APInt(32, 0, true)));
+        value = lastValue;
     }
+    emitReturn(value);
 }
 
 void CodeGenerator::visit(ExpressionStatement& node) {
@@ -384,4 +2604,232 @@ void CodeGenerator::visit(Program& node) {
     for (auto& stmt : node.statements) {
         stmt->accept(*this);
     }
+}
+
+// Flat-AST code generation. An expression occupies a contiguous post-order
+// range of the flat arrays, so it is evaluated by one linear sweep over that
+// range with an explicit value stack; statements recurse on their children.
+llvm::Value* CodeGenerator::flatExpression(const FlatAST& ast, NodeIndex node) {
+    NodeIndex start = ast.expressionStart(node);
+    
+    // The right operand of && and || must not be evaluated eagerly, and
+    // the two calls of a forkable f(a) op g(b) are emitted together. Such
+    // subtrees are found in one pass, which also tracks each node's first
+    // index, since a left-nested chain shares it
+    auto forkable = [&](NodeIndex call) {
+        return ast.kinds[call] == NodeKind::Call && canFork(static_cast<Symbol>(ast.values[call]), ast.b[call]);
+    };
+    std::vector<NodeIndex> starts(node - start + 1);
+    DeferredNodes deferred;
+    for (NodeIndex i = start; i <= node; i++) {
+        NodeIndex first = i;
+        switch (ast.kinds[i]) {
+            case NodeKind::Binary:
+            case NodeKind::Unary:
+            case NodeKind::ArrayAccess:
+                first = starts[ast.a[i] - start];
+                break;
+            case NodeKind::Call:
+                if (ast.b[i] != 0) {
+                    first = starts[ast.listItem(i, 0) - start];
+                }
+                break;
+            default:
+                break;
+        }
+        starts[i - start] = first;
+        if (ast.kinds[i] == NodeKind::Binary &&
+            (ast.binaryOp(i) == BinaryOp::And || ast.binaryOp(i) == BinaryOp::Or ||
+             (options.autoParallel && forkable(ast.a[i]) && forkable(ast.b[i])))) {
+            deferred[first].push_back(i);
+        }
+    }
+    return flatRange(ast, start, node, deferred);
+}
+
+// A post-order sweep over [start, end] with an explicit value stack. Each
+// outermost deferred subtree goes to emitLogical or emitForkedCalls, which
+// sweep its operands' ranges in turn, and the sweep resumes after it.
+llvm::Value* CodeGenerator::flatRange(const FlatAST& ast, NodeIndex start, NodeIndex end,
+                                      const DeferredNodes& deferred) {
+    std::vector<llvm::Value*> stack;
+    std::vector<llvm::Value*> args;
+    for (NodeIndex i = start; i <= end; i++) {
+        // Subtrees starting at i are nested, so the last one within range is outermost
+        NodeIndex root = NO_NODE;
+        auto it = deferred.empty() ? deferred.end() : deferred.find(i);
+        if (it != deferred.end()) {
+            auto bound = std::upper_bound(it->second.begin(), it->second.end(), end);
+            if (bound != it->second.begin()) {
+                root = *std::prev(bound);
+            }
+        }
+        if (root != NO_NODE) {
+            BinaryOp op = ast.binaryOp(root);
+            if (op == BinaryOp::And || op == BinaryOp::Or) {
+                // The links of a left-nested chain; only right operands recurse
+                std::vector<NodeIndex> chain{root};
+                for (NodeIndex left = ast.a[root];
+                     ast.kinds[left] == NodeKind::Binary &&
+                     (ast.binaryOp(left) == BinaryOp::And || ast.binaryOp(left) == BinaryOp::Or);
+                     left = ast.a[left]) {
+                    chain.push_back(left);
+                }
+                llvm::Value* value = flatRange(ast, i, ast.a[chain.back()], deferred);
+                for (auto link = chain.rbegin(); link != chain.rend(); ++link) {
+                    NodeIndex logical = *link;
+                    value = emitLogical(ast.binaryOp(logical), value,
+                                        [&] { return flatRange(ast, ast.a[logical] + 1, ast.b[logical], deferred); });
+                }
+                stack.push_back(value);
+                i = root;
+                continue;
+            }
+            // Arguments are laid out in order, each right after the previous one
+            auto arguments = [&](NodeIndex call, NodeIndex first) {
+                std::vector<llvm::Value*> values;
+                for (NodeIndex k = 0; k < ast.b[call]; k++) {
+                    NodeIndex item = ast.listItem(call, k);
+                    values.push_back(flatRange(ast, first, item, deferred));
+                    first = item + 1;
+                }
+                return values;
+            };
+            NodeIndex left = ast.a[root];
+            NodeIndex right = ast.b[root];
+            std::vector<llvm::Value*> leftArgs = arguments(left, i);
+            std::vector<llvm::Value*> rightArgs = arguments(right, left + 1);
+            auto results = emitForkedCalls(static_cast<Symbol>(ast.values[left]), leftArgs,
+                                           static_cast<Symbol>(ast.values[right]), rightArgs);
+            stack.push_back(emitBinary(op, results.first, results.second));
+            i = root;
+            continue;
+        }
+        switch (ast.kinds[i]) {
+            case NodeKind::Number:
+                stack.push_back(llvm::ConstantInt::get(llvmType(ast.valueType(i)), ast.integer(i), true));
+                break;
+            case NodeKind::Float:
+                stack.push_back(llvm::ConstantFP::get(llvmType(ValueType::F64), ast.real(i)));
+                break;
+            case NodeKind::Boolean:
+                stack.push_back(llvm::ConstantInt::get(*context, llvm::APInt(1, ast.values[i] ? 1 : 0, false)));
+                break;
+            case NodeKind::Variable:
+                stack.push_back(emitLoad(static_cast<Symbol>(ast.values[i])));
+                break;
+            case NodeKind::Binary: {
+                llvm::Value* right = stack.back();
+                stack.pop_back();
+                llvm::Value* left = stack.back();
+                stack.back() = emitBinary(ast.binaryOp(i), left, right);
+                break;
+            }
+            case NodeKind::Unary:
+                stack.back() = emitUnary(ast.unaryOp(i), stack.back());
+                break;
+            case NodeKind::ArrayAccess:
+                stack.back() = emitArrayLoad(static_cast<Symbol>(ast.values[i]), stack.back());
+                break;
+            case NodeKind::Call: {
+                size_t count = ast.b[i];
+                args.assign(stack.end() - count, stack.end());
+                stack.resize(stack.size() - count);
+                stack.push_back(emitCall(static_cast<Symbol>(ast.values[i]), args));
+                break;
+            }
+            default:
+                throw CodeGenError("Statement node inside an expression");
+        }
+    }
+    
+    return stack.back();
+}
+
+void CodeGenerator::flatStatement(const FlatAST& ast, NodeIndex node) {
+    Symbol name = static_cast<Symbol>(ast.values[node]);
+    NodeIndex a = ast.a[node];
+    NodeIndex b = ast.b[node];
+    NodeIndex c = ast.c[node];
+    
+    switch (ast.kinds[node]) {
+        case NodeKind::VariableDeclaration:
+            if (isArray(ast.valueType(node))) {
+                emitArrayDeclaration(name, ast.valueType(node), b);
+                break;
+            }
+            emitVariableDeclaration(name, a == NO_NODE ? nullptr : flatExpression(ast, a), ast.valueType(node));
+            break;
+        case NodeKind::Assignment:
+            emitAssignment(name, flatExpression(ast, a));
+            break;
+        case NodeKind::ArrayAssignment: {
+            llvm::Value* index = flatExpression(ast, a);
+            emitArrayStore(name, index, flatExpression(ast, b));
+            break;
+        }
+        case NodeKind::If: {
+            BranchHint hint = BranchHint::None;
+            NodeIndex condition = flatStripBranchHint(ast, a, hint);
+            std::function<void()> elseBranch = [&] { flatStatement(ast, c); };
+            emitIf([&] { return flatExpression(ast, condition); }, hint,
+                   [&] { flatStatement(ast, b); },
+                   c == NO_NODE ? nullptr : &elseBranch);
+            break;
+        }
+        case NodeKind::While: {
+            BranchHint hint = BranchHint::None;
+            NodeIndex condition = flatStripBranchHint(ast, a, hint);
+            emitWhile([&] { return flatExpression(ast, condition); }, hint,
+                      [&] { flatStatement(ast, b); });
+            break;
+        }
+        case NodeKind::For:
+            emitFor(name, [&] { return flatExpression(ast, a); }, [&] { return flatExpression(ast, b); },
+                    [&] { flatStatement(ast, c); });
+            break;
+        case NodeKind::ParallelFor: {
+            std::vector<Reduction> reductions;
+            for (size_t i = 0; i < ast.reductionCount(node); i++) {
+                reductions.push_back(ast.reduction(node, i));
+            }
+            emitParallelFor(name, [&] { return flatExpression(ast, ast.listItem(node, 0)); },
+                            [&] { return flatExpression(ast, ast.listItem(node, 1)); }, reductions,
+                            [&] { flatStatement(ast, c); });
+            break;
+        }
+        case NodeKind::Block:
+        case NodeKind::Program:
+            for (NodeIndex i = 0; i < b; i++) {
+                flatStatement(ast, ast.listItem(node, i));
+            }
+            break;
+        case NodeKind::Function: {
+            std::vector<Symbol> parameters;
+            std::vector<ValueType> parameterTypes;
+            for (NodeIndex i = 0; i < b; i++) {
+                parameters.push_back(static_cast<Symbol>(ast.listItem(node, i)));
+                parameterTypes.push_back(ast.parameterType(node, i));
+            }
+            TailCallPlan plan;
+            scanReturns(ast, c, name, parameters.size(), plan);
+            bool memoize = shouldMemoize(name, ast.ops[node] != 0, options.memoize && countCalls(ast, c, name) > 1,
+                                         parameterTypes, ast.returnType(node));
+            emitFunction(name, parameters, parameterTypes, ast.returnType(node), plan, memoize,
+                         [&] { flatStatement(ast, c); });
+            break;
+        }
+        case NodeKind::Return:
+            if (a != NO_NODE && flatTailRecursion(ast, a)) {
+                break;
+            }
+            emitReturn(a == NO_NODE ? nullptr : flatExpression(ast, a));
+            break;
+        case NodeKind::ExpressionStatement:
+            flatExpression(ast, a);
+            break;
+        default:
+            throw CodeGenError("Expression node used as a statement");
+    }
+    lastValue = nullptr;
 }
\ No newline at end of file
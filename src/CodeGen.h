@@ -1,6 +1,7 @@
 // CodeGen.h - LLVM Code Generator
 #pragma once
 #include "AST.h"
+#include "FlatAST.h"
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/IRBuilder.h>
@@ -10,32 +11,123 @@
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/Compiler.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Target/TargetMachine.h>
-#include <llvm/IR/LegacyPassManager.h>
-#include <llvm/ExecutionEngine/ExecutionEngine.h>
-#include <llvm/ExecutionEngine/MCJIT.h>
-#include <llvm/ExecutionEngine/GenericValue.h>
+#include <functional>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
+#include <vector>
 
 class CodeGenError : public std::runtime_error {
 public:
     CodeGenError(const std::string& msg) : std::runtime_error(msg) {}
 };
 
+// Symbol the program's `main` is renamed to in native output, so a C entry
+// point can call it
+constexpr const char* NATIVE_ENTRY = "simplelang_main";
+// Prefix every other function is exported under in native output, so a
+// program's functions cannot take the place of libc's (`write`, `exit`)
+constexpr const char* NATIVE_PREFIX = "sl_";
+
+// Switches that change the generated code. Must be set before any code is
+// generated.
+struct CodeGenOptions {
+    bool ssa = false;      // Build SSA directly instead of lowering variables to allocas
+    bool memoize = false;  // Memoize every function that recurses more than once
+    bool fastMath = false; // Let f64 arithmetic be reassociated and contracted
+    bool autoParallel = false; // Fork one of two independent calls onto the worker pool
+    
+    // Stable spelling for cache keys
+    std::string key() const;
+};
+
+// `likely(cond)` / `unlikely(cond)` around an if or while condition. The
+// builtins return their argument; in a condition they also set the branch
+// weights. A user function with either name takes precedence.
+enum class BranchHint { None, Likely, Unlikely };
+
+enum class OptimizationStage { Standalone, PreLink, PostLink };
+
+// What a function's return statements say about its self recursion, found
+// by scanning the body before it is generated
+struct TailCallPlan {
+    bool selfTailCalls = false;   // Some `return f(...)` or accumulated form
+    bool accumulate = false;      // `return e op f(...)` with one op throughout
+    BinaryOp op = BinaryOp::Add;  // Add or Mul when accumulating
+    bool conflict = false;        // Accumulated returns disagree on op
+    
+    // Record a `return` of a self call, accumulated through `op` or not
+    void note(bool accumulated, BinaryOp returnOp);
+    // Whether such a return can become a jump to the loop header
+    bool accepts(bool accumulated, BinaryOp returnOp) const;
+};
+
+// Callees of each function, in call order with repeats
+using CallGraph = std::unordered_map<Symbol, std::vector<Symbol>>;
+void addCalls(FunctionDeclaration& function, CallGraph& calls);
+// Add every function in `calls` that reaches print() or println(), directly
+// or through other functions, to `printing`, which may already hold
+// functions defined elsewhere. A call to print or println is the builtin
+// unless `calls` defines a function of that name.
+void findPrintingFunctions(const CallGraph& calls, std::unordered_set<Symbol>& printing);
+
 class CodeGenerator : public ASTVisitor {
 private:
     std::unique_ptr<llvm::LLVMContext> context;
     std::unique_ptr<llvm::Module> module;
     std::unique_ptr<llvm::IRBuilder<>> builder;
     
+    // Host target; supplies the module's triple and data layout and the
+    // cost model used by the optimizer
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+    int optLevel;
+    CodeGenOptions options;
+    // Functions carry their native output names
+    bool nativeNames = false;
+    
     // Symbol table for variables
-    std::unordered_map<std::string, llvm::AllocaInst*> namedValues;
+    std::unordered_map<Symbol, llvm::AllocaInst*> namedValues;
+    
+    // SSA mode keeps variables in registers and builds phis on the fly
+    // (Braun et al., "Simple and Efficient Construction of SSA Form"):
+    // the reaching definition of each variable per block, the blocks whose
+    // predecessors are all known, and the operand-less phis waiting on them
+    std::unordered_map<Symbol, std::unordered_map<llvm::BasicBlock*, llvm::Value*>> currentDef;
+    std::unordered_map<Symbol, llvm::Type*> variableTypes;
+    std::unordered_set<llvm::BasicBlock*> sealedBlocks;
+    std::unordered_map<llvm::BasicBlock*, std::vector<std::pair<Symbol, llvm::PHINode*>>> incompletePhis;
+    // The currentDef entries each phi was written to, so removing a trivial
+    // phi updates only those
+    std::unordered_map<llvm::PHINode*, std::vector<std::pair<Symbol, llvm::BasicBlock*>>> phiDefinitions;
+    
+    // Arrays are bound to their first element and i64 length for the whole
+    // function, in both modes; an array variable cannot be reassigned
+    struct ArrayBinding {
+        llvm::Value* data;
+        llvm::Value* length;
+        llvm::Type* element;
+    };
+    std::unordered_map<Symbol, ArrayBinding> arrays;
+    // Stack bytes taken by the current function's arrays
+    uint64_t arrayBytes = 0;
+    // Variables of the enclosing for loops, which their bodies cannot assign
+    std::vector<Symbol> loopVariables;
+    // Copies of the enclosing variables inside an outlined parallel loop
+    // body, which it cannot assign either
+    std::vector<Symbol> sharedVariables;
     
     // Function symbol table
-    std::unordered_map<std::string, llvm::Function*> functions;
+    std::unordered_map<Symbol, llvm::Function*> functions;
+    // Declared parameter types, for the C header
+    std::unordered_map<Symbol, std::vector<ValueType>> signatures;
+    // Functions that can print, whose calls are never forked or memoized
+    std::unordered_set<Symbol> printing;
+    // void(i8* frame) wrappers that run a forked call, per callee
+    std::unordered_map<Symbol, llvm::Function*> forkThunks;
     
     // Current function being compiled
     llvm::Function* currentFunction;
@@ -43,30 +135,201 @@ private:
     // Value from last expression evaluation
     llvm::Value* lastValue;
     
+    // Self tail recursion in the function being generated becomes a jump
+    // back to `header` after reassigning the parameters; accumulated returns
+    // fold their other operand into the `accumulator` variable
+    struct TailRecursion {
+        Symbol function = 0;
+        llvm::BasicBlock* header = nullptr;
+        std::vector<Symbol> parameters;
+        std::vector<llvm::AllocaInst*> parameterSlots;  // Alloca mode only
+        TailCallPlan plan;
+        Symbol accumulator = 0;
+    } tailRecursion;
+    
     // Helper methods
-    llvm::AllocaInst* createEntryBlockAlloca(llvm::Function* function, const std::string& varName);
-    llvm::Type* getType(const std::string& typeName);
+    llvm::AllocaInst* createEntryBlockAlloca(llvm::Function* function, const std::string& varName,
+                                            llvm::Type* type);
+    llvm::Type* llvmType(ValueType type);
+    // An array parameter becomes a pointer and an i64 length
+    llvm::FunctionType* functionType(const std::vector<ValueType>& parameterTypes, ValueType returnType);
+    // Array pointers never alias each other and never escape
+    void addArrayAttributes(llvm::Function* function, const std::vector<ValueType>& parameterTypes);
+    void nameArguments(llvm::Function* function, const std::vector<Symbol>& parameters,
+                       const std::vector<ValueType>& parameterTypes);
+    // Widen i1 results to the i32 that variables, arguments and returns hold
+    llvm::Value* toInt32(llvm::Value* value);
+    // Implicit numeric conversion, as on assignment, argument passing and return
+    llvm::Value* convert(llvm::Value* value, llvm::Type* type);
+    // Target of an `i32(x)` / `i64(x)` / `f64(x)` cast, or null
+    llvm::Type* castType(Symbol callee, size_t arguments);
+    
+    // On-the-fly SSA construction
+    void writeVariable(Symbol name, llvm::BasicBlock* block, llvm::Value* value);
+    llvm::Value* readVariable(Symbol name, llvm::BasicBlock* block);
+    llvm::Value* readVariableRecursive(Symbol name, llvm::BasicBlock* block);
+    llvm::Value* addPhiOperands(Symbol name, llvm::PHINode* phi);
+    llvm::Value* tryRemoveTrivialPhi(llvm::PHINode* phi);
+    // Type a variable was declared with (i32 if not yet seen)
+    llvm::Type* variableType(Symbol name);
+    // Mark that every predecessor of `block` has been emitted
+    void sealBlock(llvm::BasicBlock* block);
+    
+    // Lowering shared by the tree visitor and the flat-AST walker. Child
+    // code is emitted through callbacks so both representations drive the
+    // same control-flow construction.
+    llvm::Value* emitBinary(BinaryOp op, llvm::Value* left, llvm::Value* right);
+    llvm::Value* emitUnary(UnaryOp op, llvm::Value* operand);
+    // An array evaluates to its data pointer, which only calls and len() accept
+    llvm::Value* emitLoad(Symbol name);
+    const ArrayBinding& arrayBinding(Symbol name);
+    // The array whose data pointer is `value`, or null
+    const Symbol* arrayNamed(llvm::Value* value);
+    llvm::Value* emitElementPointer(Symbol array, llvm::Value* index);
+    llvm::Value* emitArrayLoad(Symbol array, llvm::Value* index);
+    void emitArrayStore(Symbol array, llvm::Value* index, llvm::Value* value);
+    void emitArrayDeclaration(Symbol name, ValueType type, uint32_t length);
+    llvm::Value* emitCall(Symbol name, const std::vector<llvm::Value*>& args);
+    // print(x) / println(x) / println() through the runtime's output buffer
+    llvm::Value* emitPrint(bool newline, const std::vector<llvm::Value*>& args);
+    llvm::Value* emitCondition(llvm::Value* value, const char* name);
+    // && and || evaluate `right` only when `left` does not decide the result
+    llvm::Value* emitLogical(BinaryOp op, llvm::Value* left, const std::function<llvm::Value*()>& right);
+    BranchHint branchHint(Symbol callee, size_t arguments);
+    // The condition inside a likely()/unlikely() wrapper, or `condition` itself
+    Expression* stripBranchHint(Expression* condition, BranchHint& hint);
+    NodeIndex flatStripBranchHint(const FlatAST& ast, NodeIndex condition, BranchHint& hint);
+    void emitCondBr(llvm::Value* condition, llvm::BasicBlock* trueBlock, llvm::BasicBlock* falseBlock,
+                    BranchHint hint);
+    void emitVariableDeclaration(Symbol name, llvm::Value* initValue, ValueType declared);
+    void emitAssignment(Symbol name, llvm::Value* value);
+    void emitIf(const std::function<llvm::Value*()>& condition, BranchHint hint,
+                const std::function<void()>& thenBranch,
+                const std::function<void()>* elseBranch);
+    void emitWhile(const std::function<llvm::Value*()>& condition, BranchHint hint,
+                   const std::function<void()>& body);
+    void emitFor(Symbol variable, const std::function<llvm::Value*()>& start,
+                 const std::function<llvm::Value*()>& end, const std::function<void()>& body);
+    // Promote counted-loop bounds to one integer type, which is returned
+    llvm::Type* loopBounds(Symbol variable, llvm::Value*& start, llvm::Value*& end);
+    // The body is outlined into a function the runtime calls per chunk; the
+    // chunks' reduction results are combined here afterwards
+    void emitParallelFor(Symbol variable, const std::function<llvm::Value*()>& start,
+                         const std::function<llvm::Value*()>& end, const std::vector<Reduction>& reductions,
+                         const std::function<void()>& body);
+    llvm::Value* reductionIdentity(ReductionOp op, llvm::Type* type);
+    llvm::Value* emitReduction(ReductionOp op, llvm::Value* left, llvm::Value* right);
+    // --auto-parallel: a call whose result depends only on its arguments,
+    // so it may run on another thread while its sibling runs here. Calls
+    // passing arrays are excluded, since the callee may write to them, and
+    // so are calls that can print.
+    bool canFork(Symbol callee, size_t arguments);
+    llvm::Function* forkThunk(Symbol callee);
+    // Both calls of `left op right`, the right one forked when the runtime
+    // has an idle worker and the fork depth is below its cutoff
+    std::pair<llvm::Value*, llvm::Value*> emitForkedCalls(Symbol left, const std::vector<llvm::Value*>& leftArgs,
+                                                          Symbol right, const std::vector<llvm::Value*>& rightArgs);
+    // The rarer forms of visit(BinaryOperation&), out of line so that long
+    // chains of plain operators recurse through a small frame
+    LLVM_ATTRIBUTE_NOINLINE void visitLogical(BinaryOperation& node);
+    // False, emitting nothing, unless both operands are calls canFork allows
+    LLVM_ATTRIBUTE_NOINLINE bool visitForkedCalls(BinaryOperation& node);
+    // llvm.loop properties of a counted loop's latch
+    llvm::MDNode* countedLoopMetadata();
+    void emitFunction(Symbol name, const std::vector<Symbol>& parameters, const std::vector<ValueType>& parameterTypes,
+                      ValueType returnType, const TailCallPlan& plan, bool memoize,
+                      const std::function<void()>& body);
+    // @memo, or --memoize for a function that recurses more than once. Memo
+    // tables hold i32 keys and results only.
+    bool shouldMemoize(Symbol name, bool annotated, bool recursive,
+                       const std::vector<ValueType>& parameterTypes, ValueType returnType);
+    // Fill `wrapper` with a memo-table lookup that calls `body` on a miss
+    void emitMemoWrapper(llvm::Function* wrapper, llvm::Function* body);
+    void emitReturn(llvm::Value* value);
+    // `return operand op self(args)` (operand null for a plain self call)
+    void emitTailJump(const std::vector<llvm::Value*>& args, llvm::Value* operand);
+    bool emitTailRecursion(Expression* value);
+    bool flatTailRecursion(const FlatAST& ast, NodeIndex value);
+    
+    // Native output
+    void prepareNativeNames();
+    void emitNative(llvm::raw_pwrite_stream& dest, bool assembly);
+    void emitNativeFile(const std::string& filename, bool assembly);
+    
+    // Flat-AST code generation
+    llvm::Value* flatExpression(const FlatAST& ast, NodeIndex node);
+    // Subtrees a sweep must not evaluate eagerly, listed innermost first
+    // under their first index
+    using DeferredNodes = std::unordered_map<NodeIndex, std::vector<NodeIndex>>;
+    // The value of the subtree occupying [start, end]
+    llvm::Value* flatRange(const FlatAST& ast, NodeIndex start, NodeIndex end, const DeferredNodes& deferred);
+    void flatStatement(const FlatAST& ast, NodeIndex node);
     
 public:
     CodeGenerator();
     ~CodeGenerator() = default;
     
+    void setOptions(const CodeGenOptions& newOptions) { options = newOptions; }
+    const CodeGenOptions& getOptions() const { return options; }
+    
+    // Top-level functions are declared before any body is generated, so
+    // they may be called ahead of their definition
     void generate(Program& program);
+    void generate(const FlatAST& ast);
+    
+    // Declare `name` so calls can be generated before (or without) its
+    // definition in this module
+    void declareFunction(Symbol name, const std::vector<ValueType>& parameterTypes, ValueType returnType);
+    // An i32 function of `arity` i32 parameters
+    void declareFunction(Symbol name, size_t arity);
+    // Functions that can print, for builds that generate a program in
+    // pieces; generate() finds the ones in its own program itself
+    void declarePrinting(const std::unordered_set<Symbol>& names);
+    // Serialize the module as LLVM bitcode
+    std::string bitcode();
+    // Parse a bitcode module into this generator's context and link it in
+    void linkBitcode(const std::string& bitcode, const std::string& name);
     void dumpIR();
     void writeIRToFile(const std::string& filename);
+    // Emit host machine code through the TargetMachine. `main` is renamed
+    // to NATIVE_ENTRY and every other function gets NATIVE_PREFIX first.
+    void writeObjectFile(const std::string& filename);
+    void writeAssemblyFile(const std::string& filename);
+    // Machine code for the whole module as an in-memory object file
+    std::string objectCode();
+    // Write C declarations of every function defined in the module, under
+    // their native output names
+    void writeCHeader(const std::string& filename, const std::string& sourceName);
+    // Run `main` on an ORC lazy JIT: every function sits behind a
+    // compile-on-first-call stub, so code never reached is never compiled.
+    // Consumes the module.
     int executeJIT();
+    // Link an object from objectCode() into a fresh JIT and run its `main`
+    static int executeObject(const std::string& object, int optLevel);
+    // Triple, CPU and features that generated machine code depends on
+    static std::string hostTarget();
+    
+    // Run the new-PassManager pipeline for -O<level> (0-3) over the module.
+    // With timePasses set, a per-pass timing report goes to stderr. Modules
+    // that are linked together afterwards get the LTO pre-link pipeline
+    // first and the LTO pipeline once merged.
+    void optimize(int level, bool timePasses, OptimizationStage stage = OptimizationStage::Standalone);
     
     // Visitor methods
     void visit(NumberLiteral& node) override;
+    void visit(FloatLiteral& node) override;
     void visit(BooleanLiteral& node) override;
     void visit(Variable& node) override;
     void visit(BinaryOperation& node) override;
     void visit(UnaryOperation& node) override;
+    void visit(ArrayAccess& node) override;
     void visit(FunctionCall& node) override;
     void visit(VariableDeclaration& node) override;
     void visit(Assignment& node) override;
+    void visit(ArrayAssignment& node) override;
     void visit(IfStatement& node) override;
     void visit(WhileStatement& node) override;
+    void visit(ForStatement& node) override;
     void visit(Block& node) override;
     void visit(FunctionDeclaration& node) override;
     void visit(ReturnStatement& node) override;
@@ -0,0 +1,266 @@
+// Compilation.cpp - Implementation
+#include "Compilation.h"
+#include "FlatAST.h"
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <mutex>
+
+namespace {
+
+#if LLVM_VERSION_MAJOR >= 19
+using WorkerPool = llvm::DefaultThreadPool;
+#else
+using WorkerPool = llvm::ThreadPool;
+#endif
+
+// A shard's fixed cost is amortized over at least this many functions
+constexpr size_t MIN_SHARD_FUNCTIONS = 64;
+// More shards than threads balance uneven function sizes
+constexpr size_t SHARDS_PER_THREAD = 4;
+
+std::string canonicalPath(const std::string& path) {
+    llvm::SmallString<256> real;
+    if (llvm::sys::fs::real_path(path, real)) {
+        return path; // Missing files fail later, when they are read
+    }
+    return real.str().str();
+}
+
+} // namespace
+
+Compilation::Compilation(unsigned jobs, bool mapInput) : jobs(jobs), mapInput(mapInput) {}
+
+void Compilation::parallelFor(size_t count, unsigned jobs, const std::function<void(size_t)>& task) {
+    if (count == 1 || jobs == 1) {
+        for (size_t i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    std::mutex mutex;
+    std::exception_ptr error;
+    {
+        WorkerPool pool(llvm::hardware_concurrency(jobs));
+        for (size_t i = 0; i < count; i++) {
+            pool.async([&, i] {
+                try {
+                    task(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) error = std::current_exception();
+                }
+            });
+        }
+        pool.wait();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+SourceUnit* Compilation::addUnit(const std::string& path) {
+    std::string canonical = canonicalPath(path);
+    if (!unitIndex.emplace(canonical, units.size()).second) {
+        return nullptr;
+    }
+    units.push_back(std::make_unique<SourceUnit>());
+    units.back()->path = path;
+    return units.back().get();
+}
+
+std::string Compilation::resolveImport(const SourceUnit& importer, const std::string& path) const {
+    // Relative imports are resolved against the importing file's directory
+    llvm::SmallString<256> resolved;
+    if (llvm::sys::path::is_absolute(path)) {
+        resolved = path;
+    } else {
+        resolved = llvm::sys::path::parent_path(importer.path);
+        llvm::sys::path::append(resolved, path);
+    }
+    if (!llvm::sys::fs::exists(resolved)) {
+        throw ParseError(importer.path + ": Cannot find imported file \"" + path + "\"");
+    }
+    return resolved.str().str();
+}
+
+void Compilation::parseUnit(SourceUnit& unit) {
+    unit.source = mapInput ? SourceFile::map(unit.path) : SourceFile::read(unit.path);
+    unit.arena = std::make_unique<ASTArena>();
+    Lexer lexer(unit.source.text());
+    Parser parser(lexer, *unit.arena);
+    try {
+        unit.program = parser.parse();
+    } catch (const ParseError& e) {
+        throw ParseError(unit.path + ": " + e.what());
+    }
+    for (const std::string& path : parser.imports()) {
+        unit.imports.push_back(resolveImport(unit, path));
+    }
+}
+
+void Compilation::load(const std::vector<std::string>& roots) {
+    std::vector<SourceUnit*> wave;
+    for (const std::string& root : roots) {
+        if (SourceUnit* unit = addUnit(root)) {
+            wave.push_back(unit);
+        }
+    }
+
+    while (!wave.empty()) {
+        parallelFor(wave.size(), jobs, [&](size_t i) { parseUnit(*wave[i]); });
+
+        std::vector<SourceUnit*> next;
+        for (SourceUnit* unit : wave) {
+            for (const std::string& path : unit->imports) {
+                if (SourceUnit* imported = addUnit(path)) {
+                    next.push_back(imported);
+                }
+            }
+        }
+        wave = std::move(next);
+    }
+}
+
+std::string Compilation::fingerprint() const {
+    std::string material;
+    for (const auto& unit : units) {
+        std::string_view text = unit->source.text();
+        material += std::to_string(text.size()) + ":";
+        material.append(text.data(), text.size());
+    }
+    return material;
+}
+
+OptimizationStage Compilation::generate(CodeGenerator& linked, int optLevel, bool flat, bool printStats) {
+    // Errors name the file once there is more than one
+    auto inUnit = [&](size_t unit, const std::function<void()>& body) {
+        try {
+            body();
+        } catch (const CodeGenError& e) {
+            if (units.size() == 1) throw;
+            throw CodeGenError(units[unit]->path + ": " + e.what());
+        }
+    };
+
+    // Prototype pass over every file: each function is declared in every
+    // module, so calls may cross files and precede their definitions
+    struct Prototype {
+        std::vector<ValueType> parameterTypes;
+        ValueType returnType;
+        size_t unit;
+    };
+    std::unordered_map<Symbol, Prototype> prototypes;
+    std::vector<FunctionDeclaration*> functions;
+    std::vector<size_t> functionUnits;
+    bool topLevelCode = false;
+    for (size_t i = 0; i < units.size(); i++) {
+        for (Statement* statement : units[i]->program->statements) {
+            auto* function = dynamic_cast<FunctionDeclaration*>(statement);
+            if (!function) {
+                topLevelCode = true;
+                continue;
+            }
+            auto inserted = prototypes.emplace(function->name, Prototype{
+                std::vector<ValueType>(function->parameterTypes.begin(), function->parameterTypes.end()),
+                function->returnType, i});
+            if (!inserted.second && inserted.first->second.unit != i) {
+                throw CodeGenError("Function " + symbolName(function->name) + " is defined in both " +
+                                   units[inserted.first->second.unit]->path + " and " + units[i]->path);
+            }
+            if (!inserted.second) {
+                inUnit(i, [&] { throw CodeGenError("Redefinition of function: " + symbolName(function->name)); });
+            }
+            functions.push_back(function);
+            functionUnits.push_back(i);
+        }
+    }
+
+    // Which functions print depends on calls across files and shards
+    CallGraph calls;
+    for (FunctionDeclaration* function : functions) {
+        addCalls(*function, calls);
+    }
+    std::unordered_set<Symbol> printing;
+    findPrintingFunctions(calls, printing);
+    linked.declarePrinting(printing);
+
+    // Sharding pays for a context, a bitcode round trip and a link per
+    // shard, so small programs stay in one module
+    unsigned threads = llvm::hardware_concurrency(jobs).compute_thread_count();
+    size_t shards = std::min<size_t>(functions.size() / MIN_SHARD_FUNCTIONS, threads * SHARDS_PER_THREAD);
+    if (threads <= 1 || shards <= 1 || topLevelCode) {
+        for (const auto& entry : prototypes) {
+            linked.declareFunction(entry.first, entry.second.parameterTypes, entry.second.returnType);
+        }
+        if (!flat) {
+            for (size_t i = 0; i < units.size(); i++) {
+                inUnit(i, [&] { linked.generate(*units[i]->program); });
+            }
+            return OptimizationStage::Standalone;
+        }
+
+        // Flatten everything before releasing any arena: folded constants
+        // may live in another file's arena
+        std::vector<FlatAST> trees;
+        for (const auto& unit : units) {
+            trees.push_back(FlatAST::build(*unit->program));
+        }
+        for (const auto& unit : units) {
+            unit->arena->release();
+            unit->program = nullptr;
+        }
+        if (printStats) {
+            size_t nodes = 0;
+            size_t bytes = 0;
+            for (const FlatAST& tree : trees) {
+                nodes += tree.size();
+                bytes += tree.memoryUsage();
+            }
+            std::cout << "Flat AST: " << nodes << " nodes, " << bytes << " bytes\n";
+        }
+        for (size_t i = 0; i < units.size(); i++) {
+            inUnit(i, [&] { linked.generate(trees[i]); });
+        }
+        return OptimizationStage::Standalone;
+    }
+
+    // Contiguous runs of functions, so a shard mostly holds one file's code
+    std::vector<std::string> bitcode(shards);
+    parallelFor(shards, jobs, [&](size_t shard) {
+        CodeGenerator codeGen;
+        codeGen.setOptions(linked.getOptions());
+        for (const auto& entry : prototypes) {
+            codeGen.declareFunction(entry.first, entry.second.parameterTypes, entry.second.returnType);
+        }
+        codeGen.declarePrinting(printing);
+
+        ASTArena arena(4096);
+        size_t begin = functions.size() * shard / shards;
+        size_t end = functions.size() * (shard + 1) / shards;
+        for (size_t f = begin; f < end; f++) {
+            std::vector<Statement*> statements{functions[f]};
+            Program* program = arena.make<Program>(arena.copyList(statements));
+            inUnit(functionUnits[f], [&] {
+                if (flat) {
+                    codeGen.generate(FlatAST::build(*program));
+                } else {
+                    codeGen.generate(*program);
+                }
+            });
+        }
+        codeGen.optimize(optLevel, false, OptimizationStage::PreLink);
+        bitcode[shard] = codeGen.bitcode();
+    });
+
+    for (size_t shard = 0; shard < shards; shard++) {
+        linked.linkBitcode(bitcode[shard], "shard " + std::to_string(shard));
+    }
+    return OptimizationStage::PostLink;
+}
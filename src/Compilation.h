@@ -0,0 +1,58 @@
+// Compilation.h - Multi-file builds: imports and parallel per-file front ends
+#pragma once
+#include "CodeGen.h"
+#include "Parser.h"
+#include "SourceFile.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One input file and the tree parsed from it
+struct SourceUnit {
+    std::string path;                  // As given or as resolved from an import
+    SourceFile source;
+    std::unique_ptr<ASTArena> arena;
+    Program* program = nullptr;
+    std::vector<std::string> imports;  // Resolved paths, in source order
+};
+
+// The files of one program: the inputs named on the command line plus
+// everything they `import`, transitively. Files are parsed on a worker
+// pool; code generation is spread over the same pool by function.
+class Compilation {
+private:
+    unsigned jobs;
+    bool mapInput;
+    std::vector<std::unique_ptr<SourceUnit>> units;
+    std::unordered_map<std::string, size_t> unitIndex;  // Canonical path -> units[]
+
+    // Null when the file is already part of the compilation
+    SourceUnit* addUnit(const std::string& path);
+    std::string resolveImport(const SourceUnit& importer, const std::string& path) const;
+    void parseUnit(SourceUnit& unit);
+
+public:
+    // `jobs` worker threads (0 = one per hardware thread)
+    Compilation(unsigned jobs, bool mapInput);
+
+    // Parse `roots` and their imports, one wave of newly discovered files
+    // at a time
+    void load(const std::vector<std::string>& roots);
+    const std::vector<std::unique_ptr<SourceUnit>>& sources() const { return units; }
+    // Every file's contents, for cache keys
+    std::string fingerprint() const;
+
+    // Generate the whole program into `linked`, whose options apply
+    // throughout, flattening each tree first when `flat` is set. With
+    // several worker threads and enough functions, the functions are split
+    // into shards that are generated and pre-link optimized in parallel,
+    // each in its own context and module, then linked into `linked`.
+    // Returns the stage the caller's optimize() call should run.
+    OptimizationStage generate(CodeGenerator& linked, int optLevel, bool flat, bool printStats);
+
+    // Run task(0) .. task(count - 1) on up to `jobs` threads; the first
+    // exception thrown by a task is rethrown once all have finished
+    static void parallelFor(size_t count, unsigned jobs, const std::function<void(size_t)>& task);
+};
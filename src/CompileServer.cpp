@@ -0,0 +1,540 @@
+// CompileServer.cpp - Implementation
+#include "CompileServer.h"
+#include "CodeGen.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <thread>
+
+namespace {
+
+// A request is one message: its index, the working directory and the
+// arguments, each NUL-terminated, with the client's stdin, stdout and
+// stderr attached. The reply is "index status microseconds".
+constexpr size_t MAX_MESSAGE_SIZE = 1 << 16;
+constexpr size_t STREAM_COUNT = 3;
+// Each waiting request holds its client's descriptors; past this many the
+// server stops reading requests until workers free some up
+constexpr size_t MAX_QUEUED = 64;
+// Upper bound on a client's outstanding requests, whatever the worker count
+constexpr size_t MAX_IN_FLIGHT = 64;
+
+// Compiled once at startup to exercise the whole pipeline
+constexpr std::string_view WARM_UP_PROGRAM =
+    "function main() { var total = 0; for (i in 0 .. 10) { total = total + i; } return total; }";
+
+// Signal handlers only write to this pipe; the poll loop does the work
+int signalPipe[2] = {-1, -1};
+
+void onSignal(int signal) {
+    int saved = errno;
+    char event = signal == SIGCHLD ? 'c' : 'q';
+    [[maybe_unused]] ssize_t written = ::write(signalPipe[1], &event, 1);
+    errno = saved;
+}
+
+std::string systemError(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw CodeGenError("Socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+void closeAll(std::vector<int>& descriptors) {
+    for (int descriptor : descriptors) {
+        ::close(descriptor);
+    }
+    descriptors.clear();
+}
+
+bool sendMessage(int socket, const std::string& data, const std::vector<int>& descriptors) {
+    iovec part{const_cast<char*>(data.data()), data.size()};
+    msghdr message{};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * STREAM_COUNT)];
+    if (!descriptors.empty()) {
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * descriptors.size());
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * descriptors.size());
+        std::memcpy(CMSG_DATA(header), descriptors.data(), sizeof(int) * descriptors.size());
+    }
+    ssize_t sent;
+    do {
+        sent = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return sent == static_cast<ssize_t>(data.size());
+}
+
+// The message length, 0 once the peer has hung up or -1 on error. Passed
+// descriptors are stored in `descriptors`, and closed again on error.
+ssize_t receiveMessage(int socket, std::string& data, std::vector<int>& descriptors) {
+    data.resize(MAX_MESSAGE_SIZE);
+    iovec part{data.data(), data.size()};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * STREAM_COUNT)];
+    msghdr message{};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t length;
+    do {
+        length = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    } while (length < 0 && errno == EINTR);
+
+    descriptors.clear();
+    if (length > 0) {
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) continue;
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t first = descriptors.size();
+            descriptors.resize(first + count);
+            std::memcpy(descriptors.data() + first, CMSG_DATA(header), sizeof(int) * count);
+        }
+    }
+    if (length > 0 && (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        closeAll(descriptors);
+        return -1;
+    }
+    data.resize(length > 0 ? static_cast<size_t>(length) : 0);
+    return length;
+}
+
+void writeAll(int descriptor, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(descriptor, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+// Copy everything written to a memory file so far
+void copyOutput(int from, int to) {
+    char buffer[1 << 16];
+    ::lseek(from, 0, SEEK_SET);
+    ssize_t count;
+    while ((count = ::read(from, buffer, sizeof(buffer))) != 0) {
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        writeAll(to, buffer, static_cast<size_t>(count));
+    }
+}
+
+} // namespace
+
+CompileServer::CompileServer(const std::string& socketPath, unsigned workers)
+    : socketPath(socketPath), workers(workers ? workers : std::max(1u, std::thread::hardware_concurrency())) {
+    sockaddr_un address = socketAddress(socketPath);
+    listener = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        throw CodeGenError(systemError("Cannot create socket"));
+    }
+    auto fail = [&](const std::string& what) {
+        std::string error = systemError(what);
+        ::close(listener);
+        listener = -1;
+        throw CodeGenError(error);
+    };
+
+    // A socket file nobody answers on is left over from a server that died
+    int probe = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        bool live = ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        ::close(probe);
+        if (live) {
+            errno = EADDRINUSE;
+            fail("A compile server is already listening on " + socketPath);
+        }
+        if (errno == ECONNREFUSED) {
+            ::unlink(socketPath.c_str());
+        }
+    }
+
+    // Requests run arbitrary code, so only the owner may connect
+    mode_t mask = ::umask(0177);
+    int bound = ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    ::umask(mask);
+    if (bound < 0) {
+        fail("Cannot bind " + socketPath);
+    }
+    if (::listen(listener, SOMAXCONN) < 0) {
+        ::unlink(socketPath.c_str());
+        fail("Cannot listen on " + socketPath);
+    }
+}
+
+CompileServer::~CompileServer() {
+    for (int client : clients) {
+        ::close(client);
+    }
+    for (Request& request : queued) {
+        closeAll(request.streams);
+    }
+    if (listener >= 0) {
+        ::close(listener);
+        ::unlink(socketPath.c_str());
+    }
+}
+
+int CompileServer::serve(CompilerDriver driver) {
+    // Pay once for what every compile would set up first: target
+    // registration, host CPU and feature detection, the optimizer and the
+    // backend's lazily built tables. No thread is started, so forking
+    // stays safe.
+    {
+        ASTArena arena;
+        Lexer lexer(WARM_UP_PROGRAM);
+        Parser parser(lexer, arena);
+        CodeGenerator warm;
+        warm.generate(*parser.parse());
+        warm.optimize(2, false);
+        warm.objectCode();
+    }
+
+    if (::pipe2(signalPipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        throw CodeGenError(systemError("Cannot create signal pipe"));
+    }
+    struct sigaction action{};
+    action.sa_handler = onSignal;
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&action.sa_mask);
+    for (int signal : {SIGCHLD, SIGINT, SIGTERM}) {
+        ::sigaction(signal, &action, nullptr);
+    }
+    std::cerr << "Compile server listening on " << socketPath << " (" << workers << " workers)\n";
+
+    bool stopping = false;
+    while (!stopping) {
+        std::vector<pollfd> watched{{signalPipe[0], POLLIN, 0}, {listener, POLLIN, 0}};
+        short clientEvents = queued.size() < MAX_QUEUED ? POLLIN : 0;
+        for (int client : clients) {
+            watched.push_back({client, clientEvents, 0});
+        }
+        if (::poll(watched.data(), watched.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            throw CodeGenError(systemError("poll failed"));
+        }
+
+        if (watched[0].revents) {
+            char events[64];
+            ssize_t count;
+            while ((count = ::read(signalPipe[0], events, sizeof(events))) > 0) {
+                stopping = stopping || std::find(events, events + count, 'q') != events + count;
+            }
+            reap(false);
+        }
+        if (watched[1].revents & POLLIN) {
+            accept();
+        }
+        for (size_t i = 2; i < watched.size(); i++) {
+            short revents = watched[i].revents;
+            if ((revents & POLLIN) ? !receive(watched[i].fd) : (revents & (POLLHUP | POLLERR)) != 0) {
+                disconnect(watched[i].fd);
+            }
+        }
+        startQueued(driver);
+    }
+
+    // Requests already running finish and get their replies
+    for (Request& request : queued) {
+        closeAll(request.streams);
+    }
+    queued.clear();
+    while (!running.empty()) {
+        reap(true);
+    }
+    struct sigaction defaults{};
+    defaults.sa_handler = SIG_DFL;
+    for (int signal : {SIGCHLD, SIGINT, SIGTERM}) {
+        ::sigaction(signal, &defaults, nullptr);
+    }
+    ::close(signalPipe[0]);
+    ::close(signalPipe[1]);
+    std::cerr << "Compile server stopped after " << served << " request(s)\n";
+    return 0;
+}
+
+void CompileServer::accept() {
+    int client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client >= 0) {
+        // Lets the client size how many requests it keeps outstanding
+        sendMessage(client, "workers " + std::to_string(workers), {});
+        clients.push_back(client);
+    }
+}
+
+bool CompileServer::receive(int client) {
+    Request request;
+    std::string data;
+    if (receiveMessage(client, data, request.streams) <= 0) {
+        return false;
+    }
+
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (size_t end; (end = data.find('\0', start)) != std::string::npos; start = end + 1) {
+        fields.push_back(data.substr(start, end - start));
+    }
+    // A client that does not speak the protocol is dropped
+    if (fields.size() < 2 || request.streams.size() != STREAM_COUNT) {
+        closeAll(request.streams);
+        return false;
+    }
+    request.client = client;
+    request.index = fields[0];
+    request.directory = fields[1];
+    request.arguments.assign(fields.begin() + 2, fields.end());
+    request.received = std::chrono::steady_clock::now();
+    queued.push_back(std::move(request));
+    return true;
+}
+
+void CompileServer::disconnect(int client) {
+    ::close(client);
+    clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+    for (auto it = queued.begin(); it != queued.end();) {
+        if (it->client == client) {
+            closeAll(it->streams);
+            it = queued.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // Nobody is waiting for these any more
+    for (auto& [pid, request] : running) {
+        if (request.client == client) {
+            ::kill(pid, SIGTERM);
+            request.client = -1;
+        }
+    }
+}
+
+void CompileServer::startQueued(CompilerDriver driver) {
+    while (running.size() < workers && !queued.empty()) {
+        Request request = std::move(queued.front());
+        queued.pop_front();
+        // Anything still buffered would otherwise be written twice
+        std::cout.flush();
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            runChild(request, driver);
+        }
+        if (pid < 0) {
+            std::string error = systemError("Error: compile server cannot start a request") + "\n";
+            writeAll(request.streams[2], error.data(), error.size());
+            sendMessage(request.client, request.index + " 1 0", {});
+            closeAll(request.streams);
+            continue;
+        }
+        closeAll(request.streams);
+        running.emplace(pid, std::move(request));
+    }
+}
+
+void CompileServer::runChild(Request& request, CompilerDriver driver) {
+    // Keep nothing of the server but its warm LLVM state
+    struct sigaction defaults{};
+    defaults.sa_handler = SIG_DFL;
+    for (int signal : {SIGCHLD, SIGINT, SIGTERM}) {
+        ::sigaction(signal, &defaults, nullptr);
+    }
+    ::close(signalPipe[0]);
+    ::close(signalPipe[1]);
+    ::close(listener);
+    for (int client : clients) {
+        ::close(client);
+    }
+    for (Request& other : queued) {
+        closeAll(other.streams);
+    }
+    for (size_t i = 0; i < STREAM_COUNT; i++) {
+        ::dup2(request.streams[i], static_cast<int>(i));
+    }
+    closeAll(request.streams);
+
+    if (::chdir(request.directory.c_str()) < 0) {
+        std::cerr << systemError("Error: cannot enter " + request.directory) << "\n";
+        std::exit(1);
+    }
+    std::string program = "simplelang";
+    std::vector<char*> argv{program.data()};
+    for (std::string& argument : request.arguments) {
+        argv.push_back(argument.data());
+    }
+    argv.push_back(nullptr);
+    // exit() flushes the streams; the server's own objects are left alone
+    std::exit(driver(static_cast<int>(argv.size() - 1), argv.data()));
+}
+
+void CompileServer::reap(bool block) {
+    int status;
+    pid_t pid;
+    while ((pid = ::waitpid(-1, &status, block ? 0 : WNOHANG)) > 0) {
+        auto it = running.find(pid);
+        if (it == running.end()) continue;
+        Request& request = it->second;
+        // Killed by a signal reads as 128 + signal, as in the shell
+        int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - request.received).count();
+
+        std::ostringstream line;
+        line << "[" << ++served << "] " << std::fixed << std::setprecision(1) << micros / 1000.0 << " ms, exit "
+             << code << ":";
+        for (const std::string& argument : request.arguments) {
+            line << " " << argument;
+        }
+        std::cerr << line.str() << "\n";
+
+        if (request.client >= 0) {
+            sendMessage(request.client, request.index + " " + std::to_string(code) + " " + std::to_string(micros), {});
+        }
+        running.erase(it);
+    }
+}
+
+CompileClient::CompileClient(const std::string& socketPath) {
+    sockaddr_un address = socketAddress(socketPath);
+    socket = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (socket < 0) {
+        throw CodeGenError(systemError("Cannot create socket"));
+    }
+    if (::connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        std::string error = systemError("Cannot reach a compile server on " + socketPath);
+        ::close(socket);
+        socket = -1;
+        throw CodeGenError(error);
+    }
+    std::string hello;
+    std::vector<int> none;
+    std::istringstream in(receiveMessage(socket, hello, none) > 0 ? hello : "");
+    std::string word;
+    size_t workers = 0;
+    if (!(in >> word >> workers) || word != "workers" || workers == 0) {
+        ::close(socket);
+        socket = -1;
+        throw CodeGenError("Malformed greeting from the compile server");
+    }
+    window = std::min(2 * workers, MAX_IN_FLIGHT);
+}
+
+CompileClient::~CompileClient() {
+    if (socket >= 0) {
+        ::close(socket);
+    }
+}
+
+int CompileClient::run(const std::vector<std::vector<std::string>>& commandLines, bool captureOutput,
+                       bool printLatency) {
+    char directory[PATH_MAX];
+    if (!::getcwd(directory, sizeof(directory))) {
+        throw CodeGenError(systemError("Cannot read the working directory"));
+    }
+
+    // Captured stdout and stderr per request, created as the request is sent
+    std::vector<std::array<int, 2>> outputs(commandLines.size(), {-1, -1});
+    auto send = [&](size_t i) {
+        std::vector<int> streams{STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+        if (captureOutput) {
+            int out = ::memfd_create("simplelang-stdout", MFD_CLOEXEC);
+            int err = ::memfd_create("simplelang-stderr", MFD_CLOEXEC);
+            if (out < 0 || err < 0) {
+                throw CodeGenError(systemError("Cannot create an output buffer"));
+            }
+            outputs[i] = {out, err};
+            streams[1] = out;
+            streams[2] = err;
+        }
+        std::string message = std::to_string(i);
+        message += '\0';
+        message += directory;
+        message += '\0';
+        for (const std::string& argument : commandLines[i]) {
+            message += argument;
+            message += '\0';
+        }
+        if (message.size() > MAX_MESSAGE_SIZE) {
+            throw CodeGenError("Command line too long for the compile server");
+        }
+        if (!sendMessage(socket, message, streams)) {
+            throw CodeGenError(systemError("Cannot send a request to the compile server"));
+        }
+    };
+
+    std::vector<int> statuses(commandLines.size(), -1);
+    size_t finished = 0;
+    size_t printed = 0;
+    size_t sent = 0;
+    while (finished < commandLines.size()) {
+        // Only `window` requests are outstanding at once, and captured
+        // outputs count until printed, so descriptors stay bounded
+        while (sent < commandLines.size() && sent - (captureOutput ? printed : finished) < window) {
+            send(sent++);
+        }
+        std::string reply;
+        std::vector<int> none;
+        if (receiveMessage(socket, reply, none) <= 0) {
+            throw CodeGenError("The compile server closed the connection");
+        }
+        std::istringstream in(reply);
+        size_t index;
+        int status;
+        uint64_t micros;
+        if (!(in >> index >> status >> micros) || index >= statuses.size() || statuses[index] >= 0) {
+            throw CodeGenError("Malformed reply from the compile server");
+        }
+        statuses[index] = status;
+        finished++;
+        if (printLatency) {
+            std::cerr << "Server: request " << index + 1 << " took " << std::fixed << std::setprecision(1)
+                      << micros / 1000.0 << " ms (exit " << status << ")\n";
+        }
+        // Whole outputs, in request order
+        while (captureOutput && printed < statuses.size() && statuses[printed] >= 0) {
+            copyOutput(outputs[printed][0], STDOUT_FILENO);
+            copyOutput(outputs[printed][1], STDERR_FILENO);
+            ::close(outputs[printed][0]);
+            ::close(outputs[printed][1]);
+            printed++;
+        }
+    }
+    for (int status : statuses) {
+        if (status != 0) {
+            return status;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+// CompileServer.h - Persistent compile server and its thin client
+#pragma once
+#include <chrono>
+#include <deque>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+// The compiler driver: runs one command line and returns its exit status
+typedef int (*CompilerDriver)(int argc, char* argv[]);
+
+// Listens on a Unix domain socket with LLVM already initialized. A request
+// carries a command line, the client's working directory and its standard
+// streams. Each one runs the driver in a child forked from the warm server,
+// so it skips exec, LLVM's static setup, target initialization and host
+// detection, and a program that crashes or hangs only takes its own child
+// down. At most `workers` requests run at once; the rest wait in arrival
+// order. Every finished request is logged to stderr with its latency.
+class CompileServer {
+private:
+    struct Request {
+        int client;
+        std::string index;               // Echoed back in the reply
+        std::string directory;
+        std::vector<std::string> arguments;
+        std::vector<int> streams;        // Client's stdin, stdout, stderr
+        std::chrono::steady_clock::time_point received;
+    };
+
+    std::string socketPath;
+    unsigned workers;
+    int listener = -1;
+    std::vector<int> clients;
+    std::deque<Request> queued;
+    std::unordered_map<pid_t, Request> running;
+    uint64_t served = 0;
+
+    void accept();
+    // Read one request; false once the client has gone
+    bool receive(int client);
+    void disconnect(int client);
+    void startQueued(CompilerDriver driver);
+    [[noreturn]] void runChild(Request& request, CompilerDriver driver);
+    // Reply to and log every child that has exited
+    void reap(bool block);
+
+public:
+    CompileServer(const std::string& socketPath, unsigned workers);
+    CompileServer(const CompileServer&) = delete;
+    CompileServer& operator=(const CompileServer&) = delete;
+    ~CompileServer();
+
+    // Serve until SIGINT or SIGTERM, then let running requests finish
+    int serve(CompilerDriver driver);
+};
+
+// Forwards command lines to a CompileServer, keeping about two per server
+// worker outstanding. Without `captureOutput` they write straight to this
+// process's streams, with it each request's output is held in memory files
+// and printed whole, in request order. Returns 0 if every request
+// succeeded, else the status of the first that failed.
+class CompileClient {
+private:
+    int socket = -1;
+    size_t window = 1;              // Most requests outstanding at once
+
+public:
+    explicit CompileClient(const std::string& socketPath);
+    CompileClient(const CompileClient&) = delete;
+    CompileClient& operator=(const CompileClient&) = delete;
+    ~CompileClient();
+
+    // With `printLatency`, the server-side time of each request goes to stderr
+    int run(const std::vector<std::vector<std::string>>& commandLines, bool captureOutput, bool printLatency);
+};
@@ -0,0 +1,471 @@
+// ConstEval.cpp - Implementation
+#include "ConstEval.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// Interpreter frames nest on the C++ stack
+constexpr size_t MAX_CALL_DEPTH = 1000;
+// Calls abandoned after this many steps in total stop further attempts
+constexpr uint64_t TOTAL_BUDGET_FACTOR = 16;
+
+int32_t wrap(uint32_t value) {
+    return static_cast<int32_t>(value);
+}
+
+// Tree-walking interpreter with i32 wrap-around semantics matching the
+// generated code. Any construct it cannot evaluate exactly (unknown
+// variables or functions, division by zero, the step or depth limit) sets
+// `failed` and unwinds. Only i32 code is evaluated; anything typed i64 or
+// f64, and any array, is left to the generated code.
+class Interpreter : public ASTVisitor {
+public:
+    const std::unordered_map<Symbol, FunctionDeclaration*>& functions;
+    uint64_t stepsLeft;
+    size_t depth = 0;
+    std::unordered_map<Symbol, int32_t>* variables = nullptr;
+    std::vector<Symbol> loopVariables;  // Of the for loops being run in this frame
+    int32_t value = 0;
+    bool failed = false;
+    bool returning = false;
+
+    Interpreter(const std::unordered_map<Symbol, FunctionDeclaration*>& table, uint64_t budget)
+        : functions(table), stepsLeft(budget) {}
+
+    bool step() {
+        if (failed) return false;
+        if (stepsLeft == 0) {
+            failed = true;
+            return false;
+        }
+        stepsLeft--;
+        return true;
+    }
+
+    int32_t evaluate(Expression* expression) {
+        expression->accept(*this);
+        return value;
+    }
+
+    void call(FunctionDeclaration& function, const std::vector<int32_t>& args) {
+        if (depth >= MAX_CALL_DEPTH || args.size() != function.parameters.size() ||
+            function.returnType != ValueType::I32) {
+            failed = true;
+            return;
+        }
+        for (ValueType type : function.parameterTypes) {
+            if (type != ValueType::I32) {
+                failed = true;
+                return;
+            }
+        }
+        std::unordered_map<Symbol, int32_t> locals;
+        for (size_t i = 0; i < args.size(); i++) {
+            locals[function.parameters[i]] = args[i];
+        }
+
+        std::unordered_map<Symbol, int32_t>* outer = variables;
+        std::vector<Symbol> outerLoops = std::move(loopVariables);
+        loopVariables.clear();
+        variables = &locals;
+        depth++;
+        value = 0;
+        function.body->accept(*this);
+        if (!returning) {
+            value = 0; // Falling off the end returns 0
+        }
+        returning = false;
+        depth--;
+        variables = outer;
+        loopVariables = std::move(outerLoops);
+    }
+
+    void visit(NumberLiteral& node) override {
+        if (!step()) return;
+        if (node.type != ValueType::I32) {
+            failed = true;
+            return;
+        }
+        value = static_cast<int32_t>(node.value);
+    }
+
+    void visit(FloatLiteral&) override {
+        failed = true;
+    }
+
+    void visit(BooleanLiteral& node) override {
+        if (step()) value = node.value ? 1 : 0;
+    }
+
+    void visit(Variable& node) override {
+        if (!step()) return;
+        if (!variables) {
+            failed = true;
+            return;
+        }
+        auto it = variables->find(node.name);
+        if (it == variables->end()) {
+            failed = true;
+            return;
+        }
+        value = it->second;
+    }
+
+    void visit(BinaryOperation& node) override {
+        if (!step()) return;
+        uint32_t left = static_cast<uint32_t>(evaluate(node.left));
+        if (failed) return;
+        // Like the generated code, && and || skip a right operand the left
+        // one decides, which may divide by zero or not terminate
+        if ((node.op == BinaryOp::And && left == 0) || (node.op == BinaryOp::Or && left != 0)) {
+            value = node.op == BinaryOp::Or;
+            return;
+        }
+        uint32_t right = static_cast<uint32_t>(evaluate(node.right));
+        if (failed) return;
+        int32_t l = wrap(left);
+        int32_t r = wrap(right);
+
+        switch (node.op) {
+            case BinaryOp::Add: value = wrap(left + right); break;
+            case BinaryOp::Sub: value = wrap(left - right); break;
+            case BinaryOp::Mul: value = wrap(left * right); break;
+            case BinaryOp::Div:
+                // Both trap (or are undefined) at run time; leave them there
+                if (r == 0 || (l == std::numeric_limits<int32_t>::min() && r == -1)) {
+                    failed = true;
+                    return;
+                }
+                value = l / r;
+                break;
+            case BinaryOp::Less: value = l < r; break;
+            case BinaryOp::LessEqual: value = l <= r; break;
+            case BinaryOp::Greater: value = l > r; break;
+            case BinaryOp::GreaterEqual: value = l >= r; break;
+            case BinaryOp::Equal: value = l == r; break;
+            case BinaryOp::NotEqual: value = l != r; break;
+            case BinaryOp::And: value = r != 0; break;
+            case BinaryOp::Or: value = r != 0; break;
+        }
+    }
+
+    void visit(UnaryOperation& node) override {
+        if (!step()) return;
+        uint32_t operand = static_cast<uint32_t>(evaluate(node.operand));
+        if (failed) return;
+        switch (node.op) {
+            case UnaryOp::Negate: value = wrap(0u - operand); break;
+            case UnaryOp::Not: value = operand == 0; break;
+        }
+    }
+
+    bool isLoopVariable(Symbol name) const {
+        return std::find(loopVariables.begin(), loopVariables.end(), name) != loopVariables.end();
+    }
+
+    void visit(ArrayAccess&) override {
+        failed = true;
+    }
+
+    void visit(FunctionCall& node) override {
+        if (!step()) return;
+        auto it = functions.find(node.name);
+        if (it == functions.end()) {
+            // likely()/unlikely() only carry a branch hint
+            static const Symbol likely = SymbolTable::global().intern("likely");
+            static const Symbol unlikely = SymbolTable::global().intern("unlikely");
+            if ((node.name == likely || node.name == unlikely) && node.arguments.size() == 1) {
+                evaluate(node.arguments[0]);
+                return;
+            }
+            failed = true;
+            return;
+        }
+        std::vector<int32_t> args;
+        args.reserve(node.arguments.size());
+        for (Expression* arg : node.arguments) {
+            args.push_back(evaluate(arg));
+            if (failed) return;
+        }
+        call(*it->second, args);
+    }
+
+    void visit(VariableDeclaration& node) override {
+        if (!step()) return;
+        if ((node.type != ValueType::Inferred && node.type != ValueType::I32) || isLoopVariable(node.name)) {
+            failed = true;
+            return;
+        }
+        int32_t initial = node.initializer ? evaluate(node.initializer) : 0;
+        if (!failed) (*variables)[node.name] = initial;
+    }
+
+    void visit(Assignment& node) override {
+        if (!step()) return;
+        auto it = variables->find(node.name);
+        if (it == variables->end() || isLoopVariable(node.name)) {
+            failed = true;
+            return;
+        }
+        int32_t assigned = evaluate(node.value);
+        if (!failed) it->second = assigned;
+    }
+
+    void visit(ArrayAssignment&) override {
+        failed = true;
+    }
+
+    void visit(IfStatement& node) override {
+        if (!step()) return;
+        int32_t condition = evaluate(node.condition);
+        if (failed) return;
+        if (condition != 0) {
+            node.thenBranch->accept(*this);
+        } else if (node.elseBranch) {
+            node.elseBranch->accept(*this);
+        }
+    }
+
+    void visit(WhileStatement& node) override {
+        while (step() && !returning) {
+            int32_t condition = evaluate(node.condition);
+            if (failed || condition == 0) return;
+            node.body->accept(*this);
+        }
+    }
+
+    void visit(ForStatement& node) override {
+        // Code generation checks what a parallel body may assign, so a
+        // parallel loop is left to it
+        if (node.parallel) {
+            failed = true;
+            return;
+        }
+        if (!step()) return;
+        int32_t start = evaluate(node.start);
+        if (failed) return;
+        int32_t end = evaluate(node.end);
+        if (failed || isLoopVariable(node.variable)) {
+            failed = true;
+            return;
+        }
+        // i < end, so the increment cannot wrap
+        (*variables)[node.variable] = start;
+        loopVariables.push_back(node.variable);
+        for (int32_t i = start; i < end && step() && !returning; i++) {
+            (*variables)[node.variable] = i;
+            node.body->accept(*this);
+            if (failed) return;
+            (*variables)[node.variable] = i + 1;
+        }
+        loopVariables.pop_back();
+    }
+
+    void visit(Block& node) override {
+        for (Statement* statement : node.statements) {
+            if (failed || returning) return;
+            statement->accept(*this);
+        }
+    }
+
+    void visit(FunctionDeclaration&) override {
+        failed = true; // Only top-level declarations are supported
+    }
+
+    void visit(ReturnStatement& node) override {
+        if (!step()) return;
+        value = node.value ? evaluate(node.value) : 0;
+        returning = !failed;
+    }
+
+    void visit(ExpressionStatement& node) override {
+        if (step()) evaluate(node.expression);
+    }
+
+    void visit(Program&) override {
+        failed = true;
+    }
+};
+
+} // namespace
+
+ConstEvaluator::ConstEvaluator(ASTArena& arena, uint64_t stepBudget)
+    : arena(arena), stepBudget(stepBudget), totalStepsLeft(stepBudget * TOTAL_BUDGET_FACTOR),
+      topLevelCode(false), folded(nullptr) {}
+
+void ConstEvaluator::addProgram(Program& program) {
+    for (Statement* statement : program.statements) {
+        if (auto* function = dynamic_cast<FunctionDeclaration*>(statement)) {
+            functions[function->name] = function;
+        } else {
+            topLevelCode = true;
+        }
+    }
+}
+
+bool ConstEvaluator::isLiteral(Expression* expression) const {
+    auto* number = dynamic_cast<NumberLiteral*>(expression);
+    return (number && number->type == ValueType::I32) || dynamic_cast<BooleanLiteral*>(expression);
+}
+
+bool ConstEvaluator::evaluate(Expression* expression, uint64_t budget, int32_t& value) {
+    Interpreter interpreter(functions, budget);
+    value = interpreter.evaluate(expression);
+    return !interpreter.failed;
+}
+
+Expression* ConstEvaluator::fold(Expression* expression) {
+    expression->accept(*this);
+    return folded;
+}
+
+void ConstEvaluator::fold(Program& program) {
+    program.accept(*this);
+}
+
+std::optional<int32_t> ConstEvaluator::evaluateMain() {
+    // Top-level statements outside functions are left to the code generator
+    if (topLevelCode) {
+        return std::nullopt;
+    }
+    auto it = functions.find(SymbolTable::global().intern("main"));
+    if (it == functions.end() || !it->second->parameters.empty()) {
+        return std::nullopt;
+    }
+
+    Interpreter interpreter(functions, stepBudget);
+    interpreter.call(*it->second, {});
+    if (interpreter.failed) {
+        return std::nullopt;
+    }
+    return interpreter.value;
+}
+
+void ConstEvaluator::visit(NumberLiteral& node) {
+    folded = &node;
+}
+
+void ConstEvaluator::visit(FloatLiteral& node) {
+    folded = &node;
+}
+
+void ConstEvaluator::visit(BooleanLiteral& node) {
+    folded = &node;
+}
+
+void ConstEvaluator::visit(Variable& node) {
+    folded = &node;
+}
+
+void ConstEvaluator::visit(BinaryOperation& node) {
+    node.left = fold(node.left);
+    node.right = fold(node.right);
+    folded = &node;
+
+    int32_t value;
+    if (isLiteral(node.left) && isLiteral(node.right) && evaluate(&node, 3, value)) {
+        folded = arena.make<NumberLiteral>(value);
+        counters.foldedExpressions++;
+    }
+}
+
+void ConstEvaluator::visit(UnaryOperation& node) {
+    node.operand = fold(node.operand);
+    folded = &node;
+
+    int32_t value;
+    if (isLiteral(node.operand) && evaluate(&node, 2, value)) {
+        folded = arena.make<NumberLiteral>(value);
+        counters.foldedExpressions++;
+    }
+}
+
+void ConstEvaluator::visit(ArrayAccess& node) {
+    node.index = fold(node.index);
+    folded = &node;
+}
+
+void ConstEvaluator::visit(FunctionCall& node) {
+    bool constantArguments = true;
+    for (Expression*& arg : node.arguments) {
+        arg = fold(arg);
+        constantArguments = constantArguments && isLiteral(arg);
+    }
+    folded = &node;
+    if (!constantArguments || totalStepsLeft == 0 || !functions.count(node.name)) {
+        return;
+    }
+
+    Interpreter interpreter(functions, std::min(stepBudget, totalStepsLeft));
+    int32_t value = interpreter.evaluate(&node);
+    totalStepsLeft -= std::min(stepBudget, totalStepsLeft) - interpreter.stepsLeft;
+    if (interpreter.failed) {
+        counters.abandonedCalls++;
+        return;
+    }
+    folded = arena.make<NumberLiteral>(value);
+    counters.foldedCalls++;
+}
+
+void ConstEvaluator::visit(VariableDeclaration& node) {
+    if (node.initializer) {
+        node.initializer = fold(node.initializer);
+    }
+}
+
+void ConstEvaluator::visit(Assignment& node) {
+    node.value = fold(node.value);
+}
+
+void ConstEvaluator::visit(ArrayAssignment& node) {
+    node.index = fold(node.index);
+    node.value = fold(node.value);
+}
+
+void ConstEvaluator::visit(IfStatement& node) {
+    node.condition = fold(node.condition);
+    node.thenBranch->accept(*this);
+    if (node.elseBranch) {
+        node.elseBranch->accept(*this);
+    }
+}
+
+void ConstEvaluator::visit(WhileStatement& node) {
+    node.condition = fold(node.condition);
+    node.body->accept(*this);
+}
+
+void ConstEvaluator::visit(ForStatement& node) {
+    node.start = fold(node.start);
+    node.end = fold(node.end);
+    node.body->accept(*this);
+}
+
+void ConstEvaluator::visit(Block& node) {
+    for (Statement* statement : node.statements) {
+        statement->accept(*this);
+    }
+}
+
+void ConstEvaluator::visit(FunctionDeclaration& node) {
+    node.body->accept(*this);
+}
+
+void ConstEvaluator::visit(ReturnStatement& node) {
+    if (node.value) {
+        node.value = fold(node.value);
+    }
+}
+
+void ConstEvaluator::visit(ExpressionStatement& node) {
+    node.expression = fold(node.expression);
+}
+
+void ConstEvaluator::visit(Program& node) {
+    for (Statement* statement : node.statements) {
+        statement->accept(*this);
+    }
+}
@@ -0,0 +1,70 @@
+// ConstEval.h - Compile-time evaluation of constant expressions and calls
+#pragma once
+#include "AST.h"
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+struct ConstEvalStats {
+    size_t foldedExpressions = 0;  // Operators on literals replaced by their value
+    size_t foldedCalls = 0;        // Calls on literals replaced by their result
+    size_t abandonedCalls = 0;     // Calls that ran out of budget or hit a runtime error
+};
+
+// Rewrites a parsed Program in place before code generation. Operators
+// whose operands are literals are folded, and calls whose arguments are
+// literals are interpreted (a function can only write arrays passed to it,
+// and literal arguments are never arrays) and replaced
+// with a NumberLiteral. Each call gets at most `stepBudget` interpreter
+// steps; calls that exceed it, recurse too deeply, or would divide by zero
+// are left for run time.
+class ConstEvaluator : public ASTVisitor {
+private:
+    ASTArena& arena;
+    uint64_t stepBudget;
+    uint64_t totalStepsLeft;
+    std::unordered_map<Symbol, FunctionDeclaration*> functions;
+    bool topLevelCode;  // Some added program has statements outside functions
+    ConstEvalStats counters;
+
+    // Replacement for the expression just visited
+    Expression* folded;
+
+    Expression* fold(Expression* expression);
+    bool isLiteral(Expression* expression) const;
+    // Interpret `expression` with no variables in scope
+    bool evaluate(Expression* expression, uint64_t budget, int32_t& value);
+
+public:
+    ConstEvaluator(ASTArena& arena, uint64_t stepBudget);
+
+    // Make the functions of `program` callable from folded code. Every
+    // program of a multi-file build is added before any is folded.
+    void addProgram(Program& program);
+    // Fold `program`, which must have been added
+    void fold(Program& program);
+    // The value `main()` returns, if it can be computed within the budget
+    std::optional<int32_t> evaluateMain();
+    const ConstEvalStats& stats() const { return counters; }
+
+    // Visitor methods
+    void visit(NumberLiteral& node) override;
+    void visit(FloatLiteral& node) override;
+    void visit(BooleanLiteral& node) override;
+    void visit(Variable& node) override;
+    void visit(BinaryOperation& node) override;
+    void visit(UnaryOperation& node) override;
+    void visit(ArrayAccess& node) override;
+    void visit(FunctionCall& node) override;
+    void visit(VariableDeclaration& node) override;
+    void visit(Assignment& node) override;
+    void visit(ArrayAssignment& node) override;
+    void visit(IfStatement& node) override;
+    void visit(WhileStatement& node) override;
+    void visit(ForStatement& node) override;
+    void visit(Block& node) override;
+    void visit(FunctionDeclaration& node) override;
+    void visit(ReturnStatement& node) override;
+    void visit(ExpressionStatement& node) override;
+    void visit(Program& node) override;
+};
@@ -0,0 +1,262 @@
+// FlatAST.cpp - Implementation
+#include "FlatAST.h"
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+// Appends nodes in post-order without recursing: every node is visited
+// twice off an explicit stack, so nesting depth costs heap, not native
+// stack. The first visit (`descending`) names the node's children; the
+// second, once their indices are on `results`, adds the node itself and
+// sets `last`.
+class FlatASTBuilder : public ASTVisitor {
+public:
+    FlatAST& ast;
+    NodeIndex last = NO_NODE;
+
+    explicit FlatASTBuilder(FlatAST& target) : ast(target) {}
+
+    NodeIndex build(ASTNode* root) {
+        frames.push_back({root, UNVISITED});
+        while (!frames.empty()) {
+            Frame frame = frames.back();
+            if (!frame.node) {
+                results.push_back(NO_NODE);
+                frames.pop_back();
+            } else if (frame.base == UNVISITED) {
+                frames.back().base = results.size();
+                descending = true;
+                pending.clear();
+                frame.node->accept(*this);
+                // Reversed, so the first child is built first
+                for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+                    frames.push_back({*it, UNVISITED});
+                }
+            } else {
+                base = frame.base;
+                descending = false;
+                frame.node->accept(*this);
+                results.resize(base);
+                results.push_back(last);
+                frames.pop_back();
+            }
+        }
+        results.clear();
+        return last;
+    }
+
+    void visit(NumberLiteral& node) override {
+        if (descending) return;
+        int32_t value = node.type == ValueType::I32 ? static_cast<int32_t>(node.value) : ast.addConstant(node.value);
+        last = ast.add(NodeKind::Number, static_cast<uint8_t>(node.type), value);
+    }
+
+    void visit(FloatLiteral& node) override {
+        if (descending) return;
+        int64_t bits;
+        std::memcpy(&bits, &node.value, sizeof(bits));
+        last = ast.add(NodeKind::Float, 0, ast.addConstant(bits));
+    }
+
+    void visit(BooleanLiteral& node) override {
+        if (descending) return;
+        last = ast.add(NodeKind::Boolean, 0, node.value ? 1 : 0);
+    }
+
+    void visit(Variable& node) override {
+        if (descending) return;
+        last = ast.add(NodeKind::Variable, 0, static_cast<int32_t>(node.name));
+    }
+
+    void visit(BinaryOperation& node) override {
+        if (descending) return children({node.left, node.right});
+        last = ast.add(NodeKind::Binary, static_cast<uint8_t>(node.op), 0, child(0), child(1));
+    }
+
+    void visit(UnaryOperation& node) override {
+        if (descending) return children({node.operand});
+        last = ast.add(NodeKind::Unary, static_cast<uint8_t>(node.op), 0, child(0));
+    }
+
+    void visit(ArrayAccess& node) override {
+        if (descending) return children({node.index});
+        last = ast.add(NodeKind::ArrayAccess, 0, static_cast<int32_t>(node.array), child(0));
+    }
+
+    void visit(FunctionCall& node) override {
+        if (descending) return children(node.arguments);
+        last = ast.add(NodeKind::Call, 0, static_cast<int32_t>(node.name),
+                       childList(), static_cast<NodeIndex>(node.arguments.size()));
+    }
+
+    void visit(VariableDeclaration& node) override {
+        if (descending) return children({node.initializer});
+        last = ast.add(NodeKind::VariableDeclaration, static_cast<uint8_t>(node.type),
+                       static_cast<int32_t>(node.name), child(0), node.length);
+    }
+
+    void visit(Assignment& node) override {
+        if (descending) return children({node.value});
+        last = ast.add(NodeKind::Assignment, 0, static_cast<int32_t>(node.name), child(0));
+    }
+
+    void visit(ArrayAssignment& node) override {
+        if (descending) return children({node.index, node.value});
+        last = ast.add(NodeKind::ArrayAssignment, 0, static_cast<int32_t>(node.array), child(0), child(1));
+    }
+
+    void visit(IfStatement& node) override {
+        if (descending) return children({node.condition, node.thenBranch, node.elseBranch});
+        last = ast.add(NodeKind::If, 0, 0, child(0), child(1), child(2));
+    }
+
+    void visit(WhileStatement& node) override {
+        if (descending) return children({node.condition, node.body});
+        last = ast.add(NodeKind::While, 0, 0, child(0), child(1));
+    }
+
+    void visit(ForStatement& node) override {
+        if (descending) return children({node.start, node.end, node.body});
+        if (!node.parallel) {
+            last = ast.add(NodeKind::For, 0, static_cast<int32_t>(node.variable), child(0), child(1), child(2));
+            return;
+        }
+        std::vector<NodeIndex> items{child(0), child(1)};
+        for (const Reduction& reduction : node.reductions) {
+            items.push_back(static_cast<NodeIndex>(reduction.variable));
+            items.push_back(static_cast<NodeIndex>(reduction.op));
+        }
+        last = ast.add(NodeKind::ParallelFor, 0, static_cast<int32_t>(node.variable), ast.addList(items),
+                       static_cast<NodeIndex>(items.size()), child(2));
+    }
+
+    void visit(Block& node) override {
+        if (descending) return children(node.statements);
+        last = ast.add(NodeKind::Block, 0, 0, childList(), static_cast<NodeIndex>(node.statements.size()));
+    }
+
+    void visit(FunctionDeclaration& node) override {
+        if (descending) return children({node.body});
+        std::vector<NodeIndex> params(node.parameters.begin(), node.parameters.end());
+        for (ValueType type : node.parameterTypes) {
+            params.push_back(static_cast<NodeIndex>(type));
+        }
+        params.push_back(static_cast<NodeIndex>(node.returnType));
+        NodeIndex start = ast.addList(params);
+        last = ast.add(NodeKind::Function, node.memoize ? 1 : 0, static_cast<int32_t>(node.name),
+                       start, static_cast<NodeIndex>(node.parameters.size()), child(0));
+    }
+
+    void visit(ReturnStatement& node) override {
+        if (descending) return children({node.value});
+        last = ast.add(NodeKind::Return, 0, 0, child(0));
+    }
+
+    void visit(ExpressionStatement& node) override {
+        if (descending) return children({node.expression});
+        last = ast.add(NodeKind::ExpressionStatement, 0, 0, child(0));
+    }
+
+    void visit(Program& node) override {
+        if (descending) return children(node.statements);
+        last = ast.add(NodeKind::Program, 0, 0, childList(), static_cast<NodeIndex>(node.statements.size()));
+    }
+
+private:
+    static constexpr size_t UNVISITED = SIZE_MAX;
+
+    struct Frame {
+        ASTNode* node;
+        size_t base;  // Where its children's results start, once descended
+    };
+
+    std::vector<Frame> frames;
+    std::vector<NodeIndex> results;
+    std::vector<ASTNode*> pending;  // Children named by the current visit
+    size_t base = 0;
+    bool descending = false;
+
+    void children(std::initializer_list<ASTNode*> nodes) {
+        pending.assign(nodes.begin(), nodes.end());
+    }
+
+    template <typename T>
+    void children(const NodeList<T*>& nodes) {
+        pending.assign(nodes.begin(), nodes.end());
+    }
+
+    NodeIndex child(size_t i) const { return results[base + i]; }
+
+    // Every child, stored as one list
+    NodeIndex childList() {
+        return ast.addList(std::vector<NodeIndex>(results.begin() + base, results.end()));
+    }
+};
+
+} // namespace
+
+FlatAST FlatAST::build(Program& program) {
+    FlatAST ast;
+    FlatASTBuilder builder(ast);
+    ast.root = builder.build(&program);
+    return ast;
+}
+
+NodeIndex FlatAST::add(NodeKind kind, uint8_t op, int32_t value,
+                       NodeIndex first, NodeIndex second, NodeIndex third) {
+    NodeIndex index = static_cast<NodeIndex>(kinds.size());
+    kinds.push_back(kind);
+    ops.push_back(op);
+    values.push_back(value);
+    a.push_back(first);
+    b.push_back(second);
+    c.push_back(third);
+    return index;
+}
+
+NodeIndex FlatAST::addList(const std::vector<NodeIndex>& items) {
+    NodeIndex start = static_cast<NodeIndex>(lists.size());
+    lists.insert(lists.end(), items.begin(), items.end());
+    return start;
+}
+
+int32_t FlatAST::addConstant(int64_t value) {
+    constants.push_back(value);
+    return static_cast<int32_t>(constants.size() - 1);
+}
+
+int64_t FlatAST::integer(NodeIndex node) const {
+    return valueType(node) == ValueType::I32 ? values[node] : constants[values[node]];
+}
+
+double FlatAST::real(NodeIndex node) const {
+    double value;
+    std::memcpy(&value, &constants[values[node]], sizeof(value));
+    return value;
+}
+
+NodeIndex FlatAST::expressionStart(NodeIndex node) const {
+    while (true) {
+        switch (kinds[node]) {
+            case NodeKind::Binary:
+            case NodeKind::Unary:
+            case NodeKind::ArrayAccess:
+                node = a[node];
+                break;
+            case NodeKind::Call:
+                if (b[node] == 0) return node;
+                node = listItem(node, 0);
+                break;
+            default:
+                return node;
+        }
+    }
+}
+
+size_t FlatAST::memoryUsage() const {
+    return kinds.capacity() * sizeof(NodeKind) + ops.capacity() * sizeof(uint8_t) +
+           values.capacity() * sizeof(int32_t) +
+           (a.capacity() + b.capacity() + c.capacity() + lists.capacity()) * sizeof(NodeIndex) +
+           constants.capacity() * sizeof(int64_t);
+}
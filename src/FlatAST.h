@@ -0,0 +1,108 @@
+// FlatAST.h - Compact, index-based AST in struct-of-arrays layout
+#pragma once
+#include "AST.h"
+#include <cstdint>
+#include <vector>
+
+using NodeIndex = uint32_t;
+constexpr NodeIndex NO_NODE = 0xFFFFFFFFu;
+
+enum class NodeKind : uint8_t {
+    Number,
+    Float,
+    Boolean,
+    Variable,
+    Binary,
+    Unary,
+    ArrayAccess,
+    Call,
+    VariableDeclaration,
+    Assignment,
+    ArrayAssignment,
+    If,
+    While,
+    For,
+    ParallelFor,
+    Block,
+    Function,
+    Return,
+    ExpressionStatement,
+    Program
+};
+
+// Every node is an index into the parallel columns below. Nodes are stored
+// in post-order, so an expression's operands always precede it and a whole
+// expression occupies one contiguous index range ending at its root.
+//
+// Column usage per kind:
+//   Number                op = ValueType; value = literal (I32) or index into `constants` (I64)
+//   Float                 value = index into `constants` (the double's bits)
+//   Boolean               value = literal
+//   Variable              value = Symbol
+//   Binary                op = BinaryOp, a = left, b = right
+//   Unary                 op = UnaryOp, a = operand
+//   ArrayAccess           value = Symbol, a = index
+//   Call                  value = Symbol, a/b = argument list start/length
+//   VariableDeclaration   value = Symbol, a = initializer (or NO_NODE), op = declared ValueType,
+//                         b = array length
+//   Assignment            value = Symbol, a = value
+//   ArrayAssignment       value = Symbol, a = index, b = value
+//   If                    a = condition, b = then, c = else (or NO_NODE)
+//   While                 a = condition, b = body
+//   For                   value = Symbol, a = start, b = end, c = body
+//   ParallelFor           value = Symbol, a/b = list start/length, c = body
+//                         (the list holds the start and end nodes, then a
+//                         Symbol and a ReductionOp per reduction)
+//   Block / Program       a/b = statement list start/length
+//   Function              value = Symbol, a/b = parameter list start/length, c = body,
+//                         op = 1 if annotated @memo
+//                         (the list holds b Symbols, then b parameter ValueTypes,
+//                         then the return ValueType)
+//   Return                a = value (or NO_NODE)
+//   ExpressionStatement   a = expression
+// Lists are runs in `lists`; parameter lists hold Symbols rather than nodes.
+class FlatAST {
+public:
+    std::vector<NodeKind> kinds;
+    std::vector<uint8_t> ops;
+    std::vector<int32_t> values;
+    std::vector<NodeIndex> a;
+    std::vector<NodeIndex> b;
+    std::vector<NodeIndex> c;
+    std::vector<NodeIndex> lists;
+    std::vector<int64_t> constants;  // Literals wider than `values`
+    NodeIndex root = NO_NODE;
+
+    // Flatten a tree produced by the Parser
+    static FlatAST build(Program& program);
+
+    size_t size() const { return kinds.size(); }
+    NodeIndex listItem(NodeIndex node, size_t i) const { return lists[a[node] + i]; }
+    BinaryOp binaryOp(NodeIndex node) const { return static_cast<BinaryOp>(ops[node]); }
+    UnaryOp unaryOp(NodeIndex node) const { return static_cast<UnaryOp>(ops[node]); }
+    ValueType valueType(NodeIndex node) const { return static_cast<ValueType>(ops[node]); }
+    int64_t integer(NodeIndex node) const;
+    double real(NodeIndex node) const;
+    // Of a Function node
+    ValueType parameterType(NodeIndex node, size_t i) const {
+        return static_cast<ValueType>(lists[a[node] + b[node] + i]);
+    }
+    ValueType returnType(NodeIndex node) const { return static_cast<ValueType>(lists[a[node] + 2 * b[node]]); }
+    // Of a ParallelFor node
+    size_t reductionCount(NodeIndex node) const { return (b[node] - 2) / 2; }
+    Reduction reduction(NodeIndex node, size_t i) const {
+        return Reduction{static_cast<Symbol>(lists[a[node] + 2 + 2 * i]),
+                         static_cast<ReductionOp>(lists[a[node] + 3 + 2 * i])};
+    }
+
+    // First index of the expression subtree rooted at `node`
+    NodeIndex expressionStart(NodeIndex node) const;
+
+    // Bytes held by the columns
+    size_t memoryUsage() const;
+
+    NodeIndex add(NodeKind kind, uint8_t op, int32_t value,
+                  NodeIndex first = NO_NODE, NodeIndex second = NO_NODE, NodeIndex third = NO_NODE);
+    NodeIndex addList(const std::vector<NodeIndex>& items);
+    int32_t addConstant(int64_t value);
+};
@@ -0,0 +1,266 @@
+// IncrementalCache.cpp - Implementation
+#include "IncrementalCache.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Bump when the generated IR for an unchanged function may differ
+const char* const CACHE_FORMAT = "simplelang-incremental-v5";
+
+std::string toHex(uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        hex[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+    return hex;
+}
+
+// Parameter or return type annotation, as the Parser reads it
+bool parseType(const Token& token, ValueType& type) {
+    if (token.type != TokenType::IDENTIFIER) return false;
+    if (token.value == "i32") type = ValueType::I32;
+    else if (token.value == "i64") type = ValueType::I64;
+    else if (token.value == "f64") type = ValueType::F64;
+    else return false;
+    return true;
+}
+
+std::string signature(const std::vector<ValueType>& parameterTypes, ValueType returnType) {
+    std::string text = "(";
+    for (ValueType type : parameterTypes) {
+        text += spelling(type);
+        text += ',';
+    }
+    return text + ")" + spelling(returnType);
+}
+
+} // namespace
+
+IncrementalCache::IncrementalCache(const std::string& directory) : directory(directory) {
+    if (std::error_code ec = llvm::sys::fs::create_directories(directory)) {
+        throw CodeGenError("Cannot create cache directory " + directory + ": " + ec.message());
+    }
+}
+
+bool IncrementalCache::splitFunctions(const std::vector<Token>& tokens, std::vector<FunctionRange>& functions) {
+    size_t i = 0;
+    while (tokens[i].type != TokenType::END_OF_FILE) {
+        // [@annotation] function name ( name [: type], ... ) [: type] { body }, where a
+        // parameter type may be followed by [] for an array
+        FunctionRange range;
+        range.begin = i;
+        if (tokens[i].type == TokenType::AT && tokens[i + 1].type == TokenType::IDENTIFIER) {
+            i += 2;
+        }
+        if (tokens[i].type != TokenType::FUNCTION || tokens[i + 1].type != TokenType::IDENTIFIER) {
+            return false;
+        }
+        range.name = tokens[i + 1].symbol;
+        range.returnType = ValueType::I32;
+        i += 2;
+        if (tokens[i].type != TokenType::LEFT_PAREN) return false;
+        while (tokens[i].type != TokenType::RIGHT_PAREN) {
+            if (tokens[i].type == TokenType::END_OF_FILE) return false;
+            if (tokens[i].type == TokenType::IDENTIFIER) range.parameterTypes.push_back(ValueType::I32);
+            if (tokens[i].type == TokenType::COLON) {
+                if (range.parameterTypes.empty() || !parseType(tokens[i + 1], range.parameterTypes.back())) {
+                    return false;
+                }
+                i++;
+                if (tokens[i + 1].type == TokenType::LEFT_BRACKET && tokens[i + 2].type == TokenType::RIGHT_BRACKET) {
+                    range.parameterTypes.back() = arrayOf(range.parameterTypes.back());
+                    i += 2;
+                }
+            }
+            i++;
+        }
+        i++;
+        if (tokens[i].type == TokenType::COLON) {
+            if (!parseType(tokens[i + 1], range.returnType)) return false;
+            i += 2;
+        }
+        if (tokens[i].type != TokenType::LEFT_BRACE) return false;
+
+        int depth = 0;
+        do {
+            switch (tokens[i].type) {
+                case TokenType::LEFT_BRACE: depth++; break;
+                case TokenType::RIGHT_BRACE: depth--; break;
+                case TokenType::IDENTIFIER:
+                    if (tokens[i + 1].type == TokenType::LEFT_PAREN) {
+                        range.callees.push_back(tokens[i].symbol);
+                    }
+                    break;
+                case TokenType::END_OF_FILE: return false;
+                default: break;
+            }
+            i++;
+        } while (depth > 0);
+        range.end = i;
+
+        std::sort(range.callees.begin(), range.callees.end());
+        range.callees.erase(std::unique(range.callees.begin(), range.callees.end()), range.callees.end());
+        functions.push_back(std::move(range));
+    }
+    return true;
+}
+
+std::string IncrementalCache::entryPath(const std::string& key) const {
+    return directory + "/" + key + ".bc";
+}
+
+std::string IncrementalCache::manifestPath(const std::string& sourceName) const {
+    llvm::SmallString<256> absolute(sourceName);
+    llvm::sys::fs::make_absolute(absolute);
+    return directory + "/" + toHex(llvm::xxHash64(absolute.str())) + ".manifest";
+}
+
+bool IncrementalCache::readEntry(const std::string& key, std::string& bitcode) const {
+    std::ifstream in(entryPath(key), std::ios::binary);
+    if (!in.is_open()) return false;
+    bitcode.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !bitcode.empty();
+}
+
+void IncrementalCache::writeEntry(const std::string& key, const std::string& bitcode) const {
+    // Write to a uniquely named temporary and rename, so a concurrent reader
+    // never sees a partial entry and concurrent writers never share a file
+    std::string path = entryPath(key);
+    int fd;
+    llvm::SmallString<128> temporary;
+    if (std::error_code ec = llvm::sys::fs::createUniqueFile(directory + "/" + key + "-%%%%%%%%.tmp", fd,
+                                                             temporary)) {
+        throw CodeGenError("Cannot create a cache entry in " + directory + ": " + ec.message());
+    }
+    {
+        llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+        out.write(bitcode.data(), bitcode.size());
+        out.close();
+        if (out.has_error()) {
+            out.clear_error();
+            llvm::sys::fs::remove(temporary);
+            throw CodeGenError("Cannot write cache entry " + std::string(temporary));
+        }
+    }
+    if (std::error_code ec = llvm::sys::fs::rename(temporary, path)) {
+        llvm::sys::fs::remove(temporary);
+        throw CodeGenError("Cannot store cache entry " + path + ": " + ec.message());
+    }
+}
+
+void IncrementalCache::updateManifest(const std::string& sourceName,
+                                      const std::vector<FunctionRange>& functions) const {
+    std::string path = manifestPath(sourceName);
+    std::set<std::string> current;
+    for (const auto& function : functions) {
+        current.insert(function.key);
+    }
+
+    // Entries this source referenced last time but no longer does are stale
+    std::ifstream in(path);
+    std::string key;
+    while (in >> key) {
+        if (!current.count(key)) {
+            llvm::sys::fs::remove(entryPath(key));
+        }
+    }
+    in.close();
+
+    std::ofstream out(path, std::ios::trunc);
+    for (const auto& entry : current) {
+        out << entry << "\n";
+    }
+}
+
+bool IncrementalCache::compile(const std::string& sourceName, std::string_view source,
+                               CodeGenerator& codeGen, IncrementalStats& stats) {
+    Lexer lexer(source);
+    std::vector<Token> tokens = lexer.tokenize();
+
+    std::vector<FunctionRange> functions;
+    if (!splitFunctions(tokens, functions)) {
+        return false;
+    }
+
+    std::unordered_map<Symbol, const FunctionRange*> signatures;
+    CallGraph calls;
+    for (const auto& function : functions) {
+        signatures[function.name] = &function;
+        calls[function.name] = function.callees;
+    }
+    std::unordered_set<Symbol> printing;
+    findPrintingFunctions(calls, printing);
+
+    // Key = function tokens + (name, signature, whether it prints) of every
+    // callee it references
+    for (auto& function : functions) {
+        std::string material = CACHE_FORMAT;
+        material += "/" + codeGen.getOptions().key();
+        for (size_t i = function.begin; i < function.end; i++) {
+            material += static_cast<char>(tokens[i].type);
+            material.append(tokens[i].value.data(), tokens[i].value.size());
+            material += '\0';
+        }
+        for (Symbol callee : function.callees) {
+            auto it = signatures.find(callee);
+            material += symbolName(callee);
+            material += it == signatures.end() ? std::string(":?")
+                                               : ":" + signature(it->second->parameterTypes, it->second->returnType);
+            if (printing.count(callee)) {
+                material += ":prints";
+            }
+            material += '\0';
+        }
+        function.key = toHex(llvm::xxHash64(material));
+    }
+
+    for (const auto& function : functions) {
+        codeGen.declareFunction(function.name, function.parameterTypes, function.returnType);
+    }
+
+    for (const auto& function : functions) {
+        std::string bitcode;
+        if (readEntry(function.key, bitcode)) {
+            stats.reused++;
+        } else {
+            // Parse just this function's tokens and generate it on its own,
+            // against declarations of the functions it calls
+            std::vector<Token> range(tokens.begin() + function.begin, tokens.begin() + function.end);
+            range.push_back(tokens.back());
+            ASTArena arena;
+            Parser parser(std::move(range), arena);
+            Program* program = parser.parse();
+
+            CodeGenerator functionGen;
+            functionGen.setOptions(codeGen.getOptions());
+            for (Symbol callee : function.callees) {
+                auto it = signatures.find(callee);
+                if (it != signatures.end() && callee != function.name) {
+                    functionGen.declareFunction(callee, it->second->parameterTypes, it->second->returnType);
+                }
+            }
+            functionGen.declarePrinting(printing);
+            functionGen.generate(*program);
+            bitcode = functionGen.bitcode();
+            writeEntry(function.key, bitcode);
+            stats.regenerated++;
+        }
+        codeGen.linkBitcode(bitcode, symbolName(function.name));
+    }
+
+    updateManifest(sourceName, functions);
+    return true;
+}
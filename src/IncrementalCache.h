@@ -0,0 +1,49 @@
+// IncrementalCache.h - Per-function IR cache for incremental recompilation
+#pragma once
+#include "CodeGen.h"
+#include "Token.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct IncrementalStats {
+    size_t reused = 0;       // Functions linked from cached bitcode
+    size_t regenerated = 0;  // Functions parsed and compiled this run
+};
+
+// Splits a source file into its top-level functions and caches the bitcode
+// of each one under a key derived from the function's tokens and the
+// signatures of the functions it calls. A function is re-parsed and
+// re-generated only when its own tokens change or a callee's signature, or
+// whether the callee prints, changes; whitespace and comment edits never
+// invalidate anything.
+class IncrementalCache {
+private:
+    struct FunctionRange {
+        size_t begin;                 // Index of the `function` token
+        size_t end;                   // One past the closing '}'
+        Symbol name;
+        std::vector<ValueType> parameterTypes;
+        ValueType returnType;
+        std::vector<Symbol> callees;  // Sorted, unique
+        std::string key;
+    };
+
+    std::string directory;
+
+    bool splitFunctions(const std::vector<Token>& tokens, std::vector<FunctionRange>& functions);
+    std::string entryPath(const std::string& key) const;
+    std::string manifestPath(const std::string& sourceName) const;
+    bool readEntry(const std::string& key, std::string& bitcode) const;
+    void writeEntry(const std::string& key, const std::string& bitcode) const;
+    void updateManifest(const std::string& sourceName, const std::vector<FunctionRange>& functions) const;
+
+public:
+    explicit IncrementalCache(const std::string& directory);
+
+    // Generate `source` into `codeGen`, reusing cached functions. Returns
+    // false (leaving `codeGen` untouched) when the file contains top-level
+    // code other than function declarations and must be compiled normally.
+    bool compile(const std::string& sourceName, std::string_view source,
+                 CodeGenerator& codeGen, IncrementalStats& stats);
+};
@@ -0,0 +1,195 @@
+// JITCache.cpp - Implementation
+#include "JITCache.h"
+#include "CodeGen.h"
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include <utime.h>
+
+namespace {
+
+// Bump when the object code for an unchanged key may differ
+const char* const CACHE_FORMAT = "simplelang-jit-v2";
+const char* const ENTRY_EXTENSION = ".o";
+
+std::string toHex(uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        hex[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+    return hex;
+}
+
+// The counters in an open stats file; zero if it is empty
+JITCacheStats readStats(int fd) {
+    char text[128];
+    ssize_t size = ::pread(fd, text, sizeof(text) - 1, 0);
+    JITCacheStats stats;
+    std::istringstream in(std::string(text, size > 0 ? size : 0));
+    in >> stats.hits >> stats.misses >> stats.evictions;
+    return stats;
+}
+
+} // namespace
+
+JITCache::JITCache(const std::string& directory, uint64_t maxBytes)
+    : directory(directory), maxBytes(maxBytes) {
+    if (std::error_code ec = llvm::sys::fs::create_directories(directory)) {
+        throw CodeGenError("Cannot create cache directory " + directory + ": " + ec.message());
+    }
+}
+
+std::string JITCache::key(std::string_view source, int optLevel, const std::string& flags) {
+    std::string material = CACHE_FORMAT;
+    material += '\0';
+    material += LLVM_VERSION_STRING;
+    material += '\0';
+    material += CodeGenerator::hostTarget();
+    material += '\0';
+    material += "-O" + std::to_string(optLevel) + " " + flags;
+    material += '\0';
+    material.append(source.data(), source.size());
+    return toHex(llvm::xxHash64(material));
+}
+
+std::string JITCache::entryPath(const std::string& key) const {
+    return directory + "/" + key + ENTRY_EXTENSION;
+}
+
+std::string JITCache::statsPath() const {
+    return directory + "/stats";
+}
+
+bool JITCache::lookup(const std::string& key, std::string& object) const {
+    std::string path = entryPath(key);
+    std::ifstream in(path, std::ios::binary);
+    if (in.is_open()) {
+        object.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    JITCacheStats delta;
+    if (object.empty()) {
+        delta.misses = 1;
+        updateStats(delta);
+        return false;
+    }
+
+    // Eviction is by modification time, so mark the entry as recently used
+    utime(path.c_str(), nullptr);
+    delta.hits = 1;
+    updateStats(delta);
+    return true;
+}
+
+void JITCache::store(const std::string& key, const std::string& object) const {
+    // Write to a uniquely named temporary and rename, so a concurrent reader
+    // never sees a partial entry and concurrent writers never share a file
+    std::string path = entryPath(key);
+    int fd;
+    llvm::SmallString<128> temporary;
+    if (std::error_code ec = llvm::sys::fs::createUniqueFile(directory + "/" + key + "-%%%%%%%%.tmp", fd,
+                                                             temporary)) {
+        throw CodeGenError("Cannot create a cache entry in " + directory + ": " + ec.message());
+    }
+    {
+        llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+        out.write(object.data(), object.size());
+        out.close();
+        if (out.has_error()) {
+            out.clear_error();
+            llvm::sys::fs::remove(temporary);
+            throw CodeGenError("Cannot write cache entry " + std::string(temporary));
+        }
+    }
+    if (std::error_code ec = llvm::sys::fs::rename(temporary, path)) {
+        llvm::sys::fs::remove(temporary);
+        throw CodeGenError("Cannot store cache entry " + path + ": " + ec.message());
+    }
+    evict();
+}
+
+void JITCache::evict() const {
+    struct Entry {
+        std::string path;
+        uint64_t size;
+        llvm::sys::TimePoint<> used;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+
+    std::error_code ec;
+    for (llvm::sys::fs::directory_iterator it(directory, ec), end; it != end && !ec; it.increment(ec)) {
+        if (!llvm::StringRef(it->path()).endswith(ENTRY_EXTENSION)) {
+            continue;
+        }
+        llvm::sys::fs::file_status status;
+        if (llvm::sys::fs::status(it->path(), status)) {
+            continue;
+        }
+        entries.push_back({it->path(), status.getSize(), status.getLastModificationTime()});
+        total += status.getSize();
+    }
+    if (total <= maxBytes) {
+        return;
+    }
+
+    // Least recently used first
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    JITCacheStats delta;
+    for (const auto& entry : entries) {
+        if (total <= maxBytes) {
+            break;
+        }
+        if (!llvm::sys::fs::remove(entry.path)) {
+            total -= entry.size;
+            delta.evictions++;
+        }
+    }
+    updateStats(delta);
+}
+
+JITCacheStats JITCache::stats() const {
+    // Read-write only because lockFile takes a write lock
+    int fd;
+    if (llvm::sys::fs::openFileForReadWrite(statsPath(), fd, llvm::sys::fs::CD_OpenExisting,
+                                            llvm::sys::fs::OF_None)) {
+        return JITCacheStats();
+    }
+    llvm::sys::fs::lockFile(fd);
+    JITCacheStats stats = readStats(fd);
+    llvm::sys::fs::unlockFile(fd);
+    ::close(fd);
+    return stats;
+}
+
+void JITCache::updateStats(const JITCacheStats& delta) const {
+    // Updated in place under a file lock, so concurrent runs (compile
+    // server children, say) never lose each other's counts
+    int fd;
+    if (llvm::sys::fs::openFileForReadWrite(statsPath(), fd, llvm::sys::fs::CD_OpenAlways,
+                                            llvm::sys::fs::OF_None)) {
+        return;  // The counters are informational
+    }
+    llvm::sys::fs::lockFile(fd);
+    JITCacheStats current = readStats(fd);
+    current.hits += delta.hits;
+    current.misses += delta.misses;
+    current.evictions += delta.evictions;
+    std::string text = std::to_string(current.hits) + " " + std::to_string(current.misses) + " " +
+                       std::to_string(current.evictions) + "\n";
+    if (::ftruncate(fd, 0) == 0) {
+        ::pwrite(fd, text.data(), text.size(), 0);
+    }
+    llvm::sys::fs::unlockFile(fd);
+    ::close(fd);
+}
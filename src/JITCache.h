@@ -0,0 +1,39 @@
+// JITCache.h - Persistent cache of JIT-compiled object code
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+struct JITCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+// Whole-program object files stored under a key derived from the source
+// text, the code generation flags and the host CPU. A hit lets the driver
+// skip parsing, IR generation and machine-code emission and just link the
+// object into the JIT. Entries are evicted least-recently-used first once
+// the directory grows past its size limit; hit/miss counters persist in
+// the directory across runs.
+class JITCache {
+private:
+    std::string directory;
+    uint64_t maxBytes;
+
+    std::string entryPath(const std::string& key) const;
+    std::string statsPath() const;
+    void updateStats(const JITCacheStats& delta) const;
+    void evict() const;
+
+public:
+    JITCache(const std::string& directory, uint64_t maxBytes);
+
+    // `flags` names every option that changes the generated code
+    static std::string key(std::string_view source, int optLevel, const std::string& flags);
+
+    // Load the object stored under `key`; counts a hit or a miss
+    bool lookup(const std::string& key, std::string& object) const;
+    void store(const std::string& key, const std::string& object) const;
+    JITCacheStats stats() const;
+};
@@ -1,26 +1,51 @@
 // Lexer.cpp - Implementation
 #include "Lexer.h"
-#include <cctype>
+#include "CharScan.h"
 #include <stdexcept>
 
-Lexer::Lexer(const std::string& input) 
-    : input(input), current(0), line(1), column(1) {
-    initKeywords();
-}
+namespace {
 
-void Lexer::initKeywords() {
-    keywords = {
-        {"var", TokenType::VAR},
-        {"function", TokenType::FUNCTION},
-        {"if", TokenType::IF},
-        {"else", TokenType::ELSE},
-        {"while", TokenType::WHILE},
-        {"return", TokenType::RETURN},
-        {"true", TokenType::TRUE},
-        {"false", TokenType::FALSE}
-    };
+// Keywords are recognized by switching on length and first character, so an
+// identifier costs at most one short comparison and no hashing
+constexpr TokenType keywordType(std::string_view text) {
+    switch (text.size()) {
+        case 2:
+            if (text[1] == 'f' && text == "if") return TokenType::IF;
+            if (text[1] == 'n' && text == "in") return TokenType::IN;
+            break;
+        case 3:
+            if (text[0] == 'v' && text == "var") return TokenType::VAR;
+            if (text[0] == 'f' && text == "for") return TokenType::FOR;
+            break;
+        case 4:
+            if (text[0] == 'e' && text == "else") return TokenType::ELSE;
+            if (text[0] == 't' && text == "true") return TokenType::TRUE;
+            break;
+        case 5:
+            if (text[0] == 'w' && text == "while") return TokenType::WHILE;
+            if (text[0] == 'f' && text == "false") return TokenType::FALSE;
+            break;
+        case 6:
+            if (text[0] == 'r' && text == "return") return TokenType::RETURN;
+            if (text[0] == 'i' && text == "import") return TokenType::IMPORT;
+            break;
+        case 8:
+            if (text[0] == 'f' && text == "function") return TokenType::FUNCTION;
+            if (text[0] == 'p' && text == "parallel") return TokenType::PARALLEL;
+            break;
+    }
+    return TokenType::IDENTIFIER;
 }
 
+static_assert(keywordType("function") == TokenType::FUNCTION, "keyword table out of sync");
+static_assert(keywordType("while") == TokenType::WHILE, "keyword table out of sync");
+static_assert(keywordType("whilst") == TokenType::IDENTIFIER, "keyword table out of sync");
+
+} // namespace
+
+Lexer::Lexer(std::string_view input) 
+    : input(input), current(0), line(1), lineStart(0) {}
+
 char Lexer::peek(int offset) {
     size_t pos = current + offset;
     if (pos >= input.length()) return '\0';
@@ -33,75 +58,99 @@ char Lexer::advance() {
     char c = input[current++];
     if (c == '\n') {
         line++;
-        column = 1;
-    } else {
-        column++;
+        lineStart = current;
     }
     return c;
 }
 
+int Lexer::column() const {
+    return static_cast<int>(current - lineStart) + 1;
+}
+
 void Lexer::skipWhitespace() {
-    while (!isAtEnd()) {
-        char c = peek();
-        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
-            advance();
-        } else {
-            break;
-        }
-    }
+    const char* begin = input.data();
+    const char* newLineStart = begin + lineStart;
+    int newlines = 0;
+    
+    const char* stop = scan::skipWhitespace(begin + current, begin + input.size(), newlines, newLineStart);
+    current = static_cast<size_t>(stop - begin);
+    line += newlines;
+    lineStart = static_cast<size_t>(newLineStart - begin);
 }
 
 void Lexer::skipComment() {
     if (peek() == '/' && peek(1) == '/') {
-        // Skip until end of line
-        while (peek() != '\n' && !isAtEnd()) {
-            advance();
-        }
+        // Skip until end of line; the newline is left for skipWhitespace
+        const char* begin = input.data();
+        current = static_cast<size_t>(scan::findNewline(begin + current, begin + input.size()) - begin);
     }
 }
 
 Token Lexer::makeNumber() {
-    int startLine = line;
-    int startColumn = column;
-    std::string value;
+    int startColumn = column();
+    size_t start = current;
     
-    while (std::isdigit(peek())) {
-        value += advance();
+    const char* begin = input.data();
+    current = static_cast<size_t>(scan::skipDigits(begin + current, begin + input.size()) - begin);
+    // A fraction makes it a floating-point literal
+    if (peek() == '.' && scan::isDigit(peek(1))) {
+        current = static_cast<size_t>(scan::skipDigits(begin + current + 1, begin + input.size()) - begin);
     }
     
-    return Token(TokenType::NUMBER, value, startLine, startColumn);
+    return Token(TokenType::NUMBER, input.substr(start, current - start), line, startColumn);
 }
 
 Token Lexer::makeIdentifier() {
-    int startLine = line;
-    int startColumn = column;
-    std::string value;
+    int startColumn = column();
+    size_t start = current;
     
-    while (std::isalnum(peek()) || peek() == '_') {
-        value += advance();
-    }
+    const char* begin = input.data();
+    current = static_cast<size_t>(scan::skipIdentifier(begin + current, begin + input.size()) - begin);
+    std::string_view value = input.substr(start, current - start);
     
-    // Check if it's a keyword
-    TokenType type = TokenType::IDENTIFIER;
-    auto it = keywords.find(value);
-    if (it != keywords.end()) {
-        type = it->second;
+    TokenType type = keywordType(value);
+    if (type != TokenType::IDENTIFIER) {
+        return Token(type, value, line, startColumn);
     }
     
-    return Token(type, value, startLine, startColumn);
+    auto cached = symbols.find(value);
+    if (cached == symbols.end()) {
+        cached = symbols.emplace(value, SymbolTable::global().intern(value)).first;
+    }
+    return Token(type, value, line, startColumn, cached->second);
+}
+
+Token Lexer::makeString() {
+    // Called just after the opening quote; strings have no escapes and end
+    // on the same line
+    int startColumn = column() - 1;
+    size_t start = current;
+    while (!isAtEnd() && peek() != '"' && peek() != '\n') {
+        current++;
+    }
+    if (peek() != '"') {
+        return Token(TokenType::UNKNOWN, input.substr(start - 1, current - start + 1), line, startColumn);
+    }
+    std::string_view value = input.substr(start, current - start);
+    current++; // Closing quote
+    return Token(TokenType::STRING, value, line, startColumn);
 }
 
 Token Lexer::nextToken() {
+    // Skip any mix of whitespace and (possibly consecutive) line comments
     skipWhitespace();
-    skipComment();
-    skipWhitespace(); // Skip whitespace after comments too
+    while (peek() == '/' && peek(1) == '/') {
+        skipComment();
+        skipWhitespace();
+    }
     
     if (isAtEnd()) {
-        return Token(TokenType::END_OF_FILE, "", line, column);
+        return Token(TokenType::END_OF_FILE, "", line, column());
     }
     
     int startLine = line;
-    int startColumn = column;
+    int startColumn = column();
+    size_t start = current;
     char c = advance();
     
     switch (c) {
@@ -113,8 +162,19 @@ Token Lexer::nextToken() {
         case ')': return Token(TokenType::RIGHT_PAREN, ")", startLine, startColumn);
         case '{': return Token(TokenType::LEFT_BRACE, "{", startLine, startColumn);
         case '}': return Token(TokenType::RIGHT_BRACE, "}", startLine, startColumn);
+        case '[': return Token(TokenType::LEFT_BRACKET, "[", startLine, startColumn);
+        case ']': return Token(TokenType::RIGHT_BRACKET, "]", startLine, startColumn);
         case ',': return Token(TokenType::COMMA, ",", startLine, startColumn);
+        case ':': return Token(TokenType::COLON, ":", startLine, startColumn);
         case ';': return Token(TokenType::SEMICOLON, ";", startLine, startColumn);
+        case '@': return Token(TokenType::AT, "@", startLine, startColumn);
+        case '.':
+            if (peek() == '.') {
+                advance();
+                return Token(TokenType::DOT_DOT, "..", startLine, startColumn);
+            }
+            break;
+        case '"': return makeString();
         case '!':
             if (peek() == '=') {
                 advance();
@@ -152,18 +212,18 @@ Token Lexer::nextToken() {
             }
             break;
         default:
-            if (std::isdigit(c)) {
-                current--; column--; // Back up to re-read the digit
+            if (scan::isDigit(c)) {
+                current--; // Back up to re-read the digit
                 return makeNumber();
             }
-            if (std::isalpha(c) || c == '_') {
-                current--; column--; // Back up to re-read the character
+            if (scan::isIdentifierStart(c)) {
+                current--; // Back up to re-read the character
                 return makeIdentifier();
             }
             break;
     }
     
-    return Token(TokenType::UNKNOWN, std::string(1, c), startLine, startColumn);
+    return Token(TokenType::UNKNOWN, input.substr(start, 1), startLine, startColumn);
 }
 
 std::vector<Token> Lexer::tokenize() {
@@ -2,22 +2,23 @@
 #pragma once
 #include "Token.h"
 #include <string>
-#include <vector>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 class Lexer {
 private:
-    std::string input;
+    std::string_view input;
     size_t current;
     int line;
-    int column;
-    
-    // Keywords map
-    std::unordered_map<std::string, TokenType> keywords;
+    size_t lineStart;   // Offset of the first character of the current line
+    // Identifiers already interned, keyed by views into `input`, so each
+    // spelling takes the global table's lock once per lexer
+    std::unordered_map<std::string_view, Symbol> symbols;
     
-    void initKeywords();
     char peek(int offset = 0);
     char advance();
+    int column() const;
     void skipWhitespace();
     void skipComment();
     Token makeNumber();
@@ -25,7 +26,9 @@ private:
     Token makeString();
     
 public:
-    Lexer(const std::string& input);
+    // The lexer borrows `input`; the buffer must outlive the lexer and its tokens.
+    explicit Lexer(std::string_view input);
+    Lexer(std::string&&) = delete;
     Token nextToken();
     std::vector<Token> tokenize();
     bool isAtEnd();
@@ -0,0 +1,85 @@
+// NativeLinker.cpp - Implementation
+#include "NativeLinker.h"
+#include "CodeGen.h"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Program.h>
+#include <cstdlib>
+#include <fstream>
+
+namespace {
+
+const char* const ENTRY_SHIM =
+    "#include <stdio.h>\n"
+    "int %s(void);\n"
+    "void simplelang_flush(void);\n"
+    "int main(void) {\n"
+    "    int result = %s();\n"
+    "    simplelang_flush();\n"
+    "    printf(\"Return value: %%d\\n\", result);\n"
+    "    return 0;\n"
+    "}\n";
+
+} // namespace
+
+NativeLinker::~NativeLinker() {
+    for (const auto& path : temporaries) {
+        llvm::sys::fs::remove(path);
+    }
+}
+
+std::string NativeLinker::temporaryFile(const std::string& prefix, const std::string& suffix) {
+    llvm::SmallString<128> path;
+    if (std::error_code ec = llvm::sys::fs::createTemporaryFile(prefix, suffix, path)) {
+        throw CodeGenError("Cannot create temporary file: " + ec.message());
+    }
+    temporaries.push_back(path.str().str());
+    return temporaries.back();
+}
+
+void NativeLinker::addInput(const std::string& path) {
+    inputs.push_back(path);
+}
+
+std::string NativeLinker::writeEntryShim() {
+    std::string path = temporaryFile("simplelang-entry", "c");
+    std::ofstream out(path, std::ios::trunc);
+    char source[512];
+    std::snprintf(source, sizeof(source), ENTRY_SHIM, NATIVE_ENTRY, NATIVE_ENTRY);
+    out << source;
+    if (!out) {
+        throw CodeGenError("Cannot write " + path);
+    }
+    return path;
+}
+
+void NativeLinker::link(const std::string& outputFile) {
+    const char* compilerName = std::getenv("CC");
+    llvm::ErrorOr<std::string> compiler = llvm::sys::findProgramByName(
+        compilerName && *compilerName ? compilerName : "cc");
+    if (!compiler) {
+        throw CodeGenError("No C compiler found to link with (set CC)");
+    }
+
+    std::string shim = writeEntryShim();
+    std::vector<std::string> args = {*compiler, shim};
+    args.insert(args.end(), inputs.begin(), inputs.end());
+    // The runtime is C++ and runs the parallel loop workers on threads
+    args.push_back(SIMPLELANG_RUNTIME_LIBRARY);
+    args.push_back("-lstdc++");
+    args.push_back("-lpthread");
+    args.push_back("-o");
+    args.push_back(outputFile);
+
+    std::vector<llvm::StringRef> argRefs(args.begin(), args.end());
+    std::string error;
+#if LLVM_VERSION_MAJOR >= 16
+    int status = llvm::sys::ExecuteAndWait(*compiler, argRefs, std::nullopt, {}, 0, 0, &error);
+#else
+    int status = llvm::sys::ExecuteAndWait(*compiler, argRefs, llvm::None, {}, 0, 0, &error);
+#endif
+    if (status != 0) {
+        throw CodeGenError("Linking " + outputFile + " failed" + (error.empty() ? "" : ": " + error));
+    }
+}
@@ -0,0 +1,28 @@
+// NativeLinker.h - Links emitted objects into a standalone executable
+#pragma once
+#include <string>
+#include <vector>
+
+// Drives the system C compiler (`$CC`, else `cc`) as the linker. The
+// executable gets a small C entry point that calls the program's
+// NATIVE_ENTRY and prints its result, and the simplelang_runtime library,
+// so it needs neither LLVM nor the simplelang driver at run time.
+class NativeLinker {
+private:
+    std::vector<std::string> inputs;
+    std::vector<std::string> temporaries;
+
+    std::string writeEntryShim();
+
+public:
+    NativeLinker() = default;
+    NativeLinker(const NativeLinker&) = delete;
+    NativeLinker& operator=(const NativeLinker&) = delete;
+    ~NativeLinker();
+
+    // A path for an intermediate file that is removed with the linker
+    std::string temporaryFile(const std::string& prefix, const std::string& suffix);
+    // Object file or static library to link
+    void addInput(const std::string& path);
+    void link(const std::string& outputFile);
+};
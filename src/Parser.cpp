@@ -1,22 +1,103 @@
 // Parser.cpp - Parser implementation
 #include "Parser.h"
+#include <charconv>
+#include <cstdint>
 
-Parser::Parser(std::vector<Token> tokens) : tokens(std::move(tokens)), current(0) {}
+namespace {
+
+constexpr size_t TOKEN_TYPE_COUNT = static_cast<size_t>(TokenType::UNKNOWN) + 1;
+
+// Operator table for the precedence parser. Adding a binary operator only
+// needs a row here (plus its BinaryOp lowering in CodeGen).
+constexpr std::array<BinaryOperatorInfo, TOKEN_TYPE_COUNT> makeBinaryOperatorTable() {
+    std::array<BinaryOperatorInfo, TOKEN_TYPE_COUNT> table{};
+    auto set = [&table](TokenType type, uint8_t precedence, BinaryOp op) {
+        table[static_cast<size_t>(type)] = BinaryOperatorInfo{precedence, op};
+    };
+    set(TokenType::LOGICAL_OR, 1, BinaryOp::Or);
+    set(TokenType::LOGICAL_AND, 2, BinaryOp::And);
+    set(TokenType::EQUAL, 3, BinaryOp::Equal);
+    set(TokenType::NOT_EQUAL, 3, BinaryOp::NotEqual);
+    set(TokenType::LESS_THAN, 4, BinaryOp::Less);
+    set(TokenType::LESS_EQUAL, 4, BinaryOp::LessEqual);
+    set(TokenType::GREATER_THAN, 4, BinaryOp::Greater);
+    set(TokenType::GREATER_EQUAL, 4, BinaryOp::GreaterEqual);
+    set(TokenType::PLUS, 5, BinaryOp::Add);
+    set(TokenType::MINUS, 5, BinaryOp::Sub);
+    set(TokenType::MULTIPLY, 6, BinaryOp::Mul);
+    set(TokenType::DIVIDE, 6, BinaryOp::Div);
+    return table;
+}
+
+constexpr std::array<BinaryOperatorInfo, TOKEN_TYPE_COUNT> binaryOperators = makeBinaryOperatorTable();
+
+// Prefix operators bind tighter than any binary operator
+constexpr uint8_t UNARY_PRECEDENCE = 7;
+
+// Limit on expression() re-entry through nested call arguments; parentheses
+// and operators are handled on explicit stacks and do not count
+constexpr size_t MAX_EXPRESSION_DEPTH = 4096;
+
+BinaryOp binaryOpFor(TokenType type) {
+    switch (type) {
+        case TokenType::PLUS: return BinaryOp::Add;
+        case TokenType::MINUS: return BinaryOp::Sub;
+        case TokenType::MULTIPLY: return BinaryOp::Mul;
+        case TokenType::DIVIDE: return BinaryOp::Div;
+        case TokenType::LESS_THAN: return BinaryOp::Less;
+        case TokenType::LESS_EQUAL: return BinaryOp::LessEqual;
+        case TokenType::GREATER_THAN: return BinaryOp::Greater;
+        case TokenType::GREATER_EQUAL: return BinaryOp::GreaterEqual;
+        case TokenType::EQUAL: return BinaryOp::Equal;
+        case TokenType::NOT_EQUAL: return BinaryOp::NotEqual;
+        case TokenType::LOGICAL_AND: return BinaryOp::And;
+        case TokenType::LOGICAL_OR: return BinaryOp::Or;
+        default: throw ParseError("Token is not a binary operator");
+    }
+}
+
+} // namespace
+
+Parser::Parser(Lexer& lexer, ASTArena& arena)
+    : lexer(&lexer), tokenIndex(0), head(0), filled(0), arena(arena),
+      expressionMode(ExpressionMode::Precedence), expressionDepth(0) {}
+
+Parser::Parser(std::vector<Token> tokens, ASTArena& arena)
+    : lexer(nullptr), tokens(std::move(tokens)), tokenIndex(0), head(0), filled(0), arena(arena),
+      expressionMode(ExpressionMode::Precedence), expressionDepth(0) {}
+
+Token Parser::fetch() {
+    if (lexer) {
+        return lexer->nextToken();
+    }
+    if (tokenIndex < tokens.size()) {
+        return tokens[tokenIndex++];
+    }
+    // Keep answering EOF once the vector is exhausted (or was empty)
+    return tokens.empty() ? Token() : tokens.back();
+}
 
 bool Parser::isAtEnd() {
     return peek().type == TokenType::END_OF_FILE;
 }
 
-Token Parser::peek() {
-    return tokens[current];
+const Token& Parser::peek(size_t offset) {
+    if (offset > LOOKAHEAD - 2) {
+        throw ParseError("Parser lookahead of " + std::to_string(offset) + " exceeds buffer size");
+    }
+    while (filled <= head + offset) {
+        window[filled % LOOKAHEAD] = fetch();
+        filled++;
+    }
+    return window[(head + offset) % LOOKAHEAD];
 }
 
-Token Parser::previous() {
-    return tokens[current - 1];
+const Token& Parser::previous() {
+    return window[(head - 1) % LOOKAHEAD];
 }
 
-Token Parser::advance() {
-    if (!isAtEnd()) current++;
+const Token& Parser::advance() {
+    if (!isAtEnd()) head++;
     return previous();
 }
 
@@ -35,20 +116,25 @@ bool Parser::match(std::initializer_list<TokenType> types) {
     return false;
 }
 
-Token Parser::consume(TokenType type, const std::string& message) {
+const Token& Parser::consume(TokenType type, const std::string& message) {
     if (check(type)) return advance();
     
-    Token current_token = peek();
+    const Token& current_token = peek();
     throw ParseError("Line " + std::to_string(current_token.line) + 
                     ", Column " + std::to_string(current_token.column) + 
-                    ": " + message + ". Got '" + current_token.value + "'");
+                    ": " + message + ". Got '" + std::string(current_token.value) + "'");
 }
 
-std::unique_ptr<Program> Parser::parse() {
-    std::vector<std::unique_ptr<Statement>> statements;
+Program* Parser::parse() {
+    std::vector<Statement*> statements;
     
     while (!isAtEnd()) {
         try {
+            // Imports are only meaningful at the top level
+            if (match({TokenType::IMPORT})) {
+                importDeclaration();
+                continue;
+            }
             statements.push_back(statement());
         } catch (const ParseError& error) {
             // Error recovery: skip to next statement
@@ -60,10 +146,10 @@ std::unique_ptr<Program> Parser::parse() {
         }
     }
     
-    return std::make_unique<Program>(std::move(statements));
+    return arena.make<Program>(arena.copyList(statements));
 }
 
-std::unique_ptr<Statement> Parser::statement() {
+Statement* Parser::statement() {
     if (match({TokenType::VAR})) {
         return varDeclaration();
     }
@@ -73,9 +159,19 @@ std::unique_ptr<Statement> Parser::statement() {
     if (match({TokenType::WHILE})) {
         return whileStatement();
     }
+    if (match({TokenType::FOR})) {
+        return forStatement();
+    }
+    if (match({TokenType::PARALLEL})) {
+        consume(TokenType::FOR, "Expected 'for' after 'parallel'");
+        return forStatement(true);
+    }
     if (match({TokenType::FUNCTION})) {
         return functionDeclaration();
     }
+    if (match({TokenType::AT})) {
+        return annotatedDeclaration();
+    }
     if (match({TokenType::RETURN})) {
         return returnStatement();
     }
@@ -84,210 +180,405 @@ std::unique_ptr<Statement> Parser::statement() {
     }
     
     // Check for assignment vs expression statement
-    if (check(TokenType::IDENTIFIER)) {
-        size_t saved_current = current;
-        advance(); // consume identifier
-        if (check(TokenType::ASSIGN)) {
-            current = saved_current; // backtrack
-            return assignment();
+    if (check(TokenType::IDENTIFIER) && peek(1).type == TokenType::ASSIGN) {
+        return assignment();
+    }
+    // a[i] = value; starts out like an expression
+    if (check(TokenType::IDENTIFIER) && peek(1).type == TokenType::LEFT_BRACKET) {
+        Expression* target = expression();
+        auto* element = dynamic_cast<ArrayAccess*>(target);
+        if (element && match({TokenType::ASSIGN})) {
+            Expression* value = expression();
+            consume(TokenType::SEMICOLON, "Expected ';' after assignment");
+            return arena.make<ArrayAssignment>(element->array, element->index, value);
         }
-        current = saved_current; // backtrack
+        consume(TokenType::SEMICOLON, "Expected ';' after expression");
+        return arena.make<ExpressionStatement>(target);
     }
     
     return expressionStatement();
 }
 
-std::unique_ptr<Statement> Parser::varDeclaration() {
+void Parser::importDeclaration() {
+    Token path = consume(TokenType::STRING, "Expected a quoted file name after 'import'");
+    consume(TokenType::SEMICOLON, "Expected ';' after import");
+    importPaths.emplace_back(path.value);
+}
+
+Statement* Parser::varDeclaration() {
     Token name = consume(TokenType::IDENTIFIER, "Expected variable name");
     
-    std::unique_ptr<Expression> initializer = nullptr;
-    if (match({TokenType::ASSIGN})) {
+    ValueType declared = ValueType::Inferred;
+    uint32_t length = 0;
+    if (match({TokenType::COLON})) {
+        declared = type();
+        if (match({TokenType::LEFT_BRACKET})) {
+            declared = arrayOf(declared);
+            length = arrayLength();
+        }
+    }
+    
+    Expression* initializer = nullptr;
+    if (!isArray(declared) && match({TokenType::ASSIGN})) {
         initializer = expression();
     }
     
-    consume(TokenType::SEMICOLON, "Expected ';' after variable declaration");
-    return std::make_unique<VariableDeclaration>(name.value, std::move(initializer));
+    consume(TokenType::SEMICOLON, isArray(declared) ? "Expected ';' after array declaration (arrays start zeroed)"
+                                                    : "Expected ';' after variable declaration");
+    return arena.make<VariableDeclaration>(name.symbol, initializer, declared, length);
 }
 
-std::unique_ptr<Statement> Parser::assignment() {
+uint32_t Parser::arrayLength() {
+    Token size = consume(TokenType::NUMBER, "Expected array length");
+    uint32_t length = 0;
+    auto result = std::from_chars(size.value.data(), size.value.data() + size.value.size(), length);
+    if (result.ec != std::errc() || result.ptr != size.value.data() + size.value.size() ||
+        length == 0 || length > INT32_MAX) {
+        throw ParseError("Line " + std::to_string(size.line) + 
+                        ", Column " + std::to_string(size.column) + 
+                        ": Invalid array length '" + std::string(size.value) + "'");
+    }
+    consume(TokenType::RIGHT_BRACKET, "Expected ']' after array length");
+    return length;
+}
+
+ValueType Parser::type() {
+    Token name = consume(TokenType::IDENTIFIER, "Expected a type name");
+    if (name.value == "i32") return ValueType::I32;
+    if (name.value == "i64") return ValueType::I64;
+    if (name.value == "f64") return ValueType::F64;
+    throw ParseError("Line " + std::to_string(name.line) + 
+                    ", Column " + std::to_string(name.column) + 
+                    ": Unknown type '" + std::string(name.value) + "'");
+}
+
+Statement* Parser::assignment() {
     Token name = consume(TokenType::IDENTIFIER, "Expected variable name");
     consume(TokenType::ASSIGN, "Expected '='");
-    std::unique_ptr<Expression> value = expression();
+    Expression* value = expression();
     consume(TokenType::SEMICOLON, "Expected ';' after assignment");
     
-    return std::make_unique<Assignment>(name.value, std::move(value));
+    return arena.make<Assignment>(name.symbol, value);
 }
 
-std::unique_ptr<Statement> Parser::ifStatement() {
+Statement* Parser::ifStatement() {
     consume(TokenType::LEFT_PAREN, "Expected '(' after 'if'");
-    std::unique_ptr<Expression> condition = expression();
+    Expression* condition = expression();
     consume(TokenType::RIGHT_PAREN, "Expected ')' after if condition");
     
-    std::unique_ptr<Statement> thenBranch = statement();
-    std::unique_ptr<Statement> elseBranch = nullptr;
+    Statement* thenBranch = statement();
+    Statement* elseBranch = nullptr;
     
     if (match({TokenType::ELSE})) {
         elseBranch = statement();
     }
     
-    return std::make_unique<IfStatement>(std::move(condition), std::move(thenBranch), std::move(elseBranch));
+    return arena.make<IfStatement>(condition, thenBranch, elseBranch);
 }
 
-std::unique_ptr<Statement> Parser::whileStatement() {
+Statement* Parser::whileStatement() {
     consume(TokenType::LEFT_PAREN, "Expected '(' after 'while'");
-    std::unique_ptr<Expression> condition = expression();
+    Expression* condition = expression();
     consume(TokenType::RIGHT_PAREN, "Expected ')' after while condition");
-    std::unique_ptr<Statement> body = statement();
+    Statement* body = statement();
+    
+    return arena.make<WhileStatement>(condition, body);
+}
+
+Statement* Parser::forStatement(bool parallel) {
+    consume(TokenType::LEFT_PAREN, "Expected '(' after 'for'");
+    Token variable = consume(TokenType::IDENTIFIER, "Expected loop variable name");
+    consume(TokenType::IN, "Expected 'in' after loop variable");
+    Expression* start = expression();
+    consume(TokenType::DOT_DOT, "Expected '..' between loop bounds");
+    Expression* end = expression();
+    consume(TokenType::RIGHT_PAREN, "Expected ')' after loop bounds");
+    
+    // parallel for (...) reduce (+: sum, max: peak) body. `reduce` is not a
+    // keyword; a body that calls a function of that name needs braces.
+    std::vector<Reduction> reductions;
+    if (parallel && check(TokenType::IDENTIFIER) && peek().value == "reduce" &&
+        peek(1).type == TokenType::LEFT_PAREN) {
+        advance();
+        advance();
+        do {
+            reductions.push_back(Reduction{0, reductionOp()});
+            consume(TokenType::COLON, "Expected ':' after reduction operator");
+            reductions.back().variable = consume(TokenType::IDENTIFIER, "Expected reduction variable").symbol;
+        } while (match({TokenType::COMMA}));
+        consume(TokenType::RIGHT_PAREN, "Expected ')' after reductions");
+    }
+    Statement* body = statement();
     
-    return std::make_unique<WhileStatement>(std::move(condition), std::move(body));
+    return arena.make<ForStatement>(variable.symbol, start, end, body, parallel, arena.copyList(reductions));
+}
+
+ReductionOp Parser::reductionOp() {
+    if (match({TokenType::PLUS})) return ReductionOp::Add;
+    if (match({TokenType::MULTIPLY})) return ReductionOp::Mul;
+    if (check(TokenType::IDENTIFIER) && (peek().value == "min" || peek().value == "max")) {
+        return advance().value == "min" ? ReductionOp::Min : ReductionOp::Max;
+    }
+    const Token& token = peek();
+    throw ParseError("Line " + std::to_string(token.line) + ", Column " + std::to_string(token.column) +
+                     ": Expected a reduction operator (+, *, min or max). Got '" + std::string(token.value) + "'");
 }
 
-std::unique_ptr<Statement> Parser::functionDeclaration() {
+Statement* Parser::annotatedDeclaration() {
+    Token annotation = consume(TokenType::IDENTIFIER, "Expected annotation name after '@'");
+    if (annotation.value != "memo") {
+        throw ParseError("Line " + std::to_string(annotation.line) + 
+                        ", Column " + std::to_string(annotation.column) + 
+                        ": Unknown annotation '@" + std::string(annotation.value) + "'");
+    }
+    consume(TokenType::FUNCTION, "Expected function declaration after @memo");
+    return functionDeclaration(true);
+}
+
+Statement* Parser::functionDeclaration(bool memoize) {
     Token name = consume(TokenType::IDENTIFIER, "Expected function name");
     
     consume(TokenType::LEFT_PAREN, "Expected '(' after function name");
-    std::vector<std::string> parameters;
+    std::vector<Symbol> parameters;
+    std::vector<ValueType> parameterTypes;
     
     if (!check(TokenType::RIGHT_PAREN)) {
         do {
             Token param = consume(TokenType::IDENTIFIER, "Expected parameter name");
-            parameters.push_back(param.value);
+            parameters.push_back(param.symbol);
+            ValueType parameterType = match({TokenType::COLON}) ? type() : ValueType::I32;
+            if (match({TokenType::LEFT_BRACKET})) {
+                // Arrays arrive with their length, so parameters have none
+                consume(TokenType::RIGHT_BRACKET, "Expected ']' in array parameter type");
+                parameterType = arrayOf(parameterType);
+            }
+            parameterTypes.push_back(parameterType);
         } while (match({TokenType::COMMA}));
     }
     
     consume(TokenType::RIGHT_PAREN, "Expected ')' after parameters");
+    ValueType returnType = match({TokenType::COLON}) ? type() : ValueType::I32;
     
     consume(TokenType::LEFT_BRACE, "Expected '{' before function body");
-    std::unique_ptr<Block> body = block();
+    Block* body = block();
     
-    return std::make_unique<FunctionDeclaration>(name.value, std::move(parameters), std::move(body));
+    return arena.make<FunctionDeclaration>(name.symbol, arena.copyList(parameters), arena.copyList(parameterTypes),
+                                           returnType, body, memoize);
 }
 
-std::unique_ptr<Statement> Parser::returnStatement() {
-    std::unique_ptr<Expression> value = nullptr;
+Statement* Parser::returnStatement() {
+    Expression* value = nullptr;
     
     if (!check(TokenType::SEMICOLON)) {
         value = expression();
     }
     
     consume(TokenType::SEMICOLON, "Expected ';' after return value");
-    return std::make_unique<ReturnStatement>(std::move(value));
+    return arena.make<ReturnStatement>(value);
 }
 
-std::unique_ptr<Statement> Parser::expressionStatement() {
-    std::unique_ptr<Expression> expr = expression();
+Statement* Parser::expressionStatement() {
+    Expression* expr = expression();
     consume(TokenType::SEMICOLON, "Expected ';' after expression");
-    return std::make_unique<ExpressionStatement>(std::move(expr));
+    return arena.make<ExpressionStatement>(expr);
 }
 
-std::unique_ptr<Block> Parser::block() {
-    std::vector<std::unique_ptr<Statement>> statements;
+Block* Parser::block() {
+    std::vector<Statement*> statements;
     
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
         statements.push_back(statement());
     }
     
     consume(TokenType::RIGHT_BRACE, "Expected '}' after block");
-    return std::make_unique<Block>(std::move(statements));
+    return arena.make<Block>(arena.copyList(statements));
 }
 
-// Expression parsing with precedence climbing
-std::unique_ptr<Expression> Parser::expression() {
-    return logicalOr();
+Expression* Parser::expression() {
+    if (expressionMode == ExpressionMode::Descent) {
+        return logicalOr();
+    }
+    
+    if (++expressionDepth > MAX_EXPRESSION_DEPTH) {
+        const Token& current_token = peek();
+        throw ParseError("Line " + std::to_string(current_token.line) + 
+                        ", Column " + std::to_string(current_token.column) + 
+                        ": Expression nested too deeply");
+    }
+    Expression* expr = precedenceExpression();
+    expressionDepth--;
+    return expr;
 }
 
-std::unique_ptr<Expression> Parser::logicalOr() {
-    std::unique_ptr<Expression> expr = logicalAnd();
+// Table-driven operator-precedence parsing. Operands and pending operators
+// live on explicit stacks, so arbitrarily long operator chains, prefix
+// operator runs and parenthesis nesting use no native stack; each operator
+// token costs one table lookup.
+Expression* Parser::precedenceExpression() {
+    enum class PendingKind : uint8_t { Binary, Unary, Paren };
+    struct Pending {
+        PendingKind kind;
+        uint8_t precedence;
+        BinaryOp binary;
+        UnaryOp unary;
+    };
+    
+    std::vector<Expression*> operands;
+    std::vector<Pending> operators;
+    size_t openParens = 0;
+    
+    auto reduce = [&]() {
+        Pending top = operators.back();
+        operators.pop_back();
+        if (top.kind == PendingKind::Unary) {
+            operands.back() = arena.make<UnaryOperation>(top.unary, operands.back());
+        } else {
+            Expression* right = operands.back();
+            operands.pop_back();
+            operands.back() = arena.make<BinaryOperation>(operands.back(), top.binary, right);
+        }
+    };
+    
+    while (true) {
+        // Operand position: prefix operators and opening parentheses
+        while (true) {
+            if (match({TokenType::LOGICAL_NOT, TokenType::MINUS})) {
+                UnaryOp op = previous().type == TokenType::MINUS ? UnaryOp::Negate : UnaryOp::Not;
+                operators.push_back({PendingKind::Unary, UNARY_PRECEDENCE, BinaryOp::Add, op});
+            } else if (match({TokenType::LEFT_PAREN})) {
+                operators.push_back({PendingKind::Paren, 0, BinaryOp::Add, UnaryOp::Not});
+                openParens++;
+            } else {
+                break;
+            }
+        }
+        operands.push_back(call());
+        
+        // Operator position: closing parentheses, then a binary operator
+        while (openParens > 0 && match({TokenType::RIGHT_PAREN})) {
+            while (operators.back().kind != PendingKind::Paren) {
+                reduce();
+            }
+            operators.pop_back();
+            openParens--;
+        }
+        
+        const BinaryOperatorInfo& info = binaryOperators[static_cast<size_t>(peek().type)];
+        if (info.precedence == 0) {
+            break;
+        }
+        advance();
+        
+        while (!operators.empty() && operators.back().kind != PendingKind::Paren &&
+               operators.back().precedence >= info.precedence) {
+            reduce();
+        }
+        operators.push_back({PendingKind::Binary, info.precedence, info.op, UnaryOp::Not});
+    }
+    
+    if (openParens > 0) {
+        consume(TokenType::RIGHT_PAREN, "Expected ')' after expression");
+    }
+    while (!operators.empty()) {
+        reduce();
+    }
+    return operands.back();
+}
+
+// Recursive descent: one function per precedence level
+
+Expression* Parser::logicalOr() {
+    Expression* expr = logicalAnd();
     
     while (match({TokenType::LOGICAL_OR})) {
-        std::string operator_ = previous().value;
-        std::unique_ptr<Expression> right = logicalAnd();
-        expr = std::make_unique<BinaryOperation>(std::move(expr), operator_, std::move(right));
+        BinaryOp operator_ = binaryOpFor(previous().type);
+        Expression* right = logicalAnd();
+        expr = arena.make<BinaryOperation>(expr, operator_, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::logicalAnd() {
-    std::unique_ptr<Expression> expr = equality();
+Expression* Parser::logicalAnd() {
+    Expression* expr = equality();
     
     while (match({TokenType::LOGICAL_AND})) {
-        std::string operator_ = previous().value;
-        std::unique_ptr<Expression> right = equality();
-        expr = std::make_unique<BinaryOperation>(std::move(expr), operator_, std::move(right));
+        BinaryOp operator_ = binaryOpFor(previous().type);
+        Expression* right = equality();
+        expr = arena.make<BinaryOperation>(expr, operator_, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::equality() {
-    std::unique_ptr<Expression> expr = comparison();
+Expression* Parser::equality() {
+    Expression* expr = comparison();
     
     while (match({TokenType::NOT_EQUAL, TokenType::EQUAL})) {
-        std::string operator_ = previous().value;
-        std::unique_ptr<Expression> right = comparison();
-        expr = std::make_unique<BinaryOperation>(std::move(expr), operator_, std::move(right));
+        BinaryOp operator_ = binaryOpFor(previous().type);
+        Expression* right = comparison();
+        expr = arena.make<BinaryOperation>(expr, operator_, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::comparison() {
-    std::unique_ptr<Expression> expr = term();
+Expression* Parser::comparison() {
+    Expression* expr = term();
     
     while (match({TokenType::GREATER_THAN, TokenType::GREATER_EQUAL, 
                   TokenType::LESS_THAN, TokenType::LESS_EQUAL})) {
-        std::string operator_ = previous().value;
-        std::unique_ptr<Expression> right = term();
-        expr = std::make_unique<BinaryOperation>(std::move(expr), operator_, std::move(right));
+        BinaryOp operator_ = binaryOpFor(previous().type);
+        Expression* right = term();
+        expr = arena.make<BinaryOperation>(expr, operator_, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::term() {
-    std::unique_ptr<Expression> expr = factor();
+Expression* Parser::term() {
+    Expression* expr = factor();
     
     while (match({TokenType::MINUS, TokenType::PLUS})) {
-        std::string operator_ = previous().value;
-        std::unique_ptr<Expression> right = factor();
-        expr = std::make_unique<BinaryOperation>(std::move(expr), operator_, std::move(right));
+        BinaryOp operator_ = binaryOpFor(previous().type);
+        Expression* right = factor();
+        expr = arena.make<BinaryOperation>(expr, operator_, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::factor() {
-    std::unique_ptr<Expression> expr = unary();
+Expression* Parser::factor() {
+    Expression* expr = unary();
     
     while (match({TokenType::DIVIDE, TokenType::MULTIPLY})) {
-        std::string operator_ = previous().value;
-        std::unique_ptr<Expression> right = unary();
-        expr = std::make_unique<BinaryOperation>(std::move(expr), operator_, std::move(right));
+        BinaryOp operator_ = binaryOpFor(previous().type);
+        Expression* right = unary();
+        expr = arena.make<BinaryOperation>(expr, operator_, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::unary() {
+Expression* Parser::unary() {
     if (match({TokenType::LOGICAL_NOT, TokenType::MINUS})) {
-        std::string operator_ = previous().value;
-        std::unique_ptr<Expression> right = unary();
-        return std::make_unique<UnaryOperation>(operator_, std::move(right));
+        UnaryOp operator_ = previous().type == TokenType::MINUS ? UnaryOp::Negate : UnaryOp::Not;
+        Expression* right = unary();
+        return arena.make<UnaryOperation>(operator_, right);
     }
     
     return call();
 }
 
-std::unique_ptr<Expression> Parser::call() {
-    std::unique_ptr<Expression> expr = primary();
+Expression* Parser::call() {
+    Expression* expr = primary();
     
     while (true) {
         if (match({TokenType::LEFT_PAREN})) {
             // Function call
-            if (auto var = dynamic_cast<Variable*>(expr.get())) {
-                std::string function_name = var->name;
-                std::vector<std::unique_ptr<Expression>> arguments;
+            if (auto var = dynamic_cast<Variable*>(expr)) {
+                Symbol function_name = var->name;
+                std::vector<Expression*> arguments;
                 
                 if (!check(TokenType::RIGHT_PAREN)) {
                     do {
@@ -296,10 +587,18 @@ std::unique_ptr<Expression> Parser::call() {
                 }
                 
                 consume(TokenType::RIGHT_PAREN, "Expected ')' after arguments");
-                expr = std::make_unique<FunctionCall>(function_name, std::move(arguments));
+                expr = arena.make<FunctionCall>(function_name, arena.copyList(arguments));
             } else {
                 throw ParseError("Only identifiers can be called as functions");
             }
+        } else if (match({TokenType::LEFT_BRACKET})) {
+            auto var = dynamic_cast<Variable*>(expr);
+            if (!var) {
+                throw ParseError("Only named arrays can be indexed");
+            }
+            Expression* index = expression();
+            consume(TokenType::RIGHT_BRACKET, "Expected ']' after index");
+            expr = arena.make<ArrayAccess>(var->name, index);
         } else {
             break;
         }
@@ -308,33 +607,54 @@ std::unique_ptr<Expression> Parser::call() {
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::primary() {
+Expression* Parser::primary() {
     if (match({TokenType::TRUE})) {
-        return std::make_unique<BooleanLiteral>(true);
+        return arena.make<BooleanLiteral>(true);
     }
     
     if (match({TokenType::FALSE})) {
-        return std::make_unique<BooleanLiteral>(false);
+        return arena.make<BooleanLiteral>(false);
     }
     
     if (match({TokenType::NUMBER})) {
-        int value = std::stoi(previous().value);
-        return std::make_unique<NumberLiteral>(value);
+        Token literal = previous();
+        const char* first = literal.value.data();
+        const char* last = first + literal.value.size();
+        if (literal.value.find('.') != std::string_view::npos) {
+            double value = 0;
+            auto result = std::from_chars(first, last, value);
+            if (result.ec != std::errc() || result.ptr != last) {
+                throw ParseError("Line " + std::to_string(literal.line) + 
+                                ", Column " + std::to_string(literal.column) + 
+                                ": Float literal out of range '" + std::string(literal.value) + "'");
+            }
+            return arena.make<FloatLiteral>(value);
+        }
+        int64_t value = 0;
+        auto result = std::from_chars(first, last, value);
+        if (result.ec != std::errc()) {
+            throw ParseError("Line " + std::to_string(literal.line) + 
+                            ", Column " + std::to_string(literal.column) + 
+                            ": Integer literal out of range '" + std::string(literal.value) + "'");
+        }
+        // Literals are i32 unless they need 64 bits
+        bool wide = value > INT32_MAX;
+        return arena.make<NumberLiteral>(value, wide ? ValueType::I64 : ValueType::I32);
     }
     
     if (match({TokenType::IDENTIFIER})) {
-        return std::make_unique<Variable>(previous().value);
+        return arena.make<Variable>(previous().symbol);
     }
     
     if (match({TokenType::LEFT_PAREN})) {
-        std::unique_ptr<Expression> expr = expression();
+        Expression* expr = expression();
         consume(TokenType::RIGHT_PAREN, "Expected ')' after expression");
         return expr;
     }
     
-    Token current_token = peek();
+    const Token& current_token = peek();
     throw ParseError("Line " + std::to_string(current_token.line) + 
                     ", Column " + std::to_string(current_token.column) + 
-                    ": Unexpected token '" + current_token.value + "'");
+                    ": Unexpected token '" + std::string(current_token.value) + "'");
 }
 
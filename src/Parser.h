@@ -3,6 +3,7 @@
 #include "AST.h"
 #include "Token.h"
 #include "Lexer.h"
+#include <array>
 #include <stdexcept>
 
 class ParseError : public std::runtime_error {
@@ -10,43 +11,97 @@ public:
     ParseError(const std::string& msg) : std::runtime_error(msg) {}
 };
 
+// Binding power of each binary operator token; 0 means "not a binary operator".
+// Higher binds tighter; all binary operators are left-associative.
+struct BinaryOperatorInfo {
+    uint8_t precedence;
+    BinaryOp op;
+};
+
 class Parser {
+public:
+    // Expression parsing strategy. Precedence is the default table-driven
+    // parser; Descent is the original one-function-per-level grammar, kept
+    // as a reference for benchmarks.
+    enum class ExpressionMode {
+        Precedence,
+        Descent
+    };
+    
 private:
+    // Token source: tokens are pulled on demand from `lexer`, or from the
+    // pre-tokenized `tokens` vector when the parser was built from one
+    Lexer* lexer;
     std::vector<Token> tokens;
-    size_t current;
+    size_t tokenIndex;
+    
+    // Fixed lookahead ring buffer. It holds previous(), the current token and
+    // up to LOOKAHEAD - 2 tokens of lookahead; absolute token index i lives in
+    // window[i % LOOKAHEAD].
+    static constexpr size_t LOOKAHEAD = 4;
+    std::array<Token, LOOKAHEAD> window;
+    size_t head;    // Absolute index of the current token
+    size_t filled;  // Number of tokens pulled from the source so far
+    
+    // Every node built by this parser is allocated here
+    ASTArena& arena;
     
+    // `import "path";` declarations, in source order, as written
+    std::vector<std::string> importPaths;
+    
+    ExpressionMode expressionMode;
+    size_t expressionDepth;   // Nesting of expression() through call arguments
+    
+    Token fetch();
     bool isAtEnd();
-    Token peek();
-    Token previous();
-    Token advance();
+    const Token& peek(size_t offset = 0);
+    const Token& previous();
+    const Token& advance();
     bool check(TokenType type);
     bool match(std::initializer_list<TokenType> types);
-    Token consume(TokenType type, const std::string& message);
-    
-    // Expression parsing (precedence climbing)
-    std::unique_ptr<Expression> expression();
-    std::unique_ptr<Expression> logicalOr();
-    std::unique_ptr<Expression> logicalAnd();
-    std::unique_ptr<Expression> equality();
-    std::unique_ptr<Expression> comparison();
-    std::unique_ptr<Expression> term();
-    std::unique_ptr<Expression> factor();
-    std::unique_ptr<Expression> unary();
-    std::unique_ptr<Expression> call();
-    std::unique_ptr<Expression> primary();
+    const Token& consume(TokenType type, const std::string& message);
+    
+    // Expression parsing
+    Expression* expression();
+    Expression* precedenceExpression();
+    
+    // Recursive descent (ExpressionMode::Descent)
+    Expression* logicalOr();
+    Expression* logicalAnd();
+    Expression* equality();
+    Expression* comparison();
+    Expression* term();
+    Expression* factor();
+    Expression* unary();
+    Expression* call();
+    Expression* primary();
     
     // Statement parsing
-    std::unique_ptr<Statement> statement();
-    std::unique_ptr<Statement> varDeclaration();
-    std::unique_ptr<Statement> assignment();
-    std::unique_ptr<Statement> ifStatement();
-    std::unique_ptr<Statement> whileStatement();
-    std::unique_ptr<Statement> functionDeclaration();
-    std::unique_ptr<Statement> returnStatement();
-    std::unique_ptr<Statement> expressionStatement();
-    std::unique_ptr<Block> block();
+    Statement* statement();
+    void importDeclaration();
+    Statement* varDeclaration();
+    Statement* assignment();
+    Statement* ifStatement();
+    Statement* whileStatement();
+    Statement* forStatement(bool parallel = false);
+    ReductionOp reductionOp();
+    Statement* annotatedDeclaration();
+    Statement* functionDeclaration(bool memoize = false);
+    Statement* returnStatement();
+    Statement* expressionStatement();
+    Block* block();
+    ValueType type();
+    // `[N]` after a local array's element type
+    uint32_t arrayLength();
     
 public:
-    Parser(std::vector<Token> tokens);
-    std::unique_ptr<Program> parse();
+    // Streaming parser: tokens are pulled from the lexer as parsing proceeds
+    Parser(Lexer& lexer, ASTArena& arena);
+    // Parser over a materialized token vector (as produced by Lexer::tokenize)
+    Parser(std::vector<Token> tokens, ASTArena& arena);
+    // The returned tree lives in the arena passed to the constructor
+    Program* parse();
+    const std::vector<std::string>& imports() const { return importPaths; }
+    
+    void setExpressionMode(ExpressionMode mode) { expressionMode = mode; }
 };
\ No newline at end of file
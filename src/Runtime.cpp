@@ -0,0 +1,339 @@
+// Runtime.cpp - Implementation
+#include "Runtime.h"
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+static_assert(sizeof(SimpleLangTask) == 4 * sizeof(int64_t), "generated code reserves { i8*, i8*, i64, i64 }");
+
+// Chunks per worker; more than one lets idle workers steal from those that
+// drew slower chunks
+constexpr int64_t CHUNKS_PER_WORKER = 4;
+
+// Per-thread output buffer; values are formatted straight into it
+constexpr size_t OUTPUT_BUFFER_SIZE = 1 << 16;
+// Longest value: a shortest round-trip double, sign and exponent included,
+// plus the newline
+constexpr size_t MAX_VALUE_LENGTH = 32;
+
+class OutputBuffer {
+private:
+    std::unique_ptr<char[]> data;
+    size_t used = 0;
+
+public:
+    ~OutputBuffer() { flush(); }
+
+    // Room for MAX_VALUE_LENGTH more bytes, to be committed by commit()
+    char* reserve() {
+        if (!data) {
+            data = std::make_unique<char[]>(OUTPUT_BUFFER_SIZE);
+        }
+        if (OUTPUT_BUFFER_SIZE - used < MAX_VALUE_LENGTH) {
+            flush();
+        }
+        return data.get() + used;
+    }
+
+    void commit(char* end, bool newline) {
+        if (newline) {
+            *end++ = '\n';
+        }
+        used = static_cast<size_t>(end - data.get());
+    }
+
+    void flush() {
+        const char* next = data.get();
+        size_t left = used;
+        while (left > 0) {
+            ssize_t written = ::write(STDOUT_FILENO, next, left);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                break;  // Nowhere to write; drop the output
+            }
+            next += written;
+            left -= static_cast<size_t>(written);
+        }
+        used = 0;
+    }
+};
+
+thread_local OutputBuffer output;
+
+struct Task {
+    void (*run)(void* job, int64_t index);
+    void* job;
+    int64_t index;
+};
+
+// Work-stealing pool. Every worker thread owns a deque and pushes and pops
+// at its back; idle threads steal from the front of the others. Threads
+// outside the pool share one extra deque. A thread waiting for its tasks
+// runs queued work meanwhile, so loops nested in a task cannot deadlock.
+class WorkerPool {
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<int64_t> queued{0};
+    std::atomic<int64_t> sleepers{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    int64_t forkCutoff;
+
+    static thread_local size_t self;
+
+    size_t ownQueue() const { return self < threads.size() ? self : threads.size(); }
+
+    bool pop(Task& task) {
+        size_t own = ownQueue();
+        for (size_t i = 0; i < queues.size(); i++) {
+            size_t victim = (own + i) % queues.size();
+            Queue& queue = *queues[victim];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) continue;
+            if (victim == own) {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+            } else {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+            }
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void work(size_t index) {
+        self = index;
+        Task task;
+        while (true) {
+            if (pop(task)) {
+                task.run(task.job, task.index);
+                continue;
+            }
+            // Paired with submit(): a task queued after the check below
+            // sees this thread counted as a sleeper and wakes it
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepers.fetch_add(1);
+            wake.wait(lock, [&] { return stopping || queued.load() > 0; });
+            sleepers.fetch_sub(1);
+            if (stopping) return;
+        }
+    }
+
+public:
+    explicit WorkerPool(size_t workers) : forkCutoff(4) {
+        for (size_t count = 1; count < workers; count *= 2) {
+            forkCutoff++;
+        }
+        // The calling thread is one of the workers
+        for (size_t i = 0; i < workers; i++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i + 1 < workers; i++) {
+            threads.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    static WorkerPool& instance() {
+        static WorkerPool pool([] {
+            const char* threads = std::getenv("SIMPLELANG_THREADS");
+            long count = threads ? std::strtol(threads, nullptr, 10) : 0;
+            if (count <= 0) count = static_cast<long>(std::thread::hardware_concurrency());
+            return static_cast<size_t>(std::max(count, 1L));
+        }());
+        return pool;
+    }
+
+    size_t workers() const { return queues.size(); }
+    // Nesting of forks below which another fork is worth queueing: log2 of
+    // the worker count plus 4
+    int64_t cutoff() const { return forkCutoff; }
+
+    void submit(const Task* tasks, size_t count) {
+        Queue& queue = *queues[ownQueue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.insert(queue.tasks.end(), tasks, tasks + count);
+        }
+        queued.fetch_add(static_cast<int64_t>(count));
+        if (sleepers.load() > 0) {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            wake.notify_all();
+        }
+    }
+
+    // Run queued tasks until `remaining` drops to zero
+    void wait(const std::atomic<int64_t>& remaining) {
+        Task task;
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (pop(task)) {
+                task.run(task.job, task.index);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+};
+
+// Outside threads get an index past every worker
+thread_local size_t WorkerPool::self = SIZE_MAX;
+
+// Forks and parallel loops enclosing the code running on this thread
+thread_local int64_t forkDepth = 0;
+
+// Runs a task's code at the depth it was queued from
+class DepthScope {
+private:
+    int64_t saved;
+
+public:
+    explicit DepthScope(int64_t depth) : saved(forkDepth) { forkDepth = depth; }
+    ~DepthScope() { forkDepth = saved; }
+};
+
+struct LoopJob {
+    SimpleLangLoopBody body;
+    void* context;
+    int64_t begin;
+    uint64_t base;   // Iterations in every chunk...
+    uint64_t extra;  // ...plus one more in the first `extra` chunks
+    int64_t depth;
+    std::atomic<int64_t> remaining;
+};
+
+void runChunk(void* job, int64_t index) {
+    auto* loop = static_cast<LoopJob*>(job);
+    uint64_t chunk = static_cast<uint64_t>(index);
+    uint64_t first = chunk * loop->base + std::min(chunk, loop->extra);
+    uint64_t count = loop->base + (chunk < loop->extra ? 1 : 0);
+    int64_t begin = static_cast<int64_t>(static_cast<uint64_t>(loop->begin) + first);
+    {
+        DepthScope scope(loop->depth);
+        loop->body(loop->context, index, begin, static_cast<int64_t>(static_cast<uint64_t>(begin) + count));
+    }
+    output.flush();
+    loop->remaining.fetch_sub(1, std::memory_order_release);
+}
+
+void runForked(void* job, int64_t) {
+    auto* task = static_cast<SimpleLangTask*>(job);
+    {
+        DepthScope scope(task->depth);
+        task->run(task->frame);
+    }
+    task->pending.store(0, std::memory_order_release);
+}
+
+} // namespace
+
+extern "C" int64_t simplelang_parallel_for(SimpleLangLoopBody body, void* context, int64_t begin, int64_t end) {
+    if (end <= begin) {
+        return 0;
+    }
+    uint64_t count = static_cast<uint64_t>(end) - static_cast<uint64_t>(begin);
+    WorkerPool& pool = WorkerPool::instance();
+    if (pool.workers() == 1) {
+        body(context, 0, begin, end);
+        return 1;
+    }
+    int64_t chunks = std::min<int64_t>(static_cast<int64_t>(pool.workers()) * CHUNKS_PER_WORKER,
+                                       SIMPLELANG_MAX_CHUNKS);
+    if (count < static_cast<uint64_t>(chunks)) {
+        chunks = static_cast<int64_t>(count);
+    }
+
+    // What the caller printed before the loop comes before any chunk's output
+    output.flush();
+    LoopJob job{body, context, begin, count / chunks, count % chunks, forkDepth + 1, {chunks}};
+    std::vector<Task> tasks;
+    tasks.reserve(chunks);
+    // Pushed last-chunk-first, so the owner pops chunk 0 first and thieves
+    // take the far end of the range
+    for (int64_t i = chunks - 1; i >= 0; i--) {
+        tasks.push_back(Task{runChunk, &job, i});
+    }
+    pool.submit(tasks.data(), tasks.size());
+    pool.wait(job.remaining);
+    return chunks;
+}
+
+extern "C" int32_t simplelang_should_fork(void) {
+    WorkerPool& pool = WorkerPool::instance();
+    return pool.workers() > 1 && forkDepth < pool.cutoff();
+}
+
+extern "C" void simplelang_fork(SimpleLangTask* task, void (*run)(void* frame), void* frame) {
+    task->run = run;
+    task->frame = frame;
+    task->pending.store(1, std::memory_order_relaxed);
+    task->depth = ++forkDepth;
+    Task queued{runForked, task, 0};
+    WorkerPool::instance().submit(&queued, 1);
+}
+
+extern "C" void simplelang_join(SimpleLangTask* task) {
+    forkDepth--;
+    WorkerPool::instance().wait(task->pending);
+}
+
+extern "C" void simplelang_print_i64(int64_t value, int32_t newline) {
+    char* start = output.reserve();
+    output.commit(std::to_chars(start, start + MAX_VALUE_LENGTH, value).ptr, newline);
+}
+
+extern "C" void simplelang_print_f64(double value, int32_t newline) {
+    char* start = output.reserve();
+    output.commit(std::to_chars(start, start + MAX_VALUE_LENGTH, value).ptr, newline);
+}
+
+extern "C" void simplelang_print_newline(void) {
+    output.commit(output.reserve(), true);
+}
+
+extern "C" void simplelang_flush(void) {
+    output.flush();
+}
+
+const std::vector<std::pair<const char*, void*>>& runtimeSymbols() {
+    static const std::vector<std::pair<const char*, void*>> symbols = {
+        {"simplelang_parallel_for", reinterpret_cast<void*>(&simplelang_parallel_for)},
+        {"simplelang_should_fork", reinterpret_cast<void*>(&simplelang_should_fork)},
+        {"simplelang_fork", reinterpret_cast<void*>(&simplelang_fork)},
+        {"simplelang_join", reinterpret_cast<void*>(&simplelang_join)},
+        {"simplelang_print_i64", reinterpret_cast<void*>(&simplelang_print_i64)},
+        {"simplelang_print_f64", reinterpret_cast<void*>(&simplelang_print_f64)},
+        {"simplelang_print_newline", reinterpret_cast<void*>(&simplelang_print_newline)},
+        {"simplelang_flush", reinterpret_cast<void*>(&simplelang_flush)},
+    };
+    return symbols;
+}
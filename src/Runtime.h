@@ -0,0 +1,59 @@
+// Runtime.h - Support library that compiled programs call into
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Generated code calls the C entry points below. The JIT binds them to the
+// driver's own copies; native executables link the simplelang_runtime
+// static library.
+
+// A parallel loop never uses more chunks than this, so generated code can
+// keep per-chunk partial results in fixed-size stack arrays
+constexpr int64_t SIMPLELANG_MAX_CHUNKS = 256;
+
+extern "C" {
+
+// Runs iterations [begin, end) of an outlined loop body as chunk `chunk`
+typedef void (*SimpleLangLoopBody)(void* context, int64_t chunk, int64_t begin, int64_t end);
+
+// Split [begin, end) into contiguous chunks, run them on the worker pool and
+// return once every chunk has finished. Returns the number of chunks, 0 for
+// an empty range; chunk k covers lower indices than chunk k + 1. The pool
+// has one worker per hardware thread, or SIMPLELANG_THREADS if set.
+int64_t simplelang_parallel_for(SimpleLangLoopBody body, void* context, int64_t begin, int64_t end);
+
+// A call forked by --auto-parallel. Generated code reserves the storage as
+// { i8*, i8*, i64, i64 } and the runtime fills it in.
+struct SimpleLangTask {
+    void (*run)(void* frame);
+    void* frame;
+    std::atomic<int64_t> pending;
+    int64_t depth;
+};
+
+// Whether forking a call here could pay off: there is more than one worker
+// and the caller is nested in fewer forks than the cutoff, which allows
+// about 16 tasks per worker
+int32_t simplelang_should_fork(void);
+// Queue run(frame) for any worker; the caller must join the task before
+// its storage or frame go out of scope
+void simplelang_fork(SimpleLangTask* task, void (*run)(void* frame), void* frame);
+// Wait for a forked task, running queued work (usually the task itself)
+void simplelang_join(SimpleLangTask* task);
+
+// print() and println(). Each thread appends to its own buffer, which goes
+// out in one write(2) when it fills, when the thread finishes a parallel
+// loop chunk and on simplelang_flush(); the chunks of a loop are written in
+// the order they finish. Values end with a newline if `newline` is set.
+void simplelang_print_i64(int64_t value, int32_t newline);
+void simplelang_print_f64(double value, int32_t newline);
+void simplelang_print_newline(void);
+// Write out the calling thread's buffered output
+void simplelang_flush(void);
+
+}
+
+// Name and address of every entry point, for binding them in the JIT
+const std::vector<std::pair<const char*, void*>>& runtimeSymbols();
@@ -0,0 +1,110 @@
+// SourceFile.cpp - Implementation
+#include "SourceFile.h"
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SIMPLELANG_HAVE_MMAP 1
+#endif
+
+SourceFile::SourceFile() : mapping(nullptr), length(0) {}
+
+SourceFile::SourceFile(SourceFile&& other) noexcept
+    : path(std::move(other.path)), buffer(std::move(other.buffer)),
+      mapping(other.mapping), length(other.length) {
+    other.mapping = nullptr;
+    other.length = 0;
+}
+
+SourceFile& SourceFile::operator=(SourceFile&& other) noexcept {
+    if (this != &other) {
+        release();
+        path = std::move(other.path);
+        buffer = std::move(other.buffer);
+        mapping = other.mapping;
+        length = other.length;
+        other.mapping = nullptr;
+        other.length = 0;
+    }
+    return *this;
+}
+
+SourceFile::~SourceFile() {
+    release();
+}
+
+void SourceFile::release() {
+#ifdef SIMPLELANG_HAVE_MMAP
+    if (mapping) {
+        munmap(const_cast<char*>(mapping), length);
+    }
+#endif
+    mapping = nullptr;
+    length = 0;
+}
+
+SourceFile SourceFile::map(const std::string& filename) {
+#ifdef SIMPLELANG_HAVE_MMAP
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + filename);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        ::close(fd);
+        return read(filename);
+    }
+
+    void* addr = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping stays valid after the descriptor is closed
+    if (addr == MAP_FAILED) {
+        return read(filename);
+    }
+    madvise(addr, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+
+    SourceFile file;
+    file.path = filename;
+    file.mapping = static_cast<const char*>(addr);
+    file.length = static_cast<size_t>(info.st_size);
+    return file;
+#else
+    return read(filename);
+#endif
+}
+
+SourceFile SourceFile::read(const std::string& filename) {
+    std::ifstream stream(filename, std::ios::binary | std::ios::ate);
+    if (!stream.is_open()) {
+        throw std::runtime_error("Cannot open file: " + filename);
+    }
+
+    SourceFile file;
+    file.path = filename;
+
+    std::streamoff size = stream.tellg();
+    if (size > 0) {
+        file.buffer.resize(static_cast<size_t>(size));
+        stream.seekg(0);
+        stream.read(&file.buffer[0], size);
+    } else {
+        // Size unknown (e.g. a pipe): fall back to chunked reads
+        stream.clear();
+        char chunk[65536];
+        while (stream.read(chunk, sizeof(chunk)) || stream.gcount() > 0) {
+            file.buffer.append(chunk, static_cast<size_t>(stream.gcount()));
+        }
+    }
+    return file;
+}
+
+std::string_view SourceFile::text() const {
+    if (mapping) {
+        return std::string_view(mapping, length);
+    }
+    return std::string_view(buffer);
+}
@@ -0,0 +1,32 @@
+// SourceFile.h - Read-only view of a source file (memory-mapped or buffered)
+#pragma once
+#include <string>
+#include <string_view>
+
+class SourceFile {
+private:
+    std::string path;
+    std::string buffer;       // Used when the file is read rather than mapped
+    const char* mapping;      // Start of the mmap'ed region, or nullptr
+    size_t length;
+
+    void release();
+
+public:
+    SourceFile();
+    SourceFile(SourceFile&& other) noexcept;
+    SourceFile& operator=(SourceFile&& other) noexcept;
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+    ~SourceFile();
+
+    // Map the file into memory. Falls back to reading it when the file
+    // cannot be mapped (empty files, pipes, platforms without mmap).
+    static SourceFile map(const std::string& filename);
+    // Read the whole file into an owned buffer with a single copy.
+    static SourceFile read(const std::string& filename);
+
+    std::string_view text() const;
+    const std::string& name() const { return path; }
+    bool isMapped() const { return mapping != nullptr; }
+};
@@ -0,0 +1,51 @@
+// SymbolTable.cpp - Implementation
+#include "SymbolTable.h"
+#include <mutex>
+#include <stdexcept>
+
+SymbolTable& SymbolTable::global() {
+    static SymbolTable table;
+    return table;
+}
+
+Symbol SymbolTable::intern(std::string_view name) {
+    // The top bits pick the shard; the low ones go to the shard's buckets
+    size_t hash = std::hash<std::string_view>()(name);
+    Shard& shard = shards[hash >> (sizeof(size_t) * 8 - SHARD_BITS)];
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.ids.find(name);
+        if (it != shard.ids.end()) {
+            return it->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.ids.find(name);
+    if (it != shard.ids.end()) {
+        return it->second;
+    }
+    Symbol symbol = static_cast<Symbol>(shard.names.size() << SHARD_BITS | (&shard - shards.data()));
+    shard.names.emplace_back(name);
+    shard.ids.emplace(shard.names.back(), symbol);
+    return symbol;
+}
+
+const std::string& SymbolTable::name(Symbol symbol) const {
+    const Shard& shard = shards[symbol & (SHARDS - 1)];
+    size_t index = symbol >> SHARD_BITS;
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    if (index >= shard.names.size()) {
+        throw std::out_of_range("Unknown symbol id " + std::to_string(symbol));
+    }
+    return shard.names[index];
+}
+
+size_t SymbolTable::size() const {
+    size_t total = 0;
+    for (const Shard& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.names.size();
+    }
+    return total;
+}
@@ -0,0 +1,42 @@
+// SymbolTable.h - Interned identifiers
+#pragma once
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Small integer handle for an interned identifier. Two identifiers with the
+// same spelling always intern to the same Symbol, so names can be compared
+// and hashed as integers after lexing.
+using Symbol = uint32_t;
+
+class SymbolTable {
+private:
+    // Identifiers are spread over shards by hash so lexers on different
+    // threads rarely wait for one another. A Symbol's low bits name its
+    // shard and the rest its index there.
+    static constexpr unsigned SHARD_BITS = 6;
+    static constexpr size_t SHARDS = size_t(1) << SHARD_BITS;
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::deque<std::string> names;                    // Never moves
+        std::unordered_map<std::string_view, Symbol> ids; // Keys view into `names`
+    };
+    std::array<Shard, SHARDS> shards;
+
+public:
+    // Process-wide table shared by every Lexer, Parser and CodeGenerator
+    static SymbolTable& global();
+
+    Symbol intern(std::string_view name);
+    const std::string& name(Symbol symbol) const;
+    size_t size() const;
+};
+
+inline const std::string& symbolName(Symbol symbol) {
+    return SymbolTable::global().name(symbol);
+}
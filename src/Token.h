@@ -1,12 +1,14 @@
 // Token.h - Token definitions and types
 #pragma once
-#include <string>
-#include <unordered_map>
+#include "SymbolTable.h"
+#include <cstdint>
+#include <string_view>
 
-enum class TokenType {
+enum class TokenType : uint8_t {
     // Literals
     NUMBER,
     IDENTIFIER,
+    STRING,
     
     // Keywords
     VAR,
@@ -17,6 +19,10 @@ enum class TokenType {
     RETURN,
     TRUE,
     FALSE,
+    IMPORT,
+    FOR,
+    IN,
+    PARALLEL,
     
     // Operators
     PLUS,
@@ -43,20 +49,30 @@ enum class TokenType {
     RIGHT_PAREN,
     LEFT_BRACE,
     RIGHT_BRACE,
+    LEFT_BRACKET,
+    RIGHT_BRACKET,
     COMMA,
+    COLON,
     SEMICOLON,
+    DOT_DOT,
+    AT,
     
     // Special
     END_OF_FILE,
     UNKNOWN
 };
 
+// Tokens do not own their text: `value` is a view into the source buffer
+// handed to the Lexer, which must outlive every token produced from it.
+// Identifier tokens also carry their interned Symbol.
 struct Token {
     TokenType type;
-    std::string value;
+    Symbol symbol;
+    std::string_view value;
     int line;
     int column;
     
-    Token(TokenType t, const std::string& v, int l, int c)
-        : type(t), value(v), line(l), column(c) {}
+    Token() : type(TokenType::END_OF_FILE), symbol(0), line(0), column(0) {}
+    Token(TokenType t, std::string_view v, int l, int c, Symbol s = 0)
+        : type(t), symbol(s), value(v), line(l), column(c) {}
 };
\ No newline at end of file
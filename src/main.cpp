@@ -2,43 +2,100 @@
 #include "Lexer.h"
 #include "Parser.h"
 #include "CodeGen.h"
+#include "Compilation.h"
+#include "ConstEval.h"
+#include "SourceFile.h"
+#include "IncrementalCache.h"
+#include "JITCache.h"
+#include "NativeLinker.h"
+#include "CompileServer.h"
+#include <llvm/Support/Path.h>
+#include <charconv>
+#include <cstring>
 #include <iostream>
-#include <fstream>
-#include <sstream>
-
-std::string readFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        throw std::runtime_error("Cannot open file: " + filename);
-    }
-    
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
-}
+#include <optional>
 
 void printUsage(const char* programName) {
-    std::cout << "Usage: " << programName << " [options] <input_file>\n";
+    std::cout << "Usage: " << programName << " [options] <input_file>...\n";
     std::cout << "Options:\n";
     std::cout << "  -h, --help        Show this help message\n";
     std::cout << "  -t, --tokens      Print tokens and exit\n";
     std::cout << "  -a, --ast         Print AST (not implemented yet) and exit\n";
     std::cout << "  -i, --ir          Print LLVM IR and exit\n";
-    std::cout << "  -o, --output      Specify output file for IR\n";
+    std::cout << "  -o, --output      Specify output file (IR, or the -c/-S/--exe output)\n";
+    std::cout << "  -c                Compile to a native object file (.o)\n";
+    std::cout << "  -S                Compile to native assembly (.s)\n";
+    std::cout << "  --exe             Compile and link a standalone executable\n";
+    std::cout << "  --emit-header <file>  Write C declarations of the compiled functions\n";
     std::cout << "  -r, --run         Compile and run with JIT\n";
+    std::cout << "  -j, --jobs <N>    Worker threads for parsing and code generation (default: all cores)\n";
+    std::cout << "  -m, --mmap        Memory-map the input file instead of reading it\n";
+    std::cout << "  --stats           Print AST arena allocation statistics\n";
+    std::cout << "  --flat            Generate code from the compact flattened AST\n";
+    std::cout << "  --ssa             Build SSA form directly instead of stack slots\n";
+    std::cout << "  --memoize         Memoize every function that recurses more than once\n";
+    std::cout << "  --fast-math       Allow reassociating and contracting f64 arithmetic\n";
+    std::cout << "  --auto-parallel   Run the two calls of f(a) + g(b) in parallel when worthwhile\n";
+    std::cout << "  --const-eval      Evaluate calls on constant arguments at compile time (on at -O1+)\n";
+    std::cout << "  --const-eval-budget <N>  Interpreter steps allowed per constant call (default 1000000)\n";
+    std::cout << "  --incremental <dir>  Reuse per-function IR cached in <dir>\n";
+    std::cout << "  --jit-cache <dir>    Reuse JIT machine code for unchanged programs (-r)\n";
+    std::cout << "  --jit-cache-size <MB>  Evict cached objects beyond this size (default 512)\n";
+    std::cout << "  -O0, -O1, -O2, -O3   Optimization level (default -O0)\n";
+    std::cout << "  --time-passes     Print per-pass optimization timings\n";
+    std::cout << "  --server <socket>    Keep LLVM warm and run compiles sent to <socket> (-j requests at once)\n";
+    std::cout << "  --connect <socket>   Run this command on the server listening on <socket>\n";
+    std::cout << "  --each            With --connect, compile every input as its own program\n";
 }
 
-int main(int argc, char* argv[]) {
-    std::string inputFile;
+void printJITCacheStats(const char* outcome, const JITCacheStats& stats) {
+    std::cout << "✓ JIT cache " << outcome << " (" << stats.hits << " hits, " << stats.misses
+              << " misses, " << stats.evictions << " evictions)\n";
+}
+
+// An option's numeric value; false unless all of `text` is a number that fits
+template <typename T>
+bool parseNumber(const char* text, T& value) {
+    const char* end = text + std::strlen(text);
+    auto result = std::from_chars(text, end, value);
+    return result.ec == std::errc() && result.ptr == end && end != text;
+}
+
+// One compiler invocation; children of the compile server run it too
+int runDriver(int argc, char* argv[]) {
+    std::vector<std::string> inputFiles;
     std::string outputFile;
     bool printTokens = false;
     bool printAST = false;
     bool printIR = false;
     bool runJIT = false;
+    bool mapInput = false;
+    bool printStats = false;
+    bool useFlatAST = false;
+    CodeGenOptions codeGenOptions;
+    std::string incrementalDir;
+    int optLevel = 0;
+    bool timePasses = false;
+    bool emitObject = false;
+    bool emitAssembly = false;
+    bool emitExecutable = false;
+    std::string headerFile;
+    std::string jitCacheDir;
+    uint64_t jitCacheMB = 512;
+    bool constEval = false;
+    unsigned jobs = 0;
+    uint64_t constEvalBudget = 1000000;
+    std::string serverSocket;
+    std::string connectSocket;
+    bool each = false;
+    // Arguments passed on by --connect, and all but the inputs for --each
+    std::vector<std::string> forwarded;
+    std::vector<std::string> options;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
+        int first = i;
         
         if (arg == "-h" || arg == "--help") {
             printUsage(argv[0]);
@@ -51,6 +108,74 @@ int main(int argc, char* argv[]) {
             printIR = true;
         } else if (arg == "-r" || arg == "--run") {
             runJIT = true;
+        } else if (arg == "-m" || arg == "--mmap") {
+            mapInput = true;
+        } else if (arg == "--stats") {
+            printStats = true;
+        } else if (arg == "--flat") {
+            useFlatAST = true;
+        } else if (arg == "--memoize") {
+            codeGenOptions.memoize = true;
+        } else if (arg == "--fast-math") {
+            codeGenOptions.fastMath = true;
+        } else if (arg == "--auto-parallel") {
+            codeGenOptions.autoParallel = true;
+        } else if (arg == "-j" || arg == "--jobs") {
+            if (i + 1 < argc && parseNumber(argv[i + 1], jobs)) {
+                i++;
+            } else {
+                std::cerr << "Error: -j requires a thread count\n";
+                return 1;
+            }
+        } else if (arg == "--const-eval") {
+            constEval = true;
+        } else if (arg == "--const-eval-budget") {
+            if (i + 1 < argc && parseNumber(argv[i + 1], constEvalBudget)) {
+                i++;
+            } else {
+                std::cerr << "Error: --const-eval-budget requires a step count\n";
+                return 1;
+            }
+        } else if (arg == "--ssa") {
+            codeGenOptions.ssa = true;
+        } else if (arg == "-O0" || arg == "-O1" || arg == "-O2" || arg == "-O3") {
+            optLevel = arg[2] - '0';
+        } else if (arg == "--time-passes") {
+            timePasses = true;
+        } else if (arg == "-c") {
+            emitObject = true;
+        } else if (arg == "-S") {
+            emitAssembly = true;
+        } else if (arg == "--exe") {
+            emitExecutable = true;
+        } else if (arg == "--emit-header") {
+            if (i + 1 < argc) {
+                headerFile = argv[++i];
+            } else {
+                std::cerr << "Error: --emit-header requires an output filename\n";
+                return 1;
+            }
+        } else if (arg == "--jit-cache") {
+            if (i + 1 < argc) {
+                jitCacheDir = argv[++i];
+            } else {
+                std::cerr << "Error: --jit-cache requires a cache directory\n";
+                return 1;
+            }
+        } else if (arg == "--jit-cache-size") {
+            if (i + 1 < argc && parseNumber(argv[i + 1], jitCacheMB)) {
+                i++;
+            } else {
+                std::cerr << "Error: --jit-cache-size requires a size in MB\n";
+                return 1;
+            }
+        } else if (arg == "--incremental") {
+            if (i + 1 < argc) {
+                incrementalDir = argv[++i];
+            } else {
+                std::cerr << "Error: --incremental requires a cache directory\n";
+                return 1;
+            }
         } else if (arg == "-o" || arg == "--output") {
             if (i + 1 < argc) {
                 outputFile = argv[++i];
@@ -58,44 +183,130 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Error: -o requires an output filename\n";
                 return 1;
             }
+        } else if (arg == "--server" || arg == "--connect") {
+            if (i + 1 < argc) {
+                (arg == "--server" ? serverSocket : connectSocket) = argv[++i];
+            } else {
+                std::cerr << "Error: " << arg << " requires a socket path\n";
+                return 1;
+            }
+            continue;
+        } else if (arg == "--each") {
+            each = true;
+            continue;
         } else if (arg.front() != '-') {
-            inputFile = arg;
+            inputFiles.push_back(arg);
+            forwarded.push_back(arg);
+            continue;
         } else {
             std::cerr << "Error: Unknown option " << arg << "\n";
             printUsage(argv[0]);
             return 1;
         }
+        forwarded.insert(forwarded.end(), argv + first, argv + i + 1);
+        options.insert(options.end(), argv + first, argv + i + 1);
     }
     
-    if (inputFile.empty()) {
+    if (!serverSocket.empty()) {
+        if (!connectSocket.empty() || !inputFiles.empty()) {
+            std::cerr << "Error: --server takes no input files and cannot be combined with --connect\n";
+            return 1;
+        }
+        try {
+            CompileServer server(serverSocket, jobs);
+            return server.serve(runDriver);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+    }
+    
+    if (inputFiles.empty()) {
         std::cerr << "Error: No input file specified\n";
         printUsage(argv[0]);
         return 1;
     }
     
+    if (each && connectSocket.empty()) {
+        std::cerr << "Error: --each requires --connect\n";
+        return 1;
+    }
+    if (!connectSocket.empty()) {
+        // The server checks the remaining options itself
+        std::vector<std::vector<std::string>> commandLines;
+        if (each) {
+            for (const std::string& input : inputFiles) {
+                commandLines.push_back(options);
+                commandLines.back().push_back(input);
+            }
+        } else {
+            commandLines.push_back(forwarded);
+        }
+        try {
+            CompileClient client(connectSocket);
+            return client.run(commandLines, each, printStats);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+    }
+    
+    if (emitObject + emitAssembly + emitExecutable > 1) {
+        std::cerr << "Error: -c, -S and --exe are mutually exclusive\n";
+        return 1;
+    }
+    bool emitNative = emitObject || emitAssembly || emitExecutable;
+    if (emitNative && (runJIT || printIR)) {
+        std::cerr << "Error: -c, -S and --exe cannot be combined with -r or -i\n";
+        return 1;
+    }
+    constEval = constEval || optLevel > 0;
+    
     try {
-        // Read input file
-        std::string sourceCode = readFile(inputFile);
-        std::cout << "Compiling: " << inputFile << "\n\n";
-        
-        // Lexical analysis
-        Lexer lexer(sourceCode);
-        std::vector<Token> tokens = lexer.tokenize();
+        // The first input names the outputs
+        const std::string& inputFile = inputFiles.front();
+        std::cout << "Compiling: " << inputFile;
+        for (size_t i = 1; i < inputFiles.size(); i++) {
+            std::cout << ", " << inputFiles[i];
+        }
+        std::cout << "\n\n";
         
         if (printTokens) {
+            SourceFile source = mapInput ? SourceFile::map(inputFile) : SourceFile::read(inputFile);
+            Lexer lexer(source.text());
             std::cout << "=== TOKENS ===\n";
-            for (const auto& token : tokens) {
+            Token token;
+            do {
+                token = lexer.nextToken();
                 std::cout << "Line " << token.line << ", Col " << token.column 
                          << ": " << static_cast<int>(token.type) 
                          << " '" << token.value << "'\n";
-            }
+            } while (token.type != TokenType::END_OF_FILE);
             return 0;
         }
         
-        // Parsing
-        Parser parser(tokens);
-        std::unique_ptr<Program> ast = parser.parse();
-        std::cout << "✓ Parsing completed successfully\n";
+        // Parse the inputs and every file they import (tokens are pulled from
+        // each file's lexer on demand). Each file's buffer and AST arena live
+        // in `compilation` until main returns.
+        Compilation compilation(jobs, mapInput);
+        compilation.load(inputFiles);
+        const auto& units = compilation.sources();
+        bool multiFile = units.size() > 1;
+        if (multiFile) {
+            std::cout << "✓ Parsing completed successfully (" << units.size() << " files)\n";
+        } else {
+            std::cout << "✓ Parsing completed successfully\n";
+        }
+        
+        if (printStats) {
+            for (const auto& unit : units) {
+                const ASTArena& arena = *unit->arena;
+                std::cout << (multiFile ? unit->path + ": " : "") << "AST arena: " << arena.nodeCount()
+                          << " nodes, " << arena.bytesAllocated() << " bytes allocated, "
+                          << arena.bytesReservedTotal() << " bytes reserved in "
+                          << arena.chunkCount() << " chunk(s)\n";
+            }
+        }
         
         if (printAST) {
             std::cout << "=== AST ===\n";
@@ -103,25 +314,140 @@ int main(int argc, char* argv[]) {
             return 0;
         }
         
-        // Code generation
-        CodeGenerator codeGen;
-        codeGen.generate(*ast);
+        // A cached object for this exact program and configuration
+        // replaces the whole compile
+        std::unique_ptr<JITCache> jitCache;
+        std::string jitCacheKey;
+        if (runJIT && !jitCacheDir.empty() && outputFile.empty() && headerFile.empty()) {
+            jitCache = std::make_unique<JITCache>(jitCacheDir, jitCacheMB * 1024 * 1024);
+            jitCacheKey = JITCache::key(compilation.fingerprint(), optLevel, codeGenOptions.key());
+            std::string object;
+            if (jitCache->lookup(jitCacheKey, object)) {
+                printJITCacheStats("hit", jitCache->stats());
+                std::cout << "\n=== EXECUTING WITH JIT ===\n";
+                int result = CodeGenerator::executeObject(object, optLevel);
+                std::cout << "Program executed successfully\n";
+                std::cout << "Return value: " << result << "\n";
+                return 0;
+            }
+        }
+        
+        // Created only once there is code to generate; a program evaluated
+        // entirely at compile time never touches LLVM
+        std::unique_ptr<CodeGenerator> codeGen;
+        bool generated = false;
+        OptimizationStage stage = OptimizationStage::Standalone;
+        
+        if (!incrementalDir.empty() && multiFile) {
+            std::cout << "Note: --incremental supports single-file programs; compiling without the cache\n";
+        } else if (!incrementalDir.empty()) {
+            codeGen = std::make_unique<CodeGenerator>();
+            codeGen->setOptions(codeGenOptions);
+            IncrementalCache cache(incrementalDir);
+            IncrementalStats stats;
+            generated = cache.compile(inputFile, units[0]->source.text(), *codeGen, stats);
+            if (generated) {
+                std::cout << "✓ Incremental build: " << stats.reused << " function(s) reused, "
+                          << stats.regenerated << " regenerated\n";
+            } else {
+                std::cout << "Note: top-level code outside functions; compiling without the cache\n";
+            }
+        }
+        
+        if (!generated) {
+            if (constEval) {
+                // Every file's functions are visible to folded calls
+                ConstEvaluator evaluator(*units[0]->arena, constEvalBudget);
+                for (const auto& unit : units) {
+                    evaluator.addProgram(*unit->program);
+                }
+                bool onlyRun = runJIT && !printIR && outputFile.empty() && headerFile.empty();
+                std::optional<int32_t> result;
+                if (onlyRun && !codeGen) {
+                    result = evaluator.evaluateMain();
+                }
+                if (result) {
+                    std::cout << "✓ Program evaluated at compile time\n";
+                    std::cout << "Program executed successfully\n";
+                    std::cout << "Return value: " << *result << "\n";
+                    return 0;
+                }
+                for (const auto& unit : units) {
+                    evaluator.fold(*unit->program);
+                }
+                const ConstEvalStats& folded = evaluator.stats();
+                std::cout << "✓ Constant evaluation: " << folded.foldedExpressions << " expression(s) and "
+                          << folded.foldedCalls << " call(s) folded, " << folded.abandonedCalls
+                          << " call(s) left for run time\n";
+            }
+            
+            // Code generation
+            if (!codeGen) {
+                codeGen = std::make_unique<CodeGenerator>();
+                codeGen->setOptions(codeGenOptions);
+            }
+            // Parallel across functions when there are enough of them
+            stage = compilation.generate(*codeGen, optLevel, useFlatAST, printStats);
+        }
         std::cout << "✓ Code generation completed successfully\n";
         
+        codeGen->optimize(optLevel, timePasses, stage);
+        if (optLevel > 0) {
+            std::cout << "✓ Optimized at -O" << optLevel << "\n";
+        }
+        
         if (printIR) {
             std::cout << "\n=== LLVM IR ===\n";
-            codeGen.dumpIR();
+            codeGen->dumpIR();
+            return 0;
+        }
+        
+        if (!headerFile.empty()) {
+            codeGen->writeCHeader(headerFile, inputFile);
+            std::cout << "✓ C header written to " << headerFile << "\n";
+        }
+        
+        if (emitNative) {
+            // Default output: the input's name with the extension replaced
+            llvm::SmallString<128> stemPath(inputFile);
+            llvm::sys::path::replace_extension(stemPath, "");
+            std::string stem = stemPath.str().str();
+            if (emitObject) {
+                std::string objectFile = outputFile.empty() ? stem + ".o" : outputFile;
+                codeGen->writeObjectFile(objectFile);
+                std::cout << "✓ Object file written to " << objectFile << "\n";
+            } else if (emitAssembly) {
+                std::string assemblyFile = outputFile.empty() ? stem + ".s" : outputFile;
+                codeGen->writeAssemblyFile(assemblyFile);
+                std::cout << "✓ Assembly written to " << assemblyFile << "\n";
+            } else {
+                std::string executable = outputFile.empty() ? stem : outputFile;
+                NativeLinker linker;
+                std::string objectFile = linker.temporaryFile("simplelang", "o");
+                codeGen->writeObjectFile(objectFile);
+                linker.addInput(objectFile);
+                linker.link(executable);
+                std::cout << "✓ Executable written to " << executable << "\n";
+            }
             return 0;
         }
         
         if (!outputFile.empty()) {
-            codeGen.writeIRToFile(outputFile);
+            codeGen->writeIRToFile(outputFile);
             std::cout << "✓ IR written to " << outputFile << "\n";
         }
         
         if (runJIT) {
             std::cout << "\n=== EXECUTING WITH JIT ===\n";
-            int result = codeGen.executeJIT();
+            int result;
+            if (jitCache) {
+                std::string object = codeGen->objectCode();
+                jitCache->store(jitCacheKey, object);
+                printJITCacheStats("miss", jitCache->stats());
+                result = CodeGenerator::executeObject(object, optLevel);
+            } else {
+                result = codeGen->executeJIT();
+            }
             std::cout << "Program executed successfully\n";
             std::cout << "Return value: " << result << "\n";
         }
@@ -138,4 +464,8 @@ int main(int argc, char* argv[]) {
     }
     
     return 0;
+}
+
+int main(int argc, char* argv[]) {
+    return runDriver(argc, argv);
 }
\ No newline at end of file
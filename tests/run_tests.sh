@@ -44,8 +44,452 @@ else
     echo "❌ FAIL (got $result)"
 fi
 
+echo "Test 6: --incremental regenerates only an edited function (2 reused, 1 regenerated; 10 then 11)"
+work=$(mktemp -d)
+cat > "$work/calls.sl" << 'EOF'
+function square(n) {
+    return n * n;
+}
+
+function add(a, b) {
+    return a + square(b);
+}
+
+function main() {
+    return add(1, 3);
+}
+EOF
+first=$(./build/simplelang -r --incremental "$work/cache" "$work/calls.sl" | grep "Return value:" | cut -d' ' -f3)
+sed -i 's/return a + square(b);/return a + square(b) + 1;/' "$work/calls.sl"
+second=$(./build/simplelang -r --incremental "$work/cache" "$work/calls.sl")
+result="$first $(echo "$second" | grep -o "[0-9]* function(s) reused, [0-9]* regenerated") $(echo "$second" | grep "Return value:" | cut -d' ' -f3)"
+if [ "$result" = "10 2 function(s) reused, 1 regenerated 11" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 7: --incremental does not reuse a caller whose callee changed signature"
+sed -i 's/function square(n) {/function square(n, m) {/; s/return n \* n;/return n * m;/' "$work/calls.sl"
+result=$(./build/simplelang -r --incremental "$work/cache" "$work/calls.sl" 2>&1 | grep -o "Incorrect number of arguments passed to function: square")
+rm -rf "$work"
+if [ -n "$result" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (stale caller reused)"
+fi
+
+echo "Test 8: Accumulating tail recursion in constant stack at -O0 (count(10000000) = 10000000)"
+result=$(./build/simplelang -O0 -r demos/tail_recursion.sl | grep "Return value:" | cut -d' ' -f3)
+if [ "$result" = "10000000" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 9: @memo fib(45) = 1134903170 within 5 seconds"
+result=$(timeout 5 ./build/simplelang -O0 -r demos/memo.sl | grep "Return value:" | cut -d' ' -f3)
+if [ "$result" = "1134903170" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 10: Results evaluated at compile time match the JIT-run results"
+result=""
+for demo in fibonacci loops mathematics; do
+    folded=$(./build/simplelang --const-eval -r demos/$demo.sl)
+    runtime=$(./build/simplelang -r demos/$demo.sl | grep "Return value:")
+    if echo "$folded" | grep -q "Program evaluated at compile time" &&
+       [ "$(echo "$folded" | grep "Return value:")" = "$runtime" ]; then
+        result="$result ok"
+    else
+        result="$result $demo"
+    fi
+done
+if [ "$result" = " ok ok ok" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got$result)"
+fi
+
+echo "Test 11: && and || skip a right operand that divides by zero (result = 2)"
+result=""
+for level in -O0 -O2; do
+    result="$result$(./build/simplelang $level -r demos/short_circuit.sl | grep "Return value:" | cut -d' ' -f3) "
+done
+if [ "$result" = "2 2 " ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 12: Files that import each other compile once (twice(21) = 42)"
+result=$(./build/simplelang -r demos/imports/main.sl | grep "Return value:" | cut -d' ' -f3)
+if [ "$result" = "42" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 13: A function defined in two files is rejected"
+duplicate=$(mktemp --suffix=.sl)
+printf 'import "%s/demos/imports/main.sl";\n\nfunction one() {\n    return 2;\n}\n' "$PWD" > "$duplicate"
+result=$(./build/simplelang -r "$duplicate" 2>&1 | grep -o "Function one is defined in both")
+rm -f "$duplicate"
+if [ -n "$result" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (no duplicate definition error)"
+fi
+
+echo "Test 14: Sharded code generation (300 functions, -j 4) matches -j 1 (result = 44851)"
+many=$(mktemp --suffix=.sl)
+{
+    echo "function f0(n) { return n; }"
+    for i in $(seq 1 299); do
+        echo "function f$i(n) { return f$((i - 1))(n) + $i; }"
+    done
+    echo "function main() { return f299(1); }"
+} > "$many"
+result=""
+for jobs in 1 4; do
+    result="$result$(./build/simplelang -j $jobs -r "$many" | grep "Return value:" | cut -d' ' -f3) "
+done
+rm -f "$many"
+if [ "$result" = "44851 44851 " ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 15: i64 and f64 arithmetic (9000 + 4 + 15 = 9019)"
+result=$(./build/simplelang -r demos/numeric_types.sl | grep "Return value:" | cut -d' ' -f3)
+if [ "$result" = "9019" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 16: Arrays, len and counted for (5050 + 10100 + 100 = 15250)"
+result=$(./build/simplelang -r demos/arrays.sl | grep "Return value:" | cut -d' ' -f3)
+if [ "$result" = "15250" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 17: Passing the same array twice is rejected"
+aliased=$(mktemp --suffix=.sl)
+sed 's/double(b, a)/double(a, a)/' demos/arrays.sl > "$aliased"
+result=$(./build/simplelang -r "$aliased" 2>&1 | grep -o "Array a is passed to double more than once")
+rm -f "$aliased"
+if [ -n "$result" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (no aliasing error)"
+fi
+
+echo "Test 18: Parallel for reductions (+, *, min, max, empty range) on 1 and 4 threads"
+result=""
+for threads in 1 4; do
+    result="$result$(SIMPLELANG_THREADS=$threads ./build/simplelang -r demos/parallel_reductions.sl | grep "Return value:" | cut -d' ' -f3) "
+done
+if [ "$result" = "0 0 " ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got failed-check flags $result)"
+fi
+
+echo "Test 19: --auto-parallel fib(27) = 196418 on 1 and 4 threads, tree and --flat"
+result=""
+for threads in 1 4; do
+    for walker in "" "--flat"; do
+        result="$result$(SIMPLELANG_THREADS=$threads ./build/simplelang --auto-parallel $walker -r demos/parallel_fib.sl | grep "Return value:" | cut -d' ' -f3) "
+    done
+done
+if [ "$result" = "196418 196418 196418 196418 " ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 20: print/println output (i64, f64 shortest form, println()) precedes the result"
+expected="9000000000|-42|0.1|0.3333333333333333|1.521|Return value: 7|"
+result=$(./build/simplelang -r demos/printing.sl | sed '1,/=== EXECUTING WITH JIT ===/d' | grep -v "Program executed" | tr '\n' '|')
+if [ "$result" = "$expected" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 21: print/println output of a --exe build is flushed before exit"
+exe=$(mktemp)
+./build/simplelang --exe -o "$exe" demos/printing.sl > /dev/null
+result=$("$exe" | tr '\n' '|')
+rm -f "$exe"
+if [ "$result" = "$expected" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 22: @memo on a function that prints through a call is rejected"
+noisy=$(mktemp --suffix=.sl)
+cat > "$noisy" << 'EOF'
+function show(n) {
+    println(n);
+    return n;
+}
+
+@memo function noisy(n) {
+    return show(n);
+}
+
+function main() {
+    return noisy(1);
+}
+EOF
+result=$(./build/simplelang -r "$noisy" 2>&1 | grep -o "Cannot memoize noisy: it prints")
+rm -f "$noisy"
+if [ -n "$result" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (no memoization error)"
+fi
+
+echo "Test 23: Compile server batch under a 64-descriptor limit (300 programs)"
+batch=$(mktemp -d)
+for i in $(seq 1 300); do
+    echo "function main() { return $i; }" > "$batch/p$i.sl"
+done
+result=$(
+    ulimit -n 64
+    ./build/simplelang --server "$batch/sock" -j 4 2> "$batch/server.log" &
+    server=$!
+    for i in $(seq 1 50); do [ -S "$batch/sock" ] && break; sleep 0.1; done
+    ./build/simplelang -r --connect "$batch/sock" --each "$batch"/p*.sl 2>&1 > "$batch/out" || echo "exit $?"
+    kill $server; wait $server
+    grep -c "Return value:" "$batch/out"
+)
+rm -rf "$batch"
+if [ "$result" = "300" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 24: 100000-term operator chain at -O0 (sum = 100000)"
+chain=$(mktemp --suffix=.sl)
+echo "function main() { return 1$(printf ' + 1%.0s' $(seq 2 100000)); }" > "$chain"
+result=$(./build/simplelang -O0 -r "$chain" | grep "Return value:" | cut -d' ' -f3)
+rm -f "$chain"
+if [ "$result" = "100000" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 25: 200000 nested negations with --flat (result = 1)"
+nested=$(mktemp --suffix=.sl)
+echo "function main() { return $(printf -- '-%.0s' $(seq 1 200000))1; }" > "$nested"
+result=$(./build/simplelang --flat -r "$nested" | grep "Return value:" | cut -d' ' -f3)
+rm -f "$nested"
+if [ "$result" = "1" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 26: Arrays over the stack budget are rejected (i64[4000000])"
+big=$(mktemp --suffix=.sl)
+echo "function main() { var a: i64[4000000]; a[3] = 7; return i32(a[3]); }" > "$big"
+result=$(./build/simplelang -O0 -r "$big" 2>&1 | grep -o "a function's arrays may take at most 1048576 bytes")
+rm -f "$big"
+if [ -n "$result" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (no stack budget error)"
+fi
+
+echo "Test 27: Float literals beyond f64 are rejected"
+huge=$(mktemp --suffix=.sl)
+echo "function main() { var x = 1$(printf '0%.0s' $(seq 1 400)).0; return 0; }" > "$huge"
+result=$(./build/simplelang -r "$huge" 2>&1 | grep -o "Float literal out of range")
+rm -f "$huge"
+if [ -n "$result" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (no range error)"
+fi
+
+echo "Test 28: Bad numeric option values are usage errors (exit 1)"
+result=""
+for option in "-j" "--const-eval-budget" "--jit-cache-size"; do
+    ./build/simplelang $option x -r demos/loops.sl > /dev/null 2>&1
+    result="$result$?"
+done
+if [ "$result" = "111" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got exit statuses $result)"
+fi
+
+echo "Test 29: Concurrent JIT cache runs keep every count (20 runs)"
+cache=$(mktemp -d)
+for i in $(seq 1 20); do
+    ./build/simplelang -r --jit-cache "$cache" demos/fibonacci.sl > /dev/null 2>&1 &
+done
+wait
+read hits misses evictions < "$cache/stats"
+result="$((hits + misses)) lookups, $(ls "$cache" | grep -c "\.tmp$") temporaries"
+rm -rf "$cache"
+if [ "$result" = "20 lookups, 0 temporaries" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 30: Calls passing a caller's local array are not tail calls (walk(a, 3) = 4)"
+walk=$(mktemp --suffix=.sl)
+cat > "$walk" << 'EOF'
+function walk(a: i32[], n) {
+    if (n == 0) {
+        return a[0];
+    }
+    var b: i32[4];
+    b[0] = a[0] + 1;
+    return walk(b, n - 1);
+}
+
+function main() {
+    var a: i32[4];
+    a[0] = 1;
+    return walk(a, 3);
+}
+EOF
+sed 's/return walk(b, n - 1);/var r = walk(b, n - 1);\n    return r;/' "$walk" > "${walk%.sl}_var.sl"
+exe=$(mktemp)
+result=""
+for level in -O0 -O2; do
+    for program in "$walk" "${walk%.sl}_var.sl"; do
+        result="$result$(./build/simplelang $level -r "$program" | grep "Return value:" | cut -d' ' -f3) "
+    done
+    ./build/simplelang $level --exe -o "$exe" "$walk" > /dev/null
+    result="$result$("$exe" | grep "Return value:" | cut -d' ' -f3) "
+done
+rm -f "$walk" "${walk%.sl}_var.sl" "$exe"
+if [ "$result" = "4 4 4 4 4 4 " ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 31: A function named like a libc symbol does not replace it in --exe builds"
+clash=$(mktemp --suffix=.sl)
+cat > "$clash" << 'EOF'
+function write(a, b) {
+    return a + b;
+}
+
+function main() {
+    println(write(1, 2));
+    return write(3, 4);
+}
+EOF
+exe=$(mktemp)
+./build/simplelang --exe -o "$exe" "$clash" > /dev/null
+result=$(timeout 5 "$exe" | tr '\n' '|')
+rm -f "$clash" "$exe"
+if [ "$result" = "3|Return value: 7|" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 32: -c objects and -S assembly link into C through --emit-header declarations"
+native=$(mktemp -d)
+cat > "$native/calls.sl" << 'EOF'
+function add(a, b) {
+    return a + b;
+}
+
+function main() {
+    return add(20, 22);
+}
+EOF
+cat > "$native/caller.c" << 'EOF'
+#include <stdio.h>
+#include "calls.h"
+
+int main(void) {
+    printf("%d %d\n", sl_add(2, 3), simplelang_main());
+    return 0;
+}
+EOF
+./build/simplelang -c -o "$native/calls.o" --emit-header "$native/calls.h" "$native/calls.sl" > /dev/null
+./build/simplelang -S -o "$native/calls.s" "$native/calls.sl" > /dev/null
+result=""
+for input in calls.o calls.s; do
+    ${CC:-cc} -o "$native/caller" "$native/caller.c" "$native/$input" && result="$result$("$native/caller") "
+done
+rm -rf "$native"
+if [ "$result" = "5 42 5 42 " ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 33: --ssa on 300 variables merged through 300 ifs (result = 311)"
+vars=$(mktemp --suffix=.sl)
+{
+    echo "function main() {"
+    for i in $(seq 1 300); do
+        echo "    var v$i = $i;"
+    done
+    echo "    var i = 0;"
+    echo "    while (i < 10) {"
+    for i in $(seq 1 300); do
+        echo "        if (i < 5) { v$i = v$i + 1; }"
+    done
+    echo "        i = i + 1;"
+    echo "    }"
+    echo "    return v1 + v300;"
+    echo "}"
+} > "$vars"
+result=$(timeout 10 ./build/simplelang --ssa -O0 -r "$vars" | grep "Return value:" | cut -d' ' -f3)
+rm -f "$vars"
+if [ "$result" = "311" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 34: 50000-term && chain, tree and --flat (result = 7)"
+chain=$(mktemp --suffix=.sl)
+echo "function main() { var x = 1; if (x == 1$(printf ' && x == 1%.0s' $(seq 2 50000))) { return 7; } return 3; }" > "$chain"
+result=""
+for walker in "" "--flat"; do
+    result="$result$(./build/simplelang -O0 $walker -r "$chain" | grep "Return value:" | cut -d' ' -f3) "
+done
+rm -f "$chain"
+if [ "$result" = "7 7 " ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
+echo "Test 35: --const-eval skips && and || right operands that divide by zero (result = 2)"
+folded=$(./build/simplelang --const-eval -r demos/short_circuit.sl)
+result="$(echo "$folded" | grep -c "Program evaluated at compile time") $(echo "$folded" | grep "Return value:" | cut -d' ' -f3)"
+if [ "$result" = "1 2" ]; then
+    echo "✅ PASS"
+else
+    echo "❌ FAIL (got $result)"
+fi
+
 echo
 echo "=== Test Summary ==="
-total_tests=5
+total_tests=35
 echo "Total tests: $total_tests"
 echo "All tests completed!"